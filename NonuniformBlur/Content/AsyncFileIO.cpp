@@ -0,0 +1,232 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "AsyncFileIO.h"
+
+using namespace std;
+
+// Overlapped requests are split into chunks that fit a DWORD
+static const size_t g_maxChunkSize = 1 << 30;
+
+AsyncFileIO::AsyncFileIO() :
+	m_completionPort(nullptr),
+	m_maxInFlight(16),
+	m_numInFlight(0),
+	m_isQuitting(false)
+{
+}
+
+AsyncFileIO::~AsyncFileIO()
+{
+	Flush();
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_isQuitting = true;
+	}
+	m_requestReady.notify_all();
+
+	// A null completion wakes up and stops each completion thread
+	if (m_completionPort)
+		for (size_t i = 0; i < m_threads.size(); ++i)
+			PostQueuedCompletionStatus(m_completionPort, 0, 0, nullptr);
+
+	for (auto& thread : m_threads) thread.join();
+
+	if (m_completionPort) CloseHandle(m_completionPort);
+}
+
+bool AsyncFileIO::Init(uint32_t maxInFlight, uint8_t numThreads, bool useThreadPool)
+{
+	assert(m_threads.empty());
+	m_maxInFlight = (max)(maxInFlight, 1u);
+
+	if (!useThreadPool)
+	{
+		// Completions are cheap, so a single thread usually suffices
+		m_completionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 0);
+		if (m_completionPort)
+		{
+			m_threads.resize((max)(numThreads, static_cast<uint8_t>(1)));
+			for (auto& thread : m_threads) thread = std::thread(&AsyncFileIO::completionMain, this);
+
+			return true;
+		}
+	}
+
+	// Blocking I/O needs a thread per request in flight
+	m_threads.resize(numThreads ? numThreads : (min)(m_maxInFlight, 64u));
+	for (auto& thread : m_threads) thread = std::thread(&AsyncFileIO::workerMain, this);
+
+	return true;
+}
+
+void AsyncFileIO::Read(const char* fileName, const Callback& callback)
+{
+	unique_ptr<Request> request(new Request());
+	request->FileName = fileName;
+	request->Offset = 0;
+	request->IsWrite = false;
+	request->OnCompleted = callback;
+
+	submit(move(request));
+}
+
+void AsyncFileIO::Write(const char* fileName, vector<uint8_t>&& data, const Callback& callback)
+{
+	unique_ptr<Request> request(new Request());
+	request->FileName = fileName;
+	request->Data = move(data);
+	request->Offset = 0;
+	request->IsWrite = true;
+	request->OnCompleted = callback;
+
+	submit(move(request));
+}
+
+void AsyncFileIO::Flush()
+{
+	unique_lock<mutex> lock(m_mutex);
+	m_idle.wait(lock, [this] { return m_numInFlight == 0; });
+}
+
+void AsyncFileIO::submit(unique_ptr<Request>&& request)
+{
+	assert(!m_threads.empty());
+	request->File = INVALID_HANDLE_VALUE;
+
+	{
+		// Backpressure
+		unique_lock<mutex> lock(m_mutex);
+		m_slotReady.wait(lock, [this] { return m_numInFlight < m_maxInFlight; });
+		++m_numInFlight;
+
+		if (!m_completionPort)
+		{
+			m_requests.emplace_back(move(request));
+			m_requestReady.notify_one();
+
+			return;
+		}
+	}
+
+	issue(move(request));
+}
+
+void AsyncFileIO::complete(unique_ptr<Request>&& request, bool succeeded)
+{
+	if (request->File != INVALID_HANDLE_VALUE) CloseHandle(request->File);
+
+	if (request->OnCompleted) request->OnCompleted(request->FileName, request->Data, succeeded);
+	request.reset();
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		--m_numInFlight;
+	}
+	m_slotReady.notify_one();
+	m_idle.notify_all();
+}
+
+void AsyncFileIO::workerMain()
+{
+	for (;;)
+	{
+		unique_ptr<Request> request;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_requestReady.wait(lock, [this] { return !m_requests.empty() || m_isQuitting; });
+			if (m_requests.empty()) break;
+
+			request = move(m_requests.front());
+			m_requests.pop_front();
+		}
+
+		const auto succeeded = transfer(*request);
+		complete(move(request), succeeded);
+	}
+}
+
+bool AsyncFileIO::transfer(Request& request)
+{
+	if (request.IsWrite)
+	{
+		ofstream file(request.FileName, ios::binary);
+		XUSG_N_RETURN(file, false);
+
+		return static_cast<bool>(file.write(reinterpret_cast<const char*>(request.Data.data()), request.Data.size()));
+	}
+
+	ifstream file(request.FileName, ios::binary | ios::ate);
+	XUSG_N_RETURN(file, false);
+	request.Data.resize(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+
+	return static_cast<bool>(file.read(reinterpret_cast<char*>(request.Data.data()), request.Data.size()));
+}
+
+void AsyncFileIO::issue(unique_ptr<Request>&& request)
+{
+	const auto isWrite = request->IsWrite;
+	request->File = CreateFileA(request->FileName.c_str(), isWrite ? GENERIC_WRITE : GENERIC_READ,
+		isWrite ? 0 : FILE_SHARE_READ, nullptr, isWrite ? CREATE_ALWAYS : OPEN_EXISTING,
+		FILE_FLAG_OVERLAPPED | (isWrite ? 0 : FILE_FLAG_SEQUENTIAL_SCAN), nullptr);
+	if (request->File == INVALID_HANDLE_VALUE) return complete(move(request), false);
+
+	if (!isWrite)
+	{
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(request->File, &size)) return complete(move(request), false);
+		request->Data.resize(static_cast<size_t>(size.QuadPart));
+	}
+
+	// Nothing to transfer
+	if (request->Data.empty()) return complete(move(request), true);
+
+	if (!CreateIoCompletionPort(request->File, m_completionPort, 0, 0) || !issueNext(request.get()))
+		return complete(move(request), false);
+
+	// Owned by the completion port until completed
+	request.release();
+}
+
+bool AsyncFileIO::issueNext(Request* pRequest)
+{
+	const auto chunkSize = static_cast<DWORD>((min)(pRequest->Data.size() - pRequest->Offset, g_maxChunkSize));
+	pRequest->Overlapped = {};
+	pRequest->Overlapped.Offset = static_cast<DWORD>(pRequest->Offset);
+	pRequest->Overlapped.OffsetHigh = static_cast<DWORD>(static_cast<uint64_t>(pRequest->Offset) >> 32);
+
+	const auto pData = &pRequest->Data[pRequest->Offset];
+	const auto issued = pRequest->IsWrite ?
+		WriteFile(pRequest->File, pData, chunkSize, nullptr, &pRequest->Overlapped) :
+		ReadFile(pRequest->File, pData, chunkSize, nullptr, &pRequest->Overlapped);
+
+	// Synchronous completions are still queued to the completion port
+	return issued || GetLastError() == ERROR_IO_PENDING;
+}
+
+void AsyncFileIO::completionMain()
+{
+	for (;;)
+	{
+		DWORD numBytes;
+		ULONG_PTR key;
+		OVERLAPPED* pOverlapped;
+		const auto succeeded = GetQueuedCompletionStatus(m_completionPort, &numBytes, &key, &pOverlapped, INFINITE);
+		if (!pOverlapped) break;
+
+		unique_ptr<Request> request(CONTAINING_RECORD(pOverlapped, Request, Overlapped));
+		if (!succeeded || numBytes == 0)
+		{
+			complete(move(request), false);
+			continue;
+		}
+
+		request->Offset += numBytes;
+		if (request->Offset == request->Data.size()) complete(move(request), true);
+		else if (!issueNext(request.get())) complete(move(request), false);
+		else request.release();
+	}
+}
@@ -0,0 +1,63 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Asynchronous whole-file reads and writes with a bounded number of requests in flight.
+// On Windows, requests are issued as overlapped I/O and completed on an I/O completion
+// port; otherwise (or if requested) blocking I/O runs on a pool of worker threads.
+class AsyncFileIO
+{
+public:
+	// Called on an I/O thread when a request completes; write data are handed back for reuse
+	using Callback = std::function<void(const std::string& fileName, std::vector<uint8_t>& data, bool succeeded)>;
+
+	AsyncFileIO();
+	virtual ~AsyncFileIO();
+
+	bool Init(uint32_t maxInFlight = 16, uint8_t numThreads = 0, bool useThreadPool = false);
+
+	// Both block while maxInFlight requests are pending
+	void Read(const char* fileName, const Callback& callback);
+	void Write(const char* fileName, std::vector<uint8_t>&& data, const Callback& callback = nullptr);
+
+	// Wait until all issued requests are completed
+	void Flush();
+
+protected:
+	struct Request
+	{
+		OVERLAPPED				Overlapped;	// Completions find the request by CONTAINING_RECORD()
+		HANDLE					File;
+		std::string				FileName;
+		std::vector<uint8_t>	Data;
+		size_t					Offset;
+		bool					IsWrite;
+		Callback				OnCompleted;
+	};
+
+	void submit(std::unique_ptr<Request>&& request);
+	void complete(std::unique_ptr<Request>&& request, bool succeeded);
+	void workerMain();
+
+	void issue(std::unique_ptr<Request>&& request);
+	bool issueNext(Request* pRequest);
+	void completionMain();
+
+	HANDLE						m_completionPort;
+
+	static bool transfer(Request& request);
+
+	std::vector<std::thread>	m_threads;
+	std::mutex					m_mutex;
+	std::condition_variable		m_requestReady;
+	std::condition_variable		m_slotReady;
+	std::condition_variable		m_idle;
+
+	std::deque<std::unique_ptr<Request>> m_requests;
+
+	uint32_t					m_maxInFlight;
+	uint32_t					m_numInFlight;
+	bool						m_isQuitting;
+};
@@ -0,0 +1,540 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "BatchProcessor.h"
+#include "CommandLineArgs.h"
+
+using namespace std;
+using namespace DirectX;
+
+BatchProcessor::BatchProcessor() :
+	m_numReading(0),
+	m_memoryUsed(0),
+	m_focus(0.0f, 0.0f),
+	m_sigma(24.0f),
+	m_focusSmoothness(0.0f),
+	m_aspect(1.0f),
+	m_channelScales(1.0f, 1.0f, 1.0f, 1.0f),
+	m_bandPass(),
+	m_isBandPass(false),
+	m_bloom(),
+	m_isBloom(false),
+	m_rangeSigma(0.0f),
+	m_outputLevel(0),
+	m_memoryBudget(static_cast<size_t>(2048) << 20),
+	m_numReadsAhead(8),
+	m_numFinished(0),
+	m_numFailures(0),
+	m_numThreads(),
+	m_useThreadPool(false)
+{
+}
+
+BatchProcessor::~BatchProcessor()
+{
+}
+
+bool BatchProcessor::ParseCommandLineArgs(wchar_t* argv[], int argc)
+{
+	const CommandLineArgs args(argv, argc);
+
+	auto isBatch = false;
+	for (auto i = 1; i < argc; ++i)
+	{
+		if (args.IsMatched(i, L"b") || args.IsMatched(i, L"batch"))
+		{
+			if (args.HasNextValue(i)) m_input = CommandLineArgs::ToString(argv[++i]);
+			if (args.HasNextValue(i)) m_outputDir = CommandLineArgs::ToString(argv[++i]);
+			isBatch = true;
+		}
+		else if (args.IsMatched(i, L"format"))
+		{
+			if (args.HasNextValue(i)) m_outputExt = CommandLineArgs::ToString(argv[++i]);
+		}
+		else if (args.IsMatched(i, L"sigmamap"))
+		{
+			if (args.HasNextValue(i)) m_sigmaMapFileName = CommandLineArgs::ToString(argv[++i]);
+		}
+		else if (args.IsMatched(i, L"focuspoint"))
+		{
+			FilterCPU::FocusPoint point = { XMFLOAT2(0.0f, 0.0f), 1.0f };
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &point.Focus.x);
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &point.Focus.y);
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &point.SigmaScale);
+			m_focusPoints.push_back(point);
+		}
+		else if (args.IsMatched(i, L"smoothness"))
+		{
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_focusSmoothness);
+		}
+		else if (args.IsMatched(i, L"aspect"))
+		{
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_aspect);
+		}
+		else if (args.IsMatched(i, L"channelscales"))
+		{
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_channelScales.x);
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_channelScales.y);
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_channelScales.z);
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_channelScales.w);
+		}
+		else if (args.IsMatched(i, L"dog"))
+		{
+			// Of -sigma and a coarser sigma, biased to mid-grey for the unsigned formats
+			m_bandPass = { FilterCPU::DIFFERENCE_OF_GAUSSIANS, 0.0f, 0.0f, 1.0f, 0.5f };
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_bandPass.Sigma2);
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_bandPass.Amount);
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_bandPass.Bias);
+			m_isBandPass = true;
+		}
+		else if (args.IsMatched(i, L"unsharp") || args.IsMatched(i, L"clarity"))
+		{
+			m_bandPass = { args.IsMatched(i, L"unsharp") ? FilterCPU::UNSHARP_MASK : FilterCPU::CLARITY, 0.0f, 0.0f, 1.0f, 0.0f };
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_bandPass.Amount);
+			m_isBandPass = true;
+		}
+		else if (args.IsMatched(i, L"bloom"))
+		{
+			m_bloom = { 1.0f, 0.5f, 1.0f, 0.7f };
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_bloom.Threshold);
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_bloom.Knee);
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_bloom.Intensity);
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_bloom.Scatter);
+			m_isBloom = true;
+		}
+		else if (args.IsMatched(i, L"edgeaware"))
+		{
+			// Only the in-memory filter has the range term: not with -aspect, nor for streamed images
+			m_rangeSigma = 0.1f;
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_rangeSigma);
+		}
+		else if (args.IsMatched(i, L"readahead"))
+		{
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%u", &m_numReadsAhead);
+		}
+		else if (args.IsMatched(i, L"threadpool")) m_useThreadPool = true;
+		else if (args.IsMatched(i, L"threads"))
+		{
+			for (uint8_t j = 0; j < NUM_STAGE && args.HasNextValue(i); ++j)
+			{
+				auto numThreads = 0u;
+				i += swscanf_s(argv[i + 1], L"%u", &numThreads);
+				m_numThreads[j] = static_cast<uint8_t>((min)(numThreads, 255u));
+			}
+		}
+		else if (args.IsMatched(i, L"budget"))
+		{
+			auto budgetMB = 0u;
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%u", &budgetMB);
+			if (budgetMB) m_memoryBudget = static_cast<size_t>(budgetMB) << 20;
+		}
+		else if (args.IsMatched(i, L"s") || args.IsMatched(i, L"sigma"))
+		{
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_sigma);
+		}
+		else if (args.IsMatched(i, L"f") || args.IsMatched(i, L"focus"))
+		{
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_focus.x);
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_focus.y);
+		}
+		else if (args.IsMatched(i, L"u") || args.IsMatched(i, L"uniform"))
+			reinterpret_cast<uint32_t&>(m_focus.x) = UINT32_MAX;
+		else if (args.IsMatched(i, L"l") || args.IsMatched(i, L"level"))
+		{
+			auto level = 0u;
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%u", &level);
+			m_outputLevel = static_cast<uint8_t>((min)(level, 255u));
+		}
+	}
+
+	if (m_outputDir.empty()) m_outputDir = ".";
+	if (m_rangeSigma > 0.0f && m_aspect != 1.0f)
+	{
+		cerr << "-edgeaware is not supported with -aspect, and is ignored" << endl;
+		m_rangeSigma = 0.0f;
+	}
+
+	return isBatch;
+}
+
+bool BatchProcessor::Run()
+{
+	XUSG_N_RETURN(listInputFiles(), false);
+	XUSG_N_RETURN(m_sigmaMapFileName.empty() || m_sigmaMap.Open(m_sigmaMapFileName.c_str()), false);
+	CreateDirectoryA(m_outputDir.c_str(), nullptr);
+
+	// Most cores go to the filter stage by default
+	const auto numCores = (max)(thread::hardware_concurrency(), 1u);
+	if (!m_numThreads[DECODE]) m_numThreads[DECODE] = static_cast<uint8_t>((min)((max)(numCores / 4, 1u), 255u));
+	if (!m_numThreads[ENCODE]) m_numThreads[ENCODE] = static_cast<uint8_t>((min)((max)(numCores / 4, 1u), 255u));
+	if (!m_numThreads[FILTER]) m_numThreads[FILTER] = static_cast<uint8_t>((min)((max)(numCores / 2, 1u), 255u));
+
+	// Reads ahead and pending writes share the requests in flight
+	m_fileIO = make_unique<AsyncFileIO>();
+	XUSG_N_RETURN(m_fileIO->Init(m_numReadsAhead + 2 * m_numThreads[ENCODE], 0, m_useThreadPool), false);
+
+	// Each stage buffers at most one job ahead per consuming thread; loaded files are
+	// bounded by the read slots instead, so that I/O completions never block
+	m_queues[DECODE].SetCapacity(m_numReadsAhead);
+	m_queues[FILTER].SetCapacity(m_numThreads[FILTER]);
+	m_queues[ENCODE].SetCapacity(m_numThreads[ENCODE]);
+
+	void (BatchProcessor::*const stageMains[])() =
+	{ &BatchProcessor::decodeMain, &BatchProcessor::filterMain, &BatchProcessor::encodeMain };
+	for (uint8_t i = 0; i < NUM_STAGE; ++i)
+	{
+		m_threads[i].resize(m_numThreads[i]);
+		for (auto& thread : m_threads[i]) thread = std::thread(stageMains[i], this);
+	}
+
+	const auto onLoaded = [this](const string& fileName, vector<uint8_t>& data, bool succeeded)
+	{
+		unique_ptr<Job> job(new Job());
+		job->FileName = fileName;
+		job->FileData = move(data);
+		job->MemorySize = 0;
+		job->IsLoaded = succeeded;
+		m_queues[DECODE].Push(move(job));
+	};
+
+	// Keep the reads in flight ahead of the decode stage
+	for (const auto& fileName : m_inputFiles)
+	{
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_readSlotReady.wait(lock, [this] { return m_numReading < m_numReadsAhead; });
+			++m_numReading;
+		}
+
+		// Images streamed out of core skip the read, and are mapped by the decode stage instead
+		unique_ptr<Job> job(new Job());
+		{
+			MappedFile file;
+			job->IsStreamed = file.Open(fileName.c_str()) && ImageFile::ReadDesc(job->Desc,
+				fileName.c_str(), file.GetData(), file.GetSize()) && isStreamed(job->Desc);
+		}
+
+		if (job->IsStreamed)
+		{
+			job->FileName = fileName;
+			job->IsLoaded = true;
+			m_queues[DECODE].Push(move(job));
+		}
+		else m_fileIO->Read(fileName.c_str(), onLoaded);
+	}
+
+	{
+		unique_lock<mutex> lock(m_mutex);
+		m_readSlotReady.wait(lock, [this] { return m_numReading == 0; });
+	}
+
+	// Drain the stages in order
+	for (uint8_t i = 0; i < NUM_STAGE; ++i)
+	{
+		m_queues[i].Close();
+		for (auto& thread : m_threads[i]) thread.join();
+		m_threads[i].clear();
+	}
+
+	m_fileIO->Flush();
+
+	return m_numFailures == 0;
+}
+
+bool BatchProcessor::listInputFiles()
+{
+	m_inputFiles.clear();
+
+	const auto attributes = GetFileAttributesA(m_input.c_str());
+	XUSG_N_RETURN(attributes != INVALID_FILE_ATTRIBUTES, false);
+	if (!(attributes & FILE_ATTRIBUTE_DIRECTORY)) m_inputFiles.emplace_back(m_input);
+	else
+	{
+		WIN32_FIND_DATAA findData;
+		const auto hFind = FindFirstFileA((m_input + "\\*").c_str(), &findData);
+		XUSG_N_RETURN(hFind != INVALID_HANDLE_VALUE, false);
+		do if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+			m_inputFiles.emplace_back(m_input + "\\" + findData.cFileName);
+		while (FindNextFileA(hFind, &findData));
+		FindClose(hFind);
+	}
+
+	// Skip sidecar descriptors of raw images
+	m_inputFiles.erase(remove_if(m_inputFiles.begin(), m_inputFiles.end(), [](const string& fileName)
+		{ return fileName.size() > 5 && fileName.compare(fileName.size() - 5, 5, ".json") == 0; }), m_inputFiles.end());
+	sort(m_inputFiles.begin(), m_inputFiles.end());
+
+	return !m_inputFiles.empty();
+}
+
+string BatchProcessor::getOutputFileName(const string& inputFileName) const
+{
+	const auto nameStart = inputFileName.find_last_of("/\\") + 1;
+	const auto extStart = inputFileName.find_last_of('.');
+	const auto hasExt = extStart != string::npos && extStart > nameStart;
+	const auto baseName = inputFileName.substr(nameStart, (hasExt ? extStart : inputFileName.size()) - nameStart);
+
+	// Formats that cannot be written, e.g. JPEG, are saved as PNG
+	auto ext = m_outputExt;
+	if (ext.empty()) ext = hasExt && ImageFile::GetFormat(inputFileName.c_str()) != ImageFile::OTHER ?
+		inputFileName.substr(extStart + 1) : "png";
+
+	return m_outputDir + "/" + baseName + "." + ext;
+}
+
+void BatchProcessor::decodeMain()
+{
+	for (unique_ptr<Job> job; m_queues[DECODE].Pop(job);)
+	{
+		{
+			lock_guard<mutex> lock(m_mutex);
+			--m_numReading;
+		}
+		m_readSlotReady.notify_all();
+
+		if (decode(*job)) m_queues[FILTER].Push(move(job));
+		else finish(*job, false);
+	}
+}
+
+void BatchProcessor::filterMain()
+{
+	// The sigma map or focus points are kept across the images, and sampled at the size of each
+	FilterCPU filterCPU;
+	FilterStreamCPU filterStream;
+	FilterRipCPU filterRip;
+	if (!m_sigmaMapFileName.empty())
+	{
+		filterCPU.SetSigmaMap(m_sigmaMap);
+		filterStream.SetSigmaMap(m_sigmaMap);
+		filterRip.SetSigmaMap(m_sigmaMap);
+	}
+	if (!m_focusPoints.empty())
+	{
+		const auto numPoints = static_cast<uint32_t>(m_focusPoints.size());
+		filterCPU.SetFocusPoints(m_focusPoints.data(), numPoints, m_focusSmoothness);
+		filterStream.SetFocusPoints(m_focusPoints.data(), numPoints, m_focusSmoothness);
+		filterRip.SetFocusPoints(m_focusPoints.data(), numPoints, m_focusSmoothness);
+	}
+	filterCPU.SetChannelScales(m_channelScales);
+	filterCPU.SetEdgeAware(m_rangeSigma);
+	filterStream.SetChannelScales(m_channelScales);
+	filterRip.SetChannelScales(m_channelScales);
+
+	for (unique_ptr<Job> job; m_queues[FILTER].Pop(job);)
+	{
+		if (filter(*job, filterCPU, filterStream, filterRip)) m_queues[ENCODE].Push(move(job));
+		else finish(*job, false);
+	}
+}
+
+void BatchProcessor::encodeMain()
+{
+	// PNG bands of the encode threads share the cores
+	const auto numCores = (max)(thread::hardware_concurrency(), 1u);
+	const PNGEncoder pngEncoder(PNGEncoder::DEFAULT,
+		static_cast<uint8_t>((min)((max)(numCores / m_numThreads[ENCODE], 1u), 255u)));
+
+	for (unique_ptr<Job> job; m_queues[ENCODE].Pop(job);) encode(move(job), pngEncoder);
+}
+
+bool BatchProcessor::decode(Job& job)
+{
+	XUSG_N_RETURN(job.IsLoaded, false);
+
+	// Admit the image once its file, source, output and filter working set fit in the budget
+	auto& desc = job.Desc;
+	XUSG_N_RETURN(job.IsStreamed || ImageFile::ReadDesc(desc, job.FileName.c_str(),
+		job.FileData.data(), job.FileData.size()), false);
+	const auto level = getOutputLevel(desc.Width, desc.Height);
+	const auto pixelSize = static_cast<size_t>(desc.Comp) * ImageFile::GetElementSize(desc.Type);
+	const auto imageSize = pixelSize * desc.Width * desc.Height;
+
+	// Streamed images hold neither the file nor the output, and mapped sources are paged in
+	if (job.IsStreamed)
+	{
+		const auto format = ImageFile::GetFormat(job.FileName.c_str());
+		const auto isMapped = format == ImageFile::PNM || format == ImageFile::PFM || format == ImageFile::RAW;
+		job.MemorySize = (isMapped ? 0 : imageSize) + FilterStreamCPU::GetWorkingSetSize(desc.Width, desc.Height);
+		acquireMemory(job.MemorySize);
+		job.Image = make_unique<ImageFile>();
+
+		return job.Image->Open(job.FileName.c_str());
+	}
+
+	const auto outputSize = pixelSize * (max)(desc.Width >> level, 1u) * (max)(desc.Height >> level, 1u);
+	job.MemorySize = job.FileData.size() + imageSize + outputSize + getFilterMemorySize(desc);
+	acquireMemory(job.MemorySize);
+
+	job.Image = make_unique<ImageFile>();
+
+	return job.Image->Open(job.FileName.c_str(), move(job.FileData));
+}
+
+bool BatchProcessor::filter(Job& job, FilterCPU& filterCPU, FilterStreamCPU& filterStream, FilterRipCPU& filterRip)
+{
+	const auto& desc = job.Image->GetDesc();
+	const auto level = getOutputLevel(desc.Width, desc.Height);
+
+	// Uncompressed formats are stored straight into the file mapping, and streamed outputs are encoded in rows
+	auto outputDesc = desc;
+	outputDesc.Width = (max)(desc.Width >> level, 1u);
+	outputDesc.Height = (max)(desc.Height >> level, 1u);
+	job.OutputFileName = getOutputFileName(job.FileName);
+	unique_ptr<ImageFile> output(new ImageFile());
+	XUSG_N_RETURN(output->Create(job.OutputFileName.c_str(), outputDesc, job.IsStreamed), false);
+
+	// Raw images of more than 4 channels, e.g. feature maps, are only blurred, all channels at once.
+	// The band-pass and bloom outputs take the whole pyramid, the anisotropic blur takes its rip
+	// levels, and otherwise images whose pyramid exceeds the memory budget are streamed in rows
+	if (desc.Comp > 4)
+	{
+		XUSG_N_RETURN(filterChannels<8>(*job.Image, *output, level), false);
+	}
+	else if (m_isBandPass || m_isBloom)
+	{
+		XUSG_N_RETURN(filterCPU.Init(*job.Image), false);
+		filterCPU.UpdateFrame(m_focus, m_sigma);
+
+		FilterCPU::Image result;
+		if (m_isBandPass)
+		{
+			auto bandPass = m_bandPass;
+			bandPass.Sigma = m_sigma;
+			filterCPU.ProcessBandPass(result, bandPass, level);
+		}
+		else
+		{
+			filterCPU.Process(level);
+			filterCPU.ProcessBloom(result, m_bloom, level);
+		}
+
+		// The bloom is composited with its own alpha, so that it remains over transparent pixels here
+		FilterCPU::Unpremultiply(result.Pixels.data(), result.Pixels.data(), result.Pixels.size());
+		output->WriteRows(0, result.Height, &result.Pixels[0].x, sizeof(XMFLOAT4) * result.Width, 4);
+	}
+	else if (m_aspect != 1.0f)
+	{
+		XUSG_N_RETURN(filterRip.Init(*job.Image), false);
+		filterRip.UpdateFrame(m_focus, m_sigma, m_aspect);
+		filterRip.Process();
+		filterRip.WriteResult(*output);
+	}
+	else if (job.IsStreamed)
+	{
+		if (m_rangeSigma > 0.0f) cerr << job.FileName << " exceeds the memory budget, and is streamed without -edgeaware" << endl;
+		XUSG_N_RETURN(filterStream.Init(*job.Image), false);
+		filterStream.UpdateFrame(m_focus, m_sigma);
+		XUSG_N_RETURN(filterStream.Process(*output, level), false);
+	}
+	else
+	{
+		XUSG_N_RETURN(filterCPU.Init(*job.Image), false);
+		filterCPU.UpdateFrame(m_focus, m_sigma);
+		filterCPU.Process(level);
+		filterCPU.WriteResult(*output, level);
+	}
+
+	job.Image = move(output);
+
+	return true;
+}
+
+template<uint8_t N>
+bool BatchProcessor::filterChannels(const ImageFile& source, ImageFile& output, uint8_t level) const
+{
+	// Instantiated for the multiples of 8 channels up to the most of a raw file
+	const auto& desc = source.GetDesc();
+	if (N < ImageFile::MaxRawComp && desc.Comp > N)
+		return filterChannels<(N < ImageFile::MaxRawComp ? N + 8 : N)>(source, output, level);
+
+	FilterChannelsCPU<N> filter;
+	XUSG_N_RETURN(filter.Init(reinterpret_cast<const float*>(source.GetRow(0)), desc.Width, desc.Height, desc.Comp), false);
+	if (!m_sigmaMapFileName.empty()) filter.SetSigmaMap(m_sigmaMap);
+	if (!m_focusPoints.empty())
+		filter.SetFocusPoints(m_focusPoints.data(), static_cast<uint32_t>(m_focusPoints.size()), m_focusSmoothness);
+	filter.UpdateFrame(m_focus, m_sigma);
+	filter.Process(level);
+
+	// The rows of raw files are contiguous
+	filter.GetResult(reinterpret_cast<float*>(output.GetRow(0)), level, desc.Comp);
+
+	return true;
+}
+
+bool BatchProcessor::isStreamed(const ImageFile::Desc& desc) const
+{
+	// Only the isotropic blur streams, once its pyramid exceeds the memory budget
+	return desc.Comp <= 4 && !m_isBandPass && !m_isBloom && m_aspect == 1.0f &&
+		FilterCPU::GetWorkingSetSize(desc.Width, desc.Height) > m_memoryBudget;
+}
+
+size_t BatchProcessor::getFilterMemorySize(const ImageFile::Desc& desc) const
+{
+	// Plus the up-sampled levels of the two frames of the DoG, or of the bloom, and the result;
+	// the levels of more than 4 channels hold blocks of 8
+	if (desc.Comp > 4) return FilterChannelsCPU<8>::GetWorkingSetSize(desc.Width, desc.Height) * ((desc.Comp + 7) / 8);
+	if (m_isBandPass || m_isBloom) return 5 * FilterCPU::GetWorkingSetSize(desc.Width, desc.Height) / 2;
+	if (m_aspect != 1.0f) return FilterRipCPU::GetWorkingSetSize(desc.Width, desc.Height);
+
+	return FilterCPU::GetWorkingSetSize(desc.Width, desc.Height);
+}
+
+uint8_t BatchProcessor::getOutputLevel(uint32_t width, uint32_t height) const
+{
+	// Clamped to the coarsest level of the full mip chain; the anisotropic blur is at the full resolution
+	if (m_aspect != 1.0f && !m_isBandPass && !m_isBloom) return 0;
+
+	uint8_t numLevels = 1;
+	while ((max)(width, height) >> numLevels) ++numLevels;
+
+	return (min)(m_outputLevel, static_cast<uint8_t>(numLevels - 1));
+}
+
+void BatchProcessor::encode(unique_ptr<Job>&& job, const PNGEncoder& pngEncoder)
+{
+	// Compressed formats are encoded in memory and written asynchronously, unless already streamed to the file
+	vector<uint8_t> fileData;
+	const auto succeeded = job->Image->Close(fileData, &pngEncoder);
+	job->Image.reset();
+	if (!succeeded || fileData.empty()) return finish(*job, succeeded);
+
+	// The job keeps its memory until written
+	const shared_ptr<Job> pJob(move(job));
+	m_fileIO->Write(pJob->OutputFileName.c_str(), move(fileData),
+		[this, pJob](const string&, vector<uint8_t>&, bool succeeded) { finish(*pJob, succeeded); });
+}
+
+void BatchProcessor::finish(const Job& job, bool succeeded)
+{
+	releaseMemory(job.MemorySize);
+
+	lock_guard<mutex> lock(m_mutex);
+	++m_numFinished;
+	if (succeeded) cout << "[" << m_numFinished << "/" << m_inputFiles.size() << "] " << job.FileName << endl;
+	else
+	{
+		cerr << "Failed to process " << job.FileName << endl;
+		++m_numFailures;
+	}
+}
+
+void BatchProcessor::acquireMemory(size_t size)
+{
+	// An image larger than the whole budget is admitted alone
+	unique_lock<mutex> lock(m_mutex);
+	m_memoryReady.wait(lock, [this, size] { return m_memoryUsed == 0 || m_memoryUsed + size <= m_memoryBudget; });
+	m_memoryUsed += size;
+}
+
+void BatchProcessor::releaseMemory(size_t size)
+{
+	if (!size) return;
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_memoryUsed -= size;
+	}
+	m_memoryReady.notify_all();
+}
@@ -0,0 +1,107 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "AsyncFileIO.h"
+#include "BoundedQueue.h"
+#include "FilterChannelsCPU.h"
+#include "FilterRipCPU.h"
+#include "FilterStreamCPU.h"
+#include "PNGEncoder.h"
+
+// Batch mode: filters a directory of images with the CPU filter, without a window.
+// Files are read ahead asynchronously, then decoded, filtered and encoded by separate
+// stages with their own threads; bounded queues between the stages propagate
+// backpressure, and images are only admitted while they fit in the memory budget.
+class BatchProcessor
+{
+public:
+	enum Stage : uint8_t
+	{
+		DECODE,
+		FILTER,
+		ENCODE,
+
+		NUM_STAGE
+	};
+
+	BatchProcessor();
+	virtual ~BatchProcessor();
+
+	// Returns true if batch mode is requested
+	bool ParseCommandLineArgs(wchar_t* argv[], int argc);
+	bool Run();
+
+protected:
+	struct Job
+	{
+		std::string					FileName;
+		std::string					OutputFileName;
+		std::vector<uint8_t>		FileData;
+		std::unique_ptr<ImageFile>	Image;		// Decoded source, then the filtered output
+		ImageFile::Desc				Desc;		// Of the source, peeked if streamed
+		size_t						MemorySize;	// Charged to the memory budget
+		bool						IsLoaded;
+		bool						IsStreamed;	// Mapped instead of read, and encoded in rows
+	};
+
+	using JobQueue = BoundedQueue<std::unique_ptr<Job>>;
+
+	bool listInputFiles();
+	std::string getOutputFileName(const std::string& inputFileName) const;
+
+	void decodeMain();
+	void filterMain();
+	void encodeMain();
+
+	bool decode(Job& job);
+	bool filter(Job& job, FilterCPU& filterCPU, FilterStreamCPU& filterStream, FilterRipCPU& filterRip);
+	template<uint8_t N>
+	bool filterChannels(const ImageFile& source, ImageFile& output, uint8_t level) const;
+	bool isStreamed(const ImageFile::Desc& desc) const;
+	size_t getFilterMemorySize(const ImageFile::Desc& desc) const;
+	uint8_t getOutputLevel(uint32_t width, uint32_t height) const;
+	void encode(std::unique_ptr<Job>&& job, const PNGEncoder& pngEncoder);
+	void finish(const Job& job, bool succeeded);
+
+	void acquireMemory(size_t size);
+	void releaseMemory(size_t size);
+
+	std::string					m_input;
+	std::string					m_outputDir;
+	std::string					m_outputExt;	// Empty for the format of each input
+	std::vector<std::string>	m_inputFiles;
+	std::string					m_sigmaMapFileName;
+	ImageFile					m_sigmaMap;		// Shared by the filter threads
+	std::vector<FilterCPU::FocusPoint> m_focusPoints;
+
+	std::unique_ptr<AsyncFileIO> m_fileIO;
+	JobQueue					m_queues[NUM_STAGE];
+	std::vector<std::thread>	m_threads[NUM_STAGE];
+
+	std::mutex					m_mutex;
+	std::condition_variable		m_readSlotReady;
+	std::condition_variable		m_memoryReady;
+	uint32_t					m_numReading;	// Issued reads not yet taken by the decode stage
+	size_t						m_memoryUsed;
+
+	DirectX::XMFLOAT2			m_focus;
+	float						m_sigma;
+	float						m_focusSmoothness;
+	float						m_aspect;		// Of the sigma along x to that along y
+	DirectX::XMFLOAT4			m_channelScales;	// Of the sigma, per channel
+	FilterCPU::BandPass			m_bandPass;		// Its sigma is that of the blur
+	bool						m_isBandPass;	// Output the band pass instead of the blur
+	FilterCPU::Bloom			m_bloom;
+	bool						m_isBloom;		// Composite the bloom over the blur
+	float						m_rangeSigma;	// Of the edge-aware blend of the in-memory filter, or 0; not streamed
+	uint8_t						m_outputLevel;	// Pyramid level of the output, 0 for the full resolution
+	size_t						m_memoryBudget;
+	uint32_t					m_numReadsAhead;
+	uint32_t					m_numFinished;
+	uint32_t					m_numFailures;
+	uint8_t						m_numThreads[NUM_STAGE];
+	bool						m_useThreadPool;
+};
@@ -0,0 +1,94 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Blocking FIFO with a capacity, for handing jobs between pipeline stages;
+// a full queue blocks the producer, which propagates backpressure upstream.
+template<typename T>
+class BoundedQueue
+{
+public:
+	BoundedQueue(size_t capacity = SIZE_MAX);
+	virtual ~BoundedQueue();
+
+	void SetCapacity(size_t capacity);
+
+	// Blocks while the queue is full
+	void Push(T&& item);
+
+	// Blocks while the queue is empty; returns false once the queue is closed and drained
+	bool Pop(T& item);
+
+	// Signals that no more items will be pushed
+	void Close();
+
+protected:
+	std::mutex				m_mutex;
+	std::condition_variable	m_notEmpty;
+	std::condition_variable	m_notFull;
+	std::deque<T>			m_items;
+
+	size_t					m_capacity;
+	bool					m_isClosed;
+};
+
+template<typename T>
+BoundedQueue<T>::BoundedQueue(size_t capacity) :
+	m_capacity((std::max)(capacity, static_cast<size_t>(1))),
+	m_isClosed(false)
+{
+}
+
+template<typename T>
+BoundedQueue<T>::~BoundedQueue()
+{
+}
+
+template<typename T>
+void BoundedQueue<T>::SetCapacity(size_t capacity)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_capacity = (std::max)(capacity, static_cast<size_t>(1));
+	}
+	m_notFull.notify_all();
+}
+
+template<typename T>
+void BoundedQueue<T>::Push(T&& item)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notFull.wait(lock, [this] { return m_items.size() < m_capacity; });
+		m_items.emplace_back(std::move(item));
+	}
+	m_notEmpty.notify_one();
+}
+
+template<typename T>
+bool BoundedQueue<T>::Pop(T& item)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notEmpty.wait(lock, [this] { return !m_items.empty() || m_isClosed; });
+		if (m_items.empty()) return false;
+
+		item = std::move(m_items.front());
+		m_items.pop_front();
+	}
+	m_notFull.notify_one();
+
+	return true;
+}
+
+template<typename T>
+void BoundedQueue<T>::Close()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isClosed = true;
+	}
+	m_notEmpty.notify_all();
+}
@@ -0,0 +1,49 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "CommandLineArgs.h"
+
+using namespace std;
+
+CommandLineArgs::CommandLineArgs(wchar_t* argv[], int argc) :
+	m_argv(argv),
+	m_argc(argc)
+{
+}
+
+CommandLineArgs::~CommandLineArgs()
+{
+}
+
+bool CommandLineArgs::IsMatched(int i, const wchar_t* paramName) const
+{
+	const auto& arg = m_argv[i];
+
+	return (arg[0] == L'-' || arg[0] == L'/')
+		&& ToLower(&arg[1]) == ToLower(paramName);
+}
+
+bool CommandLineArgs::HasNextValue(int i) const
+{
+	if (i + 1 >= m_argc) return false;
+	const auto& arg = m_argv[i + 1];
+
+	return arg[0] != L'/' &&
+		(arg[0] != L'-' || (arg[1] >= L'0' && arg[1] <= L'9') || arg[1] == L'.');
+}
+
+wstring CommandLineArgs::ToLower(wstring str)
+{
+	transform(str.begin(), str.end(), str.begin(), [](wchar_t c) { return towlower(c); });
+
+	return str;
+}
+
+string CommandLineArgs::ToString(const wchar_t* arg)
+{
+	string str(wcslen(arg), '\0');
+	for (size_t j = 0; j < str.size(); ++j) str[j] = static_cast<char>(arg[j]);
+
+	return str;
+}
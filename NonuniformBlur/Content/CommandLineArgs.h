@@ -0,0 +1,24 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Matching of the command-line switches shared by the processors; switches start with '-' or '/',
+// and are matched case-insensitively
+class CommandLineArgs
+{
+public:
+	CommandLineArgs(wchar_t* argv[], int argc);
+	virtual ~CommandLineArgs();
+
+	bool IsMatched(int i, const wchar_t* paramName) const;
+	bool HasNextValue(int i) const;	// Negative numbers are values rather than switches
+
+	static std::wstring ToLower(std::wstring str);
+	static std::string ToString(const wchar_t* arg);
+
+protected:
+	wchar_t**	m_argv;
+	int			m_argc;
+};
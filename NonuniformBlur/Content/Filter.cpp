@@ -15,8 +15,33 @@ struct CBGaussian
 {
 	XMFLOAT2	Focus;
 	float		Sigma;
+	uint32_t	UseSigmaMap;
 };
 
+// The up-sampling blend lerps to the premultiplied coarser color by the factor of the second
+// source, so that alpha is blended like the colors
+static const Graphics::Blend* GetUpSampleBlend()
+{
+	static const auto blend = []()
+	{
+		Graphics::Blend blend = {};
+		auto& rtBlend = blend.RenderTargets[0];
+		rtBlend.BlendEnable = true;
+		rtBlend.SrcBlend = BlendFactor::SRC1_ALPHA;
+		rtBlend.DestBlend = BlendFactor::INV_SRC1_ALPHA;
+		rtBlend.BlendOp = BlendOperator::ADD;
+		rtBlend.SrcBlendAlpha = BlendFactor::SRC1_ALPHA;
+		rtBlend.DestBlendAlpha = BlendFactor::INV_SRC1_ALPHA;
+		rtBlend.BlendOpAlpha = BlendOperator::ADD;
+		rtBlend.LogicOp = LogicOperator::NOOP;
+		rtBlend.WriteMask = ColorWrite::ALL;
+
+		return blend;
+	}();
+
+	return &blend;
+}
+
 Filter::Filter() :
 	m_imageSize(1, 1)
 {
@@ -28,7 +53,8 @@ Filter::~Filter()
 }
 
 bool Filter::Init(CommandList* pCommandList, const DescriptorTableLib::sptr& descriptorTableLib,
-	vector<Resource::uptr>& uploaders, Format rtFormat, const char* fileName, bool typedUAV)
+	vector<Resource::uptr>& uploaders, Format rtFormat, const char* fileName, bool typedUAV,
+	const char* sigmaMapFileName)
 {
 	const auto pDevice = pCommandList->GetDevice();
 	m_graphicsPipelineLib = Graphics::PipelineLib::MakeUnique(pDevice);
@@ -44,6 +70,15 @@ bool Filter::Init(CommandList* pCommandList, const DescriptorTableLib::sptr& des
 	XUSG_N_RETURN(CreateTextureFromFile(pCommandList, fileName, m_source.get(),
 		uploaders.back().get(), ResourceState::COMMON, MemoryFlag::NONE, L"Source"), false);
 
+	// Load the sigma map, of any size
+	if (sigmaMapFileName)
+	{
+		m_sigmaMap = Texture::MakeUnique();
+		uploaders.emplace_back(Resource::MakeUnique());
+		XUSG_N_RETURN(CreateTextureFromFile(pCommandList, sigmaMapFileName, m_sigmaMap.get(),
+			uploaders.back().get(), ResourceState::COMMON, MemoryFlag::NONE, L"SigmaMap"), false);
+	}
+
 	// Create resources and pipelines
 	m_imageSize.x = static_cast<uint32_t>(m_source->GetWidth());
 	m_imageSize.y = m_source->GetHeight();
@@ -73,11 +108,14 @@ void Filter::UpdateFrame(DirectX::XMFLOAT2 focus, float sigma, uint8_t frameInde
 		const auto pCbData = reinterpret_cast<CBGaussian*>(m_cbPerFrame->Map(frameIndex));
 		pCbData->Focus = focus;
 		pCbData->Sigma = sigma;
+		pCbData->UseSigmaMap = m_sigmaMap ? 1 : 0;
 	}
 }
 
-void Filter::Process(CommandList* pCommandList, uint8_t frameIndex, PipelineType pipelineType)
+void Filter::Process(CommandList* pCommandList, uint8_t frameIndex, PipelineType pipelineType, uint8_t outputLevel)
 {
+	outputLevel = (min)(outputLevel, static_cast<uint8_t>(m_filtered->GetNumMips() - 1));
+
 	ResourceBarrier barriers[2];
 	uint32_t numBarriers;
 
@@ -85,16 +123,16 @@ void Filter::Process(CommandList* pCommandList, uint8_t frameIndex, PipelineType
 	{
 	case GRAPHICS:
 		numBarriers = generateMipsGraphics(pCommandList, barriers);
-		upsampleGraphics(pCommandList, barriers, numBarriers, frameIndex);
+		upsampleGraphics(pCommandList, barriers, numBarriers, frameIndex, outputLevel);
 		break;
 	case COMPUTE:
 		numBarriers = generateMipsCompute(pCommandList, barriers);
-		upsampleCompute(pCommandList, barriers, numBarriers, frameIndex);
+		upsampleCompute(pCommandList, barriers, numBarriers, frameIndex, outputLevel);
 		break;
 	default:
 		numBarriers = generateMipsCompute(pCommandList, barriers);
 		m_filtered->SetBarrier(barriers, m_filtered->GetNumMips() - 1, ResourceState::UNORDERED_ACCESS, --numBarriers);
-		upsampleGraphics(pCommandList, barriers, numBarriers, frameIndex);
+		upsampleGraphics(pCommandList, barriers, numBarriers, frameIndex, outputLevel);
 	}
 }
 
@@ -103,10 +141,15 @@ Resource* Filter::GetResult() const
 	return m_filtered.get();
 }
 
-void Filter::GetImageSize(uint32_t& width, uint32_t& height) const
+void Filter::GetImageSize(uint32_t& width, uint32_t& height, uint8_t level) const
 {
-	width = m_imageSize.x;
-	height = m_imageSize.y;
+	width = (max)(m_imageSize.x >> level, 1u);
+	height = (max)(m_imageSize.y >> level, 1u);
+}
+
+uint8_t Filter::GetNumLevels() const
+{
+	return m_filtered->GetNumMips();
 }
 
 bool Filter::createPipelineLayouts()
@@ -132,6 +175,10 @@ bool Filter::createPipelineLayouts()
 			m_pipelineLayoutLib.get(), PipelineLayoutFlag::NONE, L"ComputeBlitLayout"), false);
 	}
 
+	// Blits premultiplying the source share the layouts
+	m_pipelineLayouts[BLIT_PREMUL_GRAPHICS] = m_pipelineLayouts[BLIT_GRAPHICS];
+	m_pipelineLayouts[BLIT_PREMUL_COMPUTE] = m_pipelineLayouts[BLIT_COMPUTE];
+
 	// Up sampling graphics with alpha blending
 	{
 		const auto utilPipelineLayout = Util::PipelineLayout::MakeUnique();
@@ -139,8 +186,10 @@ bool Filter::createPipelineLayouts()
 		utilPipelineLayout->SetRange(1, DescriptorType::SRV, 1, 0);
 		utilPipelineLayout->SetRootCBV(2, 0, 0, Shader::PS);
 		utilPipelineLayout->SetConstants(3, XUSG_UINT32_SIZE_OF(uint32_t), 1, 0, Shader::PS);
+		utilPipelineLayout->SetRange(4, DescriptorType::SRV, 1, 2);
 		utilPipelineLayout->SetShaderStage(0, Shader::PS);
 		utilPipelineLayout->SetShaderStage(1, Shader::PS);
+		utilPipelineLayout->SetShaderStage(4, Shader::PS);
 		XUSG_X_RETURN(m_pipelineLayouts[UP_SAMPLE_BLEND], utilPipelineLayout->GetPipelineLayout(
 			m_pipelineLayoutLib.get(), PipelineLayoutFlag::NONE, L"UpSamplingBlendLayout"), false);
 	}
@@ -153,6 +202,7 @@ bool Filter::createPipelineLayouts()
 		utilPipelineLayout->SetRange(2, DescriptorType::SRV, 1, 0);
 		utilPipelineLayout->SetRootCBV(3, 0);
 		utilPipelineLayout->SetConstants(4, XUSG_UINT32_SIZE_OF(uint32_t), 1);
+		utilPipelineLayout->SetRange(5, DescriptorType::SRV, 1, 2);
 		XUSG_X_RETURN(m_pipelineLayouts[UP_SAMPLE_INPLACE], utilPipelineLayout->GetPipelineLayout(
 			m_pipelineLayoutLib.get(), PipelineLayoutFlag::NONE, L"UpSamplingInPlaceLayout"), false);
 	}
@@ -164,8 +214,10 @@ bool Filter::createPipelineLayouts()
 		utilPipelineLayout->SetRange(1, DescriptorType::SRV, 2, 0);
 		utilPipelineLayout->SetRootCBV(2, 0, 0, Shader::PS);
 		utilPipelineLayout->SetConstants(3, XUSG_UINT32_SIZE_OF(uint32_t), 1, 0, Shader::PS);
+		utilPipelineLayout->SetRange(4, DescriptorType::SRV, 1, 2);
 		utilPipelineLayout->SetShaderStage(0, Shader::PS);
 		utilPipelineLayout->SetShaderStage(1, Shader::PS);
+		utilPipelineLayout->SetShaderStage(4, Shader::PS);
 		XUSG_X_RETURN(m_pipelineLayouts[UP_SAMPLE_GRAPHICS], utilPipelineLayout->GetPipelineLayout(
 			m_pipelineLayoutLib.get(), PipelineLayoutFlag::NONE, L"UpSamplingGraphicsLayout"), false);
 	}
@@ -178,10 +230,19 @@ bool Filter::createPipelineLayouts()
 		utilPipelineLayout->SetRange(2, DescriptorType::SRV, 2, 0);
 		utilPipelineLayout->SetRootCBV(3, 0);
 		utilPipelineLayout->SetConstants(4, XUSG_UINT32_SIZE_OF(uint32_t), 1);
+		utilPipelineLayout->SetRange(5, DescriptorType::SRV, 1, 2);
 		XUSG_X_RETURN(m_pipelineLayouts[UP_SAMPLE_COMPUTE], utilPipelineLayout->GetPipelineLayout(
 			m_pipelineLayoutLib.get(), PipelineLayoutFlag::NONE, L"UpSamplingComputeLayout"), false);
 	}
 
+	// Un-premultiplying the result at a reduced level, in-place
+	{
+		const auto utilPipelineLayout = Util::PipelineLayout::MakeUnique();
+		utilPipelineLayout->SetRange(0, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		XUSG_X_RETURN(m_pipelineLayouts[UNPREMULTIPLY], utilPipelineLayout->GetPipelineLayout(
+			m_pipelineLayoutLib.get(), PipelineLayoutFlag::NONE, L"UnpremultiplyLayout"), false);
+	}
+
 	return true;
 }
 
@@ -217,6 +278,31 @@ bool Filter::createPipelines(Format rtFormat)
 		XUSG_X_RETURN(m_pipelines[BLIT_COMPUTE], state->GetPipeline(m_computePipelineLib.get(), L"Blit_compute"), false);
 	}
 
+	// Blit graphics, premultiplying the source
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::PS, psIndex, L"PSBlit2D_premul.cso"), false);
+
+		const auto state = Graphics::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[BLIT_PREMUL_GRAPHICS]);
+		state->SetShader(Shader::Stage::VS, m_shaderLib->GetShader(Shader::Stage::VS, vsIndex));
+		state->SetShader(Shader::Stage::PS, m_shaderLib->GetShader(Shader::Stage::PS, psIndex++));
+		state->DSSetState(Graphics::DEPTH_STENCIL_NONE, m_graphicsPipelineLib.get());
+		state->IASetPrimitiveTopologyType(PrimitiveTopologyType::TRIANGLE);
+		state->OMSetNumRenderTargets(1);
+		state->OMSetRTVFormat(0, rtFormat);
+		XUSG_X_RETURN(m_pipelines[BLIT_PREMUL_GRAPHICS], state->GetPipeline(m_graphicsPipelineLib.get(), L"Blit_premul_graphics"), false);
+	}
+
+	// Blit compute, premultiplying the source
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSBlit2D_premul.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[BLIT_PREMUL_COMPUTE]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[BLIT_PREMUL_COMPUTE], state->GetPipeline(m_computePipelineLib.get(), L"Blit_premul_compute"), false);
+	}
+
 	// Up sampling graphics with alpha blending
 	{
 		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::PS, psIndex, L"PSUpSample_blend.cso"), false);
@@ -227,7 +313,7 @@ bool Filter::createPipelines(Format rtFormat)
 		state->SetShader(Shader::Stage::PS, m_shaderLib->GetShader(Shader::Stage::PS, psIndex++));
 		state->DSSetState(Graphics::DEPTH_STENCIL_NONE, m_graphicsPipelineLib.get());
 		state->IASetPrimitiveTopologyType(PrimitiveTopologyType::TRIANGLE);
-		state->OMSetBlendState(Graphics::NON_PRE_MUL, m_graphicsPipelineLib.get());
+		state->OMSetBlendState(GetUpSampleBlend());
 		state->OMSetNumRenderTargets(1);
 		state->OMSetRTVFormat(0, rtFormat);
 		XUSG_X_RETURN(m_pipelines[UP_SAMPLE_BLEND], state->GetPipeline(m_graphicsPipelineLib.get(), L"UpSampling_alpha_blend"), false);
@@ -264,10 +350,20 @@ bool Filter::createPipelines(Format rtFormat)
 
 		const auto state = Compute::State::MakeUnique();
 		state->SetPipelineLayout(m_pipelineLayouts[UP_SAMPLE_COMPUTE]);
-		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex));
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
 		XUSG_X_RETURN(m_pipelines[UP_SAMPLE_COMPUTE], state->GetPipeline(m_computePipelineLib.get(), L"UpSampling_compute"), false);
 	}
 
+	// Un-premultiplying the result at a reduced level, in-place
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, m_typedUAV ? L"CSUnpremultiply.cso" : L"CSUnpremultiply_typeless.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[UNPREMULTIPLY]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex));
+		XUSG_X_RETURN(m_pipelines[UNPREMULTIPLY], state->GetPipeline(m_computePipelineLib.get(), L"Unpremultiply"), false);
+	}
+
 	return true;
 }
 
@@ -306,6 +402,13 @@ bool Filter::createDescriptorTables()
 		XUSG_X_RETURN(m_srvTables[i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
 	}
 
+	// Get the SRV of the sigma map
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		descriptorTable->SetDescriptors(0, 1, m_sigmaMap ? &m_sigmaMap->GetSRV() : &m_source->GetSRV());
+		XUSG_X_RETURN(m_sigmaMapTable, descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
 	// Create the sampler table
 	const auto descriptorTable = Util::DescriptorTable::MakeUnique();
 	const auto sampler = LINEAR_CLAMP;
@@ -317,21 +420,40 @@ bool Filter::createDescriptorTables()
 
 uint32_t Filter::generateMipsGraphics(CommandList* pCommandList, ResourceBarrier* pBarriers)
 {
-	// Generate mipmaps
+	// Generate mipmaps; the first one premultiplies the source
+	const uint8_t numMips = m_filtered->GetNumMips();
+	if (numMips <= 1) return 0;
+
+	const auto numBarriers = m_filtered->GenerateMips(pCommandList, pBarriers, ResourceState::PIXEL_SHADER_RESOURCE,
+		m_pipelineLayouts[BLIT_PREMUL_GRAPHICS], m_pipelines[BLIT_PREMUL_GRAPHICS], m_srvTables.data(), 1,
+		m_samplerTable, 0, 0, 1, 1);
+
+	if (numMips <= 2) return numBarriers;
+
 	return m_filtered->GenerateMips(pCommandList, pBarriers, ResourceState::PIXEL_SHADER_RESOURCE,
-		m_pipelineLayouts[BLIT_GRAPHICS], m_pipelines[BLIT_GRAPHICS], m_srvTables.data(), 1, m_samplerTable, 0);
+		m_pipelineLayouts[BLIT_GRAPHICS], m_pipelines[BLIT_GRAPHICS], &m_srvTables[1], 1,
+		m_samplerTable, 0, numBarriers, 2);
 }
 
 uint32_t Filter::generateMipsCompute(CommandList* pCommandList, ResourceBarrier* pBarriers)
 {
-	// Generate mipmaps
+	// Generate mipmaps; the first one premultiplies the source
+	const uint8_t numMips = m_filtered->GetNumMips();
+	if (numMips <= 1) return 0;
+
+	const auto numBarriers = m_filtered->GenerateMips(pCommandList, pBarriers, 8, 8, 1, ResourceState::NON_PIXEL_SHADER_RESOURCE,
+		m_pipelineLayouts[BLIT_PREMUL_COMPUTE], m_pipelines[BLIT_PREMUL_COMPUTE], &m_uavTables[UAV_TABLE_TYPED][1], 1,
+		m_samplerTable, 0, 0, &m_srvTables[0], 2, 1, 1);
+
+	if (numMips <= 2) return numBarriers;
+
 	return m_filtered->GenerateMips(pCommandList, pBarriers, 8, 8, 1, ResourceState::NON_PIXEL_SHADER_RESOURCE,
-		m_pipelineLayouts[BLIT_COMPUTE], m_pipelines[BLIT_COMPUTE], &m_uavTables[UAV_TABLE_TYPED][1], 1,
-		m_samplerTable, 0, 0, &m_srvTables[0], 2);
+		m_pipelineLayouts[BLIT_COMPUTE], m_pipelines[BLIT_COMPUTE], &m_uavTables[UAV_TABLE_TYPED][2], 1,
+		m_samplerTable, 0, numBarriers, &m_srvTables[1], 2, 2);
 }
 
 void Filter::upsampleGraphics(CommandList* pCommandList, ResourceBarrier* pBarriers,
-	uint32_t numBarriers, uint8_t frameIndex)
+	uint32_t numBarriers, uint8_t frameIndex, uint8_t outputLevel)
 {
 	// Up sampling
 	const auto cbvOffset = m_cbPerFrame->GetCBVOffset(frameIndex);
@@ -339,9 +461,11 @@ void Filter::upsampleGraphics(CommandList* pCommandList, ResourceBarrier* pBarri
 	pCommandList->SetPipelineState(m_pipelines[UP_SAMPLE_BLEND]);
 	pCommandList->SetGraphicsDescriptorTable(0, m_samplerTable);
 	pCommandList->SetGraphicsRootConstantBufferView(2, m_cbPerFrame.get(), cbvOffset);
+	pCommandList->SetGraphicsDescriptorTable(4, m_sigmaMapTable);
 
 	const uint8_t numPasses = m_filtered->GetNumMips() - 1;
-	for (uint8_t i = 0; i + 1 < numPasses; ++i)
+	const auto lastLevel = (max)(outputLevel, static_cast<uint8_t>(1));
+	for (uint8_t i = 0; i + lastLevel < numPasses; ++i)
 	{
 		const auto c = numPasses - i;
 		const auto level = c - 1;
@@ -350,18 +474,25 @@ void Filter::upsampleGraphics(CommandList* pCommandList, ResourceBarrier* pBarri
 			ResourceState::PIXEL_SHADER_RESOURCE, m_srvTables[c], 1, numBarriers);
 	}
 
-	// Final pass
+	// Final pass at the full resolution; a reduced-level result is only made straight
+	if (outputLevel > 0)
+	{
+		unpremultiply(pCommandList, pBarriers, numBarriers, outputLevel);
+		return;
+	}
+
 	pCommandList->SetGraphicsPipelineLayout(m_pipelineLayouts[UP_SAMPLE_GRAPHICS]);
 	pCommandList->SetPipelineState(m_pipelines[UP_SAMPLE_GRAPHICS]);
 	pCommandList->SetGraphicsDescriptorTable(0, m_samplerTable);
 	pCommandList->SetGraphicsRootConstantBufferView(2, m_cbPerFrame.get(), cbvOffset);
 	pCommandList->SetGraphics32BitConstant(3, 0);
+	pCommandList->SetGraphicsDescriptorTable(4, m_sigmaMapTable);
 	numBarriers = m_filtered->Blit(pCommandList, pBarriers, 0, 1,
 		ResourceState::PIXEL_SHADER_RESOURCE, m_srvTables[0], 1, numBarriers);
 }
 
 void Filter::upsampleCompute(CommandList* pCommandList, ResourceBarrier* pBarriers,
-	uint32_t numBarriers, uint8_t frameIndex)
+	uint32_t numBarriers, uint8_t frameIndex, uint8_t outputLevel)
 {
 	// Up sampling
 	const auto cbvOffset = m_cbPerFrame->GetCBVOffset(frameIndex);
@@ -369,9 +500,11 @@ void Filter::upsampleCompute(CommandList* pCommandList, ResourceBarrier* pBarrie
 	pCommandList->SetPipelineState(m_pipelines[UP_SAMPLE_INPLACE]);
 	pCommandList->SetComputeDescriptorTable(0, m_samplerTable);
 	pCommandList->SetComputeRootConstantBufferView(3, m_cbPerFrame.get(), cbvOffset);
+	pCommandList->SetComputeDescriptorTable(5, m_sigmaMapTable);
 
 	const uint8_t numPasses = m_filtered->GetNumMips() - 1;
-	for (uint8_t i = 0; i + 1 < numPasses; ++i)
+	const auto lastLevel = (max)(outputLevel, static_cast<uint8_t>(1));
+	for (uint8_t i = 0; i + lastLevel < numPasses; ++i)
 	{
 		const auto c = numPasses - i;
 		const auto level = c - 1;
@@ -380,12 +513,36 @@ void Filter::upsampleCompute(CommandList* pCommandList, ResourceBarrier* pBarrie
 			m_uavTables[m_typedUAV ? UAV_TABLE_TYPED : UAV_TABLE_PACKED][level], 1, numBarriers, m_srvTables[c], 2);
 	}
 
-	// Final pass
+	// Final pass at the full resolution; a reduced-level result is only made straight
+	if (outputLevel > 0)
+	{
+		unpremultiply(pCommandList, pBarriers, numBarriers, outputLevel);
+		return;
+	}
+
 	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[UP_SAMPLE_COMPUTE]);
 	pCommandList->SetPipelineState(m_pipelines[UP_SAMPLE_COMPUTE]);
 	pCommandList->SetComputeDescriptorTable(0, m_samplerTable);
 	pCommandList->SetComputeRootConstantBufferView(3, m_cbPerFrame.get(), cbvOffset);
 	pCommandList->SetCompute32BitConstant(4, 0);
+	pCommandList->SetComputeDescriptorTable(5, m_sigmaMapTable);
 	numBarriers = m_filtered->Blit(pCommandList, pBarriers, 8, 8, 1, 0, 1, ResourceState::NON_PIXEL_SHADER_RESOURCE,
 		m_uavTables[UAV_TABLE_TYPED][0], 1, numBarriers, m_srvTables[0], 2);
 }
+
+void Filter::unpremultiply(CommandList* pCommandList, ResourceBarrier* pBarriers,
+	uint32_t numBarriers, uint8_t outputLevel)
+{
+	// A pixel shader cannot read its own render target, so the result at a reduced level
+	// is made straight in-place by compute in either pipeline
+	pCommandList->Barrier(numBarriers, pBarriers);
+	numBarriers = m_filtered->SetBarrier(pBarriers, outputLevel, ResourceState::UNORDERED_ACCESS);
+	pCommandList->Barrier(numBarriers, pBarriers);
+
+	uint32_t width, height;
+	GetImageSize(width, height, outputLevel);
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[UNPREMULTIPLY]);
+	pCommandList->SetPipelineState(m_pipelines[UNPREMULTIPLY]);
+	pCommandList->SetComputeDescriptorTable(0, m_uavTables[m_typedUAV ? UAV_TABLE_TYPED : UAV_TABLE_PACKED][outputLevel]);
+	pCommandList->Dispatch(XUSG_DIV_UP(width, 8), XUSG_DIV_UP(height, 8), 1);
+}
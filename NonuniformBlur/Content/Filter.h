@@ -21,14 +21,22 @@ public:
 	Filter();
 	virtual ~Filter();
 
+	// The optional sigma map scales the sigma per pixel by its first channel, sampled bilinearly, in
+	// place of the radial falloff around the focus, as in FilterCPU::SetSigmaMap()
 	bool Init(XUSG::CommandList* pCommandList, const XUSG::DescriptorTableLib::sptr& descriptorTableLib,
-		std::vector<XUSG::Resource::uptr>& uploaders, XUSG::Format rtFormat, const char* fileName, bool typedUAV);
+		std::vector<XUSG::Resource::uptr>& uploaders, XUSG::Format rtFormat, const char* fileName, bool typedUAV,
+		const char* sigmaMapFileName = nullptr);
 
 	void UpdateFrame(DirectX::XMFLOAT2 focus, float sigma, uint8_t frameIndex);
-	void Process(XUSG::CommandList* pCommandList, uint8_t frameIndex, PipelineType pipelineType);
+
+	// Up-sampling stops at the output level, so that the mip of the result at that level
+	// holds the blurred image at a reduced resolution. The source is taken as straight alpha,
+	// and the levels are premultiplied; only the result at the output level is straight again
+	void Process(XUSG::CommandList* pCommandList, uint8_t frameIndex, PipelineType pipelineType, uint8_t outputLevel = 0);
 
 	XUSG::Resource* GetResult() const;
-	void GetImageSize(uint32_t& width, uint32_t& height) const;
+	void GetImageSize(uint32_t& width, uint32_t& height, uint8_t level = 0) const;
+	uint8_t GetNumLevels() const;
 
 	static const uint8_t FrameCount = 3;
 
@@ -37,10 +45,13 @@ protected:
 	{
 		BLIT_GRAPHICS,
 		BLIT_COMPUTE,
+		BLIT_PREMUL_GRAPHICS,
+		BLIT_PREMUL_COMPUTE,
 		UP_SAMPLE_BLEND,
 		UP_SAMPLE_INPLACE,
 		UP_SAMPLE_GRAPHICS,
 		UP_SAMPLE_COMPUTE,
+		UNPREMULTIPLY,
 
 		NUM_PIPELINE
 	};
@@ -61,9 +72,11 @@ protected:
 	uint32_t generateMipsCompute(XUSG::CommandList* pCommandList, XUSG::ResourceBarrier* pBarriers);
 
 	void upsampleGraphics(XUSG::CommandList* pCommandList, XUSG::ResourceBarrier* pBarriers,
-		uint32_t numBarriers, uint8_t frameIndex);
+		uint32_t numBarriers, uint8_t frameIndex, uint8_t outputLevel);
 	void upsampleCompute(XUSG::CommandList* pCommandList, XUSG::ResourceBarrier* pBarriers,
-		uint32_t numBarriers, uint8_t frameIndex);
+		uint32_t numBarriers, uint8_t frameIndex, uint8_t outputLevel);
+	void unpremultiply(XUSG::CommandList* pCommandList, XUSG::ResourceBarrier* pBarriers,
+		uint32_t numBarriers, uint8_t outputLevel);
 
 	XUSG::ShaderLib::uptr				m_shaderLib;
 	XUSG::Graphics::PipelineLib::uptr	m_graphicsPipelineLib;
@@ -76,9 +89,11 @@ protected:
 
 	std::vector<XUSG::DescriptorTable>	m_uavTables[NUM_UAV_TABLE_TYPE];
 	std::vector<XUSG::DescriptorTable>	m_srvTables;
+	XUSG::DescriptorTable				m_sigmaMapTable;	// The source stands in without a sigma map
 	XUSG::DescriptorTable				m_samplerTable;
 
 	XUSG::Texture::uptr					m_source;
+	XUSG::Texture::uptr					m_sigmaMap;
 	XUSG::RenderTarget::uptr			m_filtered;
 
 	XUSG::ConstantBuffer::uptr			m_cbPerFrame;
@@ -0,0 +1,1380 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "FilterCPU.h"
+#include <xmmintrin.h>
+#include <cfloat>
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+	const auto g_pi = 3.141592654f;
+
+	// Granularity of the lazily up-sampled regions
+	const uint32_t g_blockSize = 32;
+
+	// Bytes of the mip rows swept by all the frames of a fan-out in turn
+	const size_t g_bandSize = 128 << 10;
+
+	// Tiles of the screen along each axis, over which the focus points are culled
+	const uint32_t g_focusGridSize = 16;
+
+	inline __m128 Lerp(__m128 a, __m128 b, __m128 t)
+	{
+		return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+	}
+
+	inline __m128 Sample(const XMFLOAT4* pRow0, const XMFLOAT4* pRow1, __m128 fy, const FilterCPU::Tap& tx)
+	{
+		const auto fx = _mm_set1_ps(tx.F);
+		const auto top = Lerp(_mm_loadu_ps(&pRow0[tx.I0].x), _mm_loadu_ps(&pRow0[tx.I1].x), fx);
+		const auto bottom = Lerp(_mm_loadu_ps(&pRow1[tx.I0].x), _mm_loadu_ps(&pRow1[tx.I1].x), fx);
+
+		return Lerp(top, bottom, fy);
+	}
+
+	// Gaussian-approximating Haar coefficient (MipGaussianBlendWeight() with _PREINTEGRATED_), from
+	// the per-level terms; it does not increase with a non-negative sigma
+	inline float BlendWeight(float sigma, float numerator, float levelScale)
+	{
+		const auto c = 4.0f * g_pi * sigma * sigma;
+
+		return (min)(numerator / (c * (levelScale + c)), 1.0f);
+	}
+
+	// BlendWeight() of the 4 channels
+	inline __m128 BlendWeights(__m128 sigmas, __m128 numerator, __m128 levelScale)
+	{
+		const auto c = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(4.0f * g_pi), sigmas), sigmas);
+
+		return _mm_min_ps(_mm_div_ps(numerator, _mm_mul_ps(c, _mm_add_ps(levelScale, c))), _mm_set1_ps(1.0f));
+	}
+
+	// Soft-knee threshold of the brightest color channel; the alpha does not bloom
+	inline __m128 BrightPass(const XMFLOAT4& color, float threshold, float knee)
+	{
+		const auto brightness = (max)({ color.x, color.y, color.z });
+		auto soft = (min)((max)(brightness - threshold + knee, 0.0f), 2.0f * knee);
+		soft = soft * soft / (4.0f * knee + 1e-5f);
+		const auto contribution = (max)(soft, brightness - threshold) / (max)(brightness, 1e-5f);
+
+		return _mm_mul_ps(_mm_loadu_ps(&color.x), _mm_setr_ps(contribution, contribution, contribution, 0.0f));
+	}
+
+	// Blocks of a level covered by the rectangles
+	void MarkBlocks(vector<uint8_t>& mask, uint32_t width, uint32_t height, const vector<FilterCPU::Rect>& rects)
+	{
+		const auto numBlocksX = (width + g_blockSize - 1) / g_blockSize;
+		const auto numBlocksY = (height + g_blockSize - 1) / g_blockSize;
+		mask.assign(static_cast<size_t>(numBlocksX) * numBlocksY, 0);
+		for (const auto& rect : rects)
+			for (auto j = rect.Top / g_blockSize; j <= (rect.Bottom - 1) / g_blockSize; ++j)
+				for (auto i = rect.Left / g_blockSize; i <= (rect.Right - 1) / g_blockSize; ++i)
+					mask[numBlocksX * j + i] = 1;
+	}
+}
+
+FilterCPU::FilterCPU() :
+	m_focusSmoothness(0.0f),
+	m_focus(0.0f, 0.0f),
+	m_sigma(0.0f),
+	m_channelScales(1.0f, 1.0f, 1.0f, 1.0f),
+	m_errorBound(0.0f),
+	m_rangeSigma(0.0f)
+{
+}
+
+FilterCPU::~FilterCPU()
+{
+}
+
+bool FilterCPU::Init(const ImageFile& source)
+{
+	const auto& desc = source.GetDesc();
+	XUSG_N_RETURN(desc.Width > 0 && desc.Height > 0, false);
+
+	// Load the source as premultiplied float4
+	resizeLevels(desc.Width, desc.Height);
+	auto& mip0 = m_mips[0];
+	source.ReadRows(0, mip0.Height, &mip0.Pixels[0].x, sizeof(XMFLOAT4) * mip0.Width, 4);
+	Premultiply(mip0.Pixels.data(), mip0.Pixels.size());
+	buildLevels();
+
+	return true;
+}
+
+bool FilterCPU::Init(vector<XMFLOAT4>&& pixels, uint32_t width, uint32_t height)
+{
+	XUSG_N_RETURN(width > 0 && height > 0 && pixels.size() == static_cast<size_t>(width) * height, false);
+
+	resizeLevels(width, height);
+	m_mips[0].Pixels = move(pixels);
+	buildLevels();
+
+	return true;
+}
+
+void FilterCPU::UpdateFrame(XMFLOAT2 focus, float sigma)
+{
+	m_focus = focus;
+	m_sigma = sigma;
+
+	updateDistances();
+	for (auto& blocks : m_blendedBlocks) fill(blocks.begin(), blocks.end(), 0);
+	for (auto& rects : m_dirtyRects) rects.clear();
+	m_errorBound = 0.0f;
+}
+
+bool FilterCPU::SetSigmaMap(const ImageFile& sigmaMap)
+{
+	XUSG_N_RETURN(loadSigmaMap(sigmaMap), false);
+	updateFalloffs();
+	UpdateFrame(m_focus, m_sigma);
+
+	return true;
+}
+
+bool FilterCPU::SetSigmaMap(const float* pSigmaMap, uint32_t width, uint32_t height)
+{
+	XUSG_N_RETURN(loadSigmaMap(pSigmaMap, width, height), false);
+	updateFalloffs();
+	UpdateFrame(m_focus, m_sigma);
+
+	return true;
+}
+
+bool FilterCPU::SetFocusPoints(const FocusPoint* pPoints, uint32_t numPoints, float smoothness)
+{
+	XUSG_N_RETURN(loadFocusPoints(pPoints, numPoints, smoothness), false);
+	updateFalloffs();
+	UpdateFrame(m_focus, m_sigma);
+
+	return true;
+}
+
+void FilterCPU::SetChannelScales(XMFLOAT4 scales)
+{
+	m_channelScales = scales;
+	UpdateFrame(m_focus, m_sigma);
+}
+
+bool FilterCPU::SetEdgeAware(float rangeSigma, const ImageFile* pGuide)
+{
+	m_rangeSigma = (max)(rangeSigma, 0.0f);
+	m_guides.clear();
+	if (pGuide)
+	{
+		// Mip chain of the guide, as of the source
+		const auto& desc = pGuide->GetDesc();
+		XUSG_N_RETURN(!m_mips.empty() && desc.Width == m_mips[0].Width && desc.Height == m_mips[0].Height, false);
+
+		const auto numMips = static_cast<uint8_t>(m_mips.size());
+		m_guides.resize(numMips);
+		for (uint8_t i = 0; i < numMips; ++i)
+		{
+			auto& guide = m_guides[i];
+			guide.Width = m_mips[i].Width;
+			guide.Height = m_mips[i].Height;
+			guide.Pixels.resize(m_mips[i].Pixels.size());
+			if (i > 0) downsample(guide, m_guides[i - 1], 0, guide.Height);
+			else pGuide->ReadRows(0, guide.Height, &guide.Pixels[0].x, sizeof(XMFLOAT4) * guide.Width, 4);
+		}
+	}
+	UpdateFrame(m_focus, m_sigma);
+
+	return true;
+}
+
+void FilterCPU::Process(uint8_t outputLevel)
+{
+	// V-cycle, from the level below the coarsest, or from the depth, down to the output level
+	const auto numMips = static_cast<uint8_t>(m_mips.size());
+	const auto depth = getDepth(m_focus, m_sigma, outputLevel);
+	for (auto i = (min)(depth + 1, numMips - 1); i > outputLevel; --i)
+	{
+		const auto level = static_cast<uint8_t>(i - 1);
+		upsample(level, 0, m_blended[level].Height);
+	}
+
+	for (uint8_t i = 0; i < numMips; ++i)
+		fill(m_blendedBlocks[i].begin(), m_blendedBlocks[i].end(), i < outputLevel || i > depth ? 0 : 1);
+	for (auto& rects : m_dirtyRects) rects.clear();
+	m_errorBound = 0.0f;
+}
+
+void FilterCPU::Process(const Rect* pROIs, uint32_t numROIs)
+{
+	const auto numMips = static_cast<uint8_t>(m_mips.size());
+	vector<vector<Rect>> footprints(numMips);
+
+	// Clip the ROIs to the image
+	const auto& mip0 = m_mips[0];
+	for (auto i = 0u; i < numROIs; ++i)
+	{
+		const auto& roi = pROIs[i];
+		const Rect rect = { roi.Left, roi.Top, (min)(roi.Right, mip0.Width), (min)(roi.Bottom, mip0.Height) };
+		if (rect.Left < rect.Right && rect.Top < rect.Bottom) footprints[0].emplace_back(rect);
+	}
+
+	// Footprints in the coarser levels, from the bilinear taps of the up-sampling
+	for (uint8_t i = 0; i + 1 < numMips; ++i)
+	{
+		mergeRects(footprints[i]);
+		const auto& tapsX = m_tapsX[i];
+		const auto& tapsY = m_tapsY[i];
+		for (const auto& rect : footprints[i])
+			footprints[i + 1].push_back({ tapsX[rect.Left].I0, tapsY[rect.Top].I0,
+				tapsX[rect.Right - 1].I1 + 1, tapsY[rect.Bottom - 1].I1 + 1 });
+	}
+
+	// V-cycle over the footprints only
+	const auto depth = getDepth(m_focus, m_sigma, 0);
+	for (auto i = (min)(depth + 1, numMips - 1); i > 0; --i)
+	{
+		const auto level = static_cast<uint8_t>(i - 1);
+		for (const auto& rect : footprints[level])
+			upsample(level, rect.Top, rect.Bottom, rect.Left, rect.Right);
+	}
+
+	// The changes of an updated source are then no longer tracked by blocks
+	auto isDirty = false;
+	for (const auto& rects : m_dirtyRects) isDirty = isDirty || !rects.empty();
+	if (isDirty)
+	{
+		for (auto& blocks : m_blendedBlocks) fill(blocks.begin(), blocks.end(), 0);
+		for (auto& rects : m_dirtyRects) rects.clear();
+		m_errorBound = 0.0f;
+	}
+}
+
+void FilterCPU::Process(Frame& frame, uint8_t outputLevel) const
+{
+	// V-cycle of Process(), into the levels of the frame
+	const auto numMips = static_cast<uint8_t>(m_mips.size());
+	const auto isUniform = reinterpret_cast<const uint32_t&>(frame.Focus.x) == UINT32_MAX;
+	const auto depth = getDepth(frame.Focus, frame.Sigma, outputLevel);
+	frame.Blended.resize(numMips);
+	frame.Dist2X.resize(numMips);
+	for (auto i = (min)(depth + 1, numMips - 1); i > outputLevel; --i)
+	{
+		const auto level = static_cast<uint8_t>(i - 1);
+		const auto& src = m_mips[level];
+		const auto& tapsY = m_tapsY[level];
+		auto& dst = frame.Blended[level];
+		dst.Width = src.Width;
+		dst.Height = src.Height;
+		dst.Pixels.resize(src.Pixels.size());
+
+		// The coarser level is not read at the depth, so the mip stands in for it
+		const auto& coarser = level < depth ? GetResult(frame, level + 1) : m_mips[level + 1];
+
+		auto& dist2X = frame.Dist2X[level];
+		if (isUniform || !m_falloffs.empty()) dist2X.clear();
+		else computeDistances(dist2X, dst.Width, frame.Focus.x);
+
+		const auto pCoarser = coarser.Pixels.data();
+		vector<float> rangeRow;
+		for (auto y = 0u; y < dst.Height; ++y)
+		{
+			const auto& ty = tapsY[y];
+			const auto rowOffset = static_cast<size_t>(dst.Width) * y;
+			float falloffY;
+			const auto pFalloffX = getFalloffRow(level, y, frame.Focus, dist2X, falloffY);
+			upsampleRow(level, &dst.Pixels[rowOffset], &src.Pixels[rowOffset],
+				&pCoarser[static_cast<size_t>(coarser.Width) * ty.I0],
+				&pCoarser[static_cast<size_t>(coarser.Width) * ty.I1], ty, m_tapsX[level],
+				pFalloffX, falloffY, getChannelSigmas(frame.Sigma), 0, dst.Width, getRangeRow(level, y, rangeRow));
+		}
+	}
+}
+
+void FilterCPU::Process(Frame* pFrames, uint32_t numFrames, uint8_t outputLevel, float tolerance) const
+{
+	// Up-sampled level shared by the frames with the same coarser level and weights within the
+	// tolerance; it is held by the levels of its first frame, whose parameters up-sample it
+	struct SharedLevel
+	{
+		uint32_t	Coarser;	// Shared level of the coarser level, or 0 for the coarsest mip
+		uint32_t	Frame;
+	};
+
+	const auto numMips = static_cast<uint8_t>(m_mips.size());
+	vector<SharedLevel> levels, coarserLevels;
+	vector<uint32_t> shared(numFrames, 0), coarserShared(numFrames, 0);
+	vector<__m128> weightsMin(numFrames), weightsMax(numFrames);
+	vector<float> errors(numFrames, 0.0f);	// Bounds of the deviations of the shared levels of the frames
+	for (auto j = 0u; j < numFrames; ++j)
+	{
+		pFrames[j].Blended.resize(numMips);
+		pFrames[j].Dist2X.resize(numMips);
+	}
+
+	// Value ranges of the mips from the level on, which bound the differences of a mip to its coarser
+	// level, as the levels up-sampled from them are their convex combinations
+	auto valueMin = _mm_set1_ps(FLT_MAX);
+	auto valueMax = _mm_set1_ps(-FLT_MAX);
+	const auto updateValueRange = [&](const Image& mip)
+	{
+		if (tolerance <= 0.0f) return;
+		for (const auto& pixel : mip.Pixels)
+		{
+			const auto value = _mm_loadu_ps(&pixel.x);
+			valueMin = _mm_min_ps(valueMin, value);
+			valueMax = _mm_max_ps(valueMax, value);
+		}
+	};
+	updateValueRange(m_mips[numMips - 1]);
+
+	for (auto i = numMips - 1; i > outputLevel; --i)
+	{
+		const auto level = static_cast<uint8_t>(i - 1);
+		const auto& src = m_mips[level];
+		const auto numerator = _mm_set1_ps(ldexpf(logf(4.0f), level << 2));
+		const auto levelScale = _mm_set1_ps(ldexpf(1.0f, level << 1));
+		levels.swap(coarserLevels);
+		shared.swap(coarserShared);
+		levels.clear();
+		updateValueRange(src);
+		const auto valueRange = _mm_max_ps(_mm_sub_ps(valueMax, valueMin), _mm_setzero_ps());
+
+		// Weights of the channels over the level: at the largest falloff, and up to 1 toward the
+		// focus unless uniform, so that saturated ones are constant
+		for (auto j = 0u; j < numFrames; ++j)
+		{
+			const auto& frame = pFrames[j];
+			const auto isUniform = reinterpret_cast<const uint32_t&>(frame.Focus.x) == UINT32_MAX;
+			const auto maxFalloff = getMaxFalloff(level, frame.Focus, 0, 0, src.Width, src.Height);
+			const auto sigmas = getChannelSigmas(frame.Sigma);
+			weightsMin[j] = BlendWeights(_mm_mul_ps(_mm_loadu_ps(&sigmas.x), _mm_set1_ps(maxFalloff)), numerator, levelScale);
+			weightsMax[j] = isUniform ? weightsMin[j] : _mm_set1_ps(1.0f);
+		}
+
+		// Group the frames; a frame joins the first level of the same coarser level whose deviation,
+		// the span of both weights times the value range, keeps its accumulated one within the tolerance
+		for (auto j = 0u; j < numFrames; ++j)
+		{
+			auto& frame = pFrames[j];
+			auto k = 0u;
+			auto error = 0.0f;
+			for (; k < levels.size(); ++k)
+			{
+				const auto& sharedLevel = levels[k];
+				if (sharedLevel.Coarser != coarserShared[j]) continue;
+
+				const auto& first = pFrames[sharedLevel.Frame];
+				if (!memcmp(&first.Focus, &frame.Focus, sizeof(XMFLOAT2)) && first.Sigma == frame.Sigma)
+				{
+					error = 0.0f;
+					break;
+				}
+
+				// Constant weights alike are exact
+				const auto span = _mm_max_ps(_mm_sub_ps(weightsMax[j], weightsMin[sharedLevel.Frame]),
+					_mm_sub_ps(weightsMax[sharedLevel.Frame], weightsMin[j]));
+				if (_mm_movemask_ps(_mm_cmpneq_ps(span, _mm_setzero_ps())) == 0)
+				{
+					error = 0.0f;
+					break;
+				}
+
+				if (tolerance > 0.0f)
+				{
+					XMFLOAT4 deviations;
+					_mm_storeu_ps(&deviations.x, _mm_mul_ps(span, valueRange));
+					error = (max)({ deviations.x, deviations.y, deviations.z, deviations.w });
+					if (errors[j] + error <= tolerance) break;
+				}
+			}
+
+			if (k == levels.size())
+			{
+				levels.push_back({ coarserShared[j], j });
+				auto& dst = frame.Blended[level];
+				dst.Width = src.Width;
+				dst.Height = src.Height;
+				dst.Pixels.resize(src.Pixels.size());
+
+				auto& dist2X = frame.Dist2X[level];
+				const auto isUniform = reinterpret_cast<const uint32_t&>(frame.Focus.x) == UINT32_MAX;
+				if (isUniform || !m_falloffs.empty()) dist2X.clear();
+				else computeDistances(dist2X, src.Width, frame.Focus.x);
+			}
+			else errors[j] += error;
+			shared[j] = k;
+		}
+
+		// All the shared levels in bands of rows, while the mip rows are cached
+		vector<float> rangeRow;
+		const auto bandHeight = (max)(static_cast<uint32_t>(g_bandSize / (sizeof(XMFLOAT4) * src.Width)), 1u);
+		for (auto y0 = 0u; y0 < src.Height; y0 += bandHeight)
+		{
+			for (const auto& sharedLevel : levels)
+			{
+				auto& frame = pFrames[sharedLevel.Frame];
+				const auto& coarser = coarserLevels.empty() ? m_mips[level + 1] :
+					pFrames[coarserLevels[sharedLevel.Coarser].Frame].Blended[level + 1];
+				const auto& dist2X = frame.Dist2X[level];
+				const auto pCoarser = coarser.Pixels.data();
+				for (auto y = y0; y < (min)(y0 + bandHeight, src.Height); ++y)
+				{
+					const auto rowOffset = static_cast<size_t>(src.Width) * y;
+					const auto& ty = m_tapsY[level][y];
+					float falloffY;
+					const auto pFalloffX = getFalloffRow(level, y, frame.Focus, dist2X, falloffY);
+					upsampleRow(level, &frame.Blended[level].Pixels[rowOffset], &src.Pixels[rowOffset],
+						&pCoarser[static_cast<size_t>(coarser.Width) * ty.I0],
+						&pCoarser[static_cast<size_t>(coarser.Width) * ty.I1], ty, m_tapsX[level],
+						pFalloffX, falloffY, getChannelSigmas(frame.Sigma), 0, src.Width, getRangeRow(level, y, rangeRow));
+				}
+			}
+		}
+	}
+
+	// The other frames of each shared output level take copies
+	for (auto j = 0u; j < numFrames && outputLevel + 1u < numMips; ++j)
+	{
+		const auto first = levels[shared[j]].Frame;
+		if (first != j) pFrames[j].Blended[outputLevel] = pFrames[first].Blended[outputLevel];
+	}
+}
+
+void FilterCPU::ProcessBandPass(Image& result, const BandPass& bandPass, uint8_t outputLevel) const
+{
+	// Both blurs of the DoG in one sweep; the others take the finer band from the source
+	const auto isDoG = bandPass.Mode == DIFFERENCE_OF_GAUSSIANS;
+	Frame frames[2];
+	for (auto& frame : frames) frame.Focus = m_focus;
+	frames[0].Sigma = bandPass.Sigma;
+	frames[1].Sigma = bandPass.Sigma2;
+	Process(frames, isDoG ? 2 : 1, outputLevel);
+
+	const auto& src = m_mips[outputLevel];
+	const auto& fine = isDoG ? GetResult(frames[0], outputLevel) : src;
+	const auto& coarse = GetResult(frames[isDoG ? 1 : 0], outputLevel);
+	result.Width = src.Width;
+	result.Height = src.Height;
+	result.Pixels.resize(src.Pixels.size());
+
+	const auto amount = _mm_set1_ps(bandPass.Amount);
+	const auto bias = _mm_set1_ps(bandPass.Bias);
+	for (size_t i = 0; i < result.Pixels.size(); ++i)
+	{
+		const auto s = _mm_loadu_ps(&src.Pixels[i].x);
+		const auto detail = _mm_sub_ps(_mm_loadu_ps(&fine.Pixels[i].x), _mm_loadu_ps(&coarse.Pixels[i].x));
+		auto& dst = result.Pixels[i];
+		switch (bandPass.Mode)
+		{
+		case DIFFERENCE_OF_GAUSSIANS:
+			_mm_storeu_ps(&dst.x, _mm_add_ps(_mm_mul_ps(detail, amount), bias));
+			dst.w = 1.0f;
+			break;
+		case CLARITY:
+		{
+			// Midtones of the straight luminance, so that the shadows and highlights do not clip
+			const auto& pixel = src.Pixels[i];
+			const auto luminance = pixel.w > 0.0f ? (0.2126f * pixel.x + 0.7152f * pixel.y + 0.0722f * pixel.z) / pixel.w : 0.0f;
+			const auto midtone = 2.0f * (min)((max)(luminance, 0.0f), 1.0f) - 1.0f;
+			_mm_storeu_ps(&dst.x, _mm_add_ps(s, _mm_mul_ps(detail, _mm_mul_ps(amount, _mm_set1_ps(1.0f - midtone * midtone)))));
+			dst.w = pixel.w;
+			break;
+		}
+		default:
+			_mm_storeu_ps(&dst.x, _mm_add_ps(s, _mm_mul_ps(detail, amount)));
+			dst.w = src.Pixels[i].w;
+		}
+	}
+}
+
+void FilterCPU::ProcessBloom(Image& result, const Bloom& bloom, uint8_t outputLevel, bool isComposited) const
+{
+	const auto numMips = static_cast<uint8_t>(m_mips.size());
+	result.Width = m_mips[outputLevel].Width;
+	result.Height = m_mips[outputLevel].Height;
+	result.Pixels.resize(m_mips[outputLevel].Pixels.size());
+
+	// Bright pass of the coarsest mip, which is the output itself at the coarsest level
+	Image levels[2];
+	auto pCoarser = outputLevel + 1 < numMips ? &levels[0] : &result;
+	const auto& coarsest = m_mips[numMips - 1];
+	pCoarser->Width = coarsest.Width;
+	pCoarser->Height = coarsest.Height;
+	pCoarser->Pixels.resize(coarsest.Pixels.size());
+	for (size_t i = 0; i < coarsest.Pixels.size(); ++i)
+		_mm_storeu_ps(&pCoarser->Pixels[i].x, BrightPass(coarsest.Pixels[i], bloom.Threshold, bloom.Knee));
+
+	// Up-sampling chain with the taps of the V-cycle, reusing the mip chain of the blur: each level
+	// blends the bright pass of its mip with the coarser bloom by the scatter, and the output level
+	// takes the bloom of the next; only two levels are held, as each is read by the next finer one
+	const auto scatter = _mm_set1_ps(bloom.Scatter);
+	for (auto i = numMips - 2; i >= outputLevel; --i)
+	{
+		const auto& mip = m_mips[i];
+		auto& dst = i > outputLevel ? levels[(numMips - i + 1) & 1] : result;
+		dst.Width = mip.Width;
+		dst.Height = mip.Height;
+		dst.Pixels.resize(mip.Pixels.size());
+		for (auto y = 0u; y < dst.Height; ++y)
+		{
+			const auto& ty = m_tapsY[i][y];
+			const auto pCoarser0 = &pCoarser->Pixels[static_cast<size_t>(pCoarser->Width) * ty.I0];
+			const auto pCoarser1 = &pCoarser->Pixels[static_cast<size_t>(pCoarser->Width) * ty.I1];
+			const auto pMip = &mip.Pixels[static_cast<size_t>(dst.Width) * y];
+			const auto pDst = &dst.Pixels[static_cast<size_t>(dst.Width) * y];
+			const auto fy = _mm_set1_ps(ty.F);
+			for (auto x = 0u; x < dst.Width; ++x)
+			{
+				const auto value = Sample(pCoarser0, pCoarser1, fy, m_tapsX[i][x]);
+				_mm_storeu_ps(&pDst[x].x, i > outputLevel ?
+					Lerp(BrightPass(pMip[x], bloom.Threshold, bloom.Knee), value, scatter) : value);
+			}
+		}
+		pCoarser = &dst;
+	}
+
+	// Added over the blurred result, with the glow's own alpha of its brightest channel, so that
+	// the glow remains over the transparent pixels once un-premultiplied; or opaque on its own
+	const auto& blurred = getBlended(outputLevel);
+	const auto intensity = _mm_set1_ps(bloom.Intensity);
+	for (size_t i = 0; i < result.Pixels.size(); ++i)
+	{
+		auto& pixel = result.Pixels[i];
+		_mm_storeu_ps(&pixel.x, _mm_mul_ps(_mm_loadu_ps(&pixel.x), intensity));
+		if (isComposited)
+		{
+			const auto& color = blurred.Pixels[i];
+			const auto alpha = (min)((max)({ pixel.x, pixel.y, pixel.z }), 1.0f);
+			_mm_storeu_ps(&pixel.x, _mm_add_ps(_mm_loadu_ps(&color.x), _mm_loadu_ps(&pixel.x)));
+			pixel.w = color.w + alpha * (1.0f - color.w);
+		}
+		else pixel.w = 1.0f;
+	}
+}
+
+bool FilterCPU::UpdateSource(const ImageFile& source, const Rect* pDirtyRects, uint32_t numRects)
+{
+	const auto& desc = source.GetDesc();
+	auto& mip0 = m_mips[0];
+	XUSG_N_RETURN(desc.Width == mip0.Width && desc.Height == mip0.Height, false);
+
+	// Clip the rectangles to the image
+	vector<Rect> rects;
+	for (auto i = 0u; i < numRects; ++i)
+	{
+		const auto& dirty = pDirtyRects[i];
+		const Rect rect = { dirty.Left, dirty.Top, (min)(dirty.Right, mip0.Width), (min)(dirty.Bottom, mip0.Height) };
+		if (rect.Left < rect.Right && rect.Top < rect.Bottom) rects.emplace_back(rect);
+	}
+	mergeRects(rects);
+
+	// Reload the rectangles of the source
+	vector<XMFLOAT4> rows;
+	for (const auto& rect : rects)
+	{
+		const auto numRows = rect.Bottom - rect.Top;
+		rows.resize(static_cast<size_t>(mip0.Width) * numRows);
+		source.ReadRows(rect.Top, numRows, &rows[0].x, sizeof(XMFLOAT4) * mip0.Width, 4);
+		Premultiply(rows.data(), rows.size());
+		for (auto y = 0u; y < numRows; ++y)
+		{
+			const auto offset = static_cast<size_t>(mip0.Width) * y + rect.Left;
+			memcpy(&mip0.Pixels[static_cast<size_t>(mip0.Width) * rect.Top + offset], &rows[offset],
+				sizeof(XMFLOAT4) * (rect.Right - rect.Left));
+		}
+	}
+
+	// Texels of the coarser level whose taps, from the one at -1 to the one at +1, read [first, end)
+	const auto getFootprint = [](const vector<Tap> taps[3], uint32_t first, uint32_t end, uint32_t& dstFirst, uint32_t& dstEnd)
+	{
+		dstFirst = static_cast<uint32_t>(partition_point(taps[2].cbegin(), taps[2].cend(),
+			[first](const Tap& tap) { return tap.I1 < first; }) - taps[2].cbegin());
+		dstEnd = static_cast<uint32_t>(partition_point(taps[0].cbegin(), taps[0].cend(),
+			[end](const Tap& tap) { return tap.I0 < end; }) - taps[0].cbegin());
+	};
+
+	// Regenerate the footprints up the pyramid
+	const auto numMips = static_cast<uint8_t>(m_mips.size());
+	for (uint8_t i = 0; !rects.empty(); ++i)
+	{
+		auto& dirtyRects = m_dirtyRects[i];
+		dirtyRects.insert(dirtyRects.end(), rects.cbegin(), rects.cend());
+		mergeRects(dirtyRects);
+		if (i + 1 >= numMips) break;
+
+		const auto& mip = m_mips[i + 1];
+		vector<Tap> tapsX[3], tapsY[3];
+		for (uint8_t j = 0; j < 3; ++j)
+		{
+			computeTaps(tapsX[j], mip.Width, m_mips[i].Width, j - 1.0f);
+			computeTaps(tapsY[j], mip.Height, m_mips[i].Height, j - 1.0f);
+		}
+
+		for (auto& rect : rects)
+		{
+			getFootprint(tapsX, rect.Left, rect.Right, rect.Left, rect.Right);
+			getFootprint(tapsY, rect.Top, rect.Bottom, rect.Top, rect.Bottom);
+		}
+		mergeRects(rects);
+
+		for (const auto& rect : rects)
+			generateMips(i + 1, rect.Top, rect.Bottom, rect.Left, rect.Right);
+	}
+
+	return true;
+}
+
+size_t FilterCPU::ProcessDirty(float tolerance)
+{
+	// The levels share the tolerance left by the previous updates
+	const auto numMips = static_cast<uint8_t>(m_mips.size());
+	const auto levelTolerance = (max)(tolerance - m_errorBound, 0.0f) / numMips;
+
+	// Changed blocks of the coarser level, starting from the coarsest mip
+	const auto& coarsest = m_mips[numMips - 1];
+	vector<uint8_t> coarserChanged, changed, dirty;
+	MarkBlocks(coarserChanged, coarsest.Width, coarsest.Height, m_dirtyRects[numMips - 1]);
+
+	size_t numPixels = 0;
+	for (auto i = numMips - 1; i > 0; --i)
+	{
+		const auto level = static_cast<uint8_t>(i - 1);
+		const auto& mip = m_mips[level];
+		MarkBlocks(dirty, mip.Width, mip.Height, m_dirtyRects[level]);
+		m_errorBound += reblendBlocks(level, dirty, coarserChanged, changed, levelTolerance, numPixels);
+		coarserChanged.swap(changed);
+	}
+
+	for (auto& rects : m_dirtyRects) rects.clear();
+
+	return numPixels;
+}
+
+const FilterCPU::Image& FilterCPU::GetResult(uint8_t level) const
+{
+	return getBlended(level);
+}
+
+const FilterCPU::Image& FilterCPU::GetResult(const Frame& frame, uint8_t level) const
+{
+	return level + 1u < m_mips.size() ? frame.Blended[level] : m_mips[level];
+}
+
+void FilterCPU::Query(XMFLOAT4* pDst, uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+	const auto& result = getBlended(0);
+	assert(x + width <= result.Width && y + height <= result.Height);
+	if (width == 0 || height == 0) return;
+
+	ensureBlended(0, x, y, x + width - 1, y + height - 1);
+	for (auto i = 0u; i < height; ++i)
+		memcpy(&pDst[static_cast<size_t>(width) * i], &result.Pixels[static_cast<size_t>(result.Width) * (y + i) + x],
+			sizeof(XMFLOAT4) * width);
+}
+
+void FilterCPU::Query(XMFLOAT4* pDst, const XMUINT2* pPoints, uint32_t numPoints)
+{
+	const auto& result = getBlended(0);
+	for (auto i = 0u; i < numPoints; ++i)
+	{
+		const auto& point = pPoints[i];
+		assert(point.x < result.Width && point.y < result.Height);
+		ensureBlended(0, point.x, point.y, point.x, point.y);
+		pDst[i] = result.Pixels[static_cast<size_t>(result.Width) * point.y + point.x];
+	}
+}
+
+void FilterCPU::GetImageSize(uint32_t& width, uint32_t& height, uint8_t level) const
+{
+	width = m_mips[level].Width;
+	height = m_mips[level].Height;
+}
+
+uint8_t FilterCPU::GetNumLevels() const
+{
+	return static_cast<uint8_t>(m_mips.size());
+}
+
+void FilterCPU::WriteResult(ImageFile& imageFile, uint8_t level) const
+{
+	const auto& result = GetResult(level);
+	vector<XMFLOAT4> row(result.Width);
+	for (auto y = 0u; y < result.Height; ++y)
+	{
+		Unpremultiply(row.data(), &result.Pixels[static_cast<size_t>(result.Width) * y], result.Width);
+		imageFile.WriteRows(y, 1, &row[0].x, sizeof(XMFLOAT4) * result.Width, 4);
+	}
+}
+
+size_t FilterCPU::GetWorkingSetSize(uint32_t width, uint32_t height)
+{
+	// Mips plus the up-sampled levels, which are all but the coarsest
+	size_t numPixels = 0;
+	for (auto i = 0u; (width | height) >> i; ++i)
+	{
+		const auto levelPixels = static_cast<size_t>((max)(width >> i, 1u)) * (max)(height >> i, 1u);
+		numPixels += 2 * levelPixels;
+	}
+
+	return sizeof(XMFLOAT4) * numPixels;
+}
+
+void FilterCPU::Premultiply(XMFLOAT4* pPixels, size_t numPixels)
+{
+	// All 4 channels are scaled at once, by (a, a, a, 1)
+	const auto one = _mm_set1_ps(1.0f);
+	for (size_t i = 0; i < numPixels; ++i)
+	{
+		const auto color = _mm_loadu_ps(&pPixels[i].x);
+		const auto alpha = _mm_unpackhi_ps(_mm_shuffle_ps(color, color, _MM_SHUFFLE(3, 3, 3, 3)), one);
+		_mm_storeu_ps(&pPixels[i].x, _mm_mul_ps(color, _mm_shuffle_ps(alpha, alpha, _MM_SHUFFLE(1, 0, 0, 0))));
+	}
+}
+
+void FilterCPU::Unpremultiply(XMFLOAT4* pDst, const XMFLOAT4* pSrc, size_t numPixels)
+{
+	// All 4 channels are scaled at once, by (1 / a, 1 / a, 1 / a, 1), or (0, 0, 0, 1) if transparent
+	const auto zero = _mm_setzero_ps();
+	const auto one = _mm_set1_ps(1.0f);
+	for (size_t i = 0; i < numPixels; ++i)
+	{
+		const auto color = _mm_loadu_ps(&pSrc[i].x);
+		const auto alpha = _mm_shuffle_ps(color, color, _MM_SHUFFLE(3, 3, 3, 3));
+		const auto invAlpha = _mm_unpackhi_ps(_mm_and_ps(_mm_div_ps(one, alpha), _mm_cmpgt_ps(alpha, zero)), one);
+		_mm_storeu_ps(&pDst[i].x, _mm_mul_ps(color, _mm_shuffle_ps(invAlpha, invAlpha, _MM_SHUFFLE(1, 0, 0, 0))));
+	}
+}
+
+bool FilterCPU::loadSigmaMap(const ImageFile& sigmaMap)
+{
+	const auto& desc = sigmaMap.GetDesc();
+	XUSG_N_RETURN(desc.Width > 0 && desc.Height > 0, false);
+
+	m_sigmaMap.Width = desc.Width;
+	m_sigmaMap.Height = desc.Height;
+	m_sigmaMap.Values.resize(static_cast<size_t>(desc.Width) * desc.Height);
+	sigmaMap.ReadRows(0, desc.Height, m_sigmaMap.Values.data(), sizeof(float) * desc.Width, 1);
+	m_focusPoints.clear();
+
+	return true;
+}
+
+bool FilterCPU::loadSigmaMap(const float* pSigmaMap, uint32_t width, uint32_t height)
+{
+	const auto numTexels = static_cast<size_t>(width) * height;
+	XUSG_N_RETURN(pSigmaMap || numTexels == 0, false);
+
+	m_sigmaMap.Width = width;
+	m_sigmaMap.Height = height;
+	m_sigmaMap.Values.assign(pSigmaMap, pSigmaMap + numTexels);
+	m_focusPoints.clear();
+
+	return true;
+}
+
+bool FilterCPU::loadFocusPoints(const FocusPoint* pPoints, uint32_t numPoints, float smoothness)
+{
+	XUSG_N_RETURN(pPoints || numPoints == 0, false);
+	XUSG_N_RETURN(smoothness >= 0.0f, false);
+	for (auto k = 0u; k < numPoints; ++k) XUSG_N_RETURN(pPoints[k].SigmaScale >= 0.0f, false);
+
+	m_focusPoints.assign(pPoints, pPoints + numPoints);
+	m_focusSmoothness = smoothness;
+	m_sigmaMap.Values.clear();
+
+	// A point is a candidate of a tile unless its least falloff there is beyond the smoothness from
+	// the greatest falloff of the nearest point, where it never contributes to the smooth minimum
+	const auto getBounds = [](float focus, float x0, float x1)
+	{
+		const auto d0 = x0 - focus;
+		const auto d1 = x1 - focus;
+		const auto dMin = focus < x0 ? d0 : focus > x1 ? -d1 : 0.0f;
+
+		return XMFLOAT2(dMin * dMin, (max)(d0 * d0, d1 * d1));
+	};
+
+	m_focusCandidates.resize(numPoints ? g_focusGridSize * g_focusGridSize : 0);
+	vector<XMFLOAT2> bounds(numPoints);
+	for (auto j = 0u; j < g_focusGridSize && numPoints; ++j)
+	{
+		const auto y0 = 2.0f * j / g_focusGridSize - 1.0f;
+		const auto y1 = 2.0f * (j + 1) / g_focusGridSize - 1.0f;
+		for (auto i = 0u; i < g_focusGridSize; ++i)
+		{
+			const auto x0 = 2.0f * i / g_focusGridSize - 1.0f;
+			const auto x1 = 2.0f * (i + 1) / g_focusGridSize - 1.0f;
+			auto nearest = FLT_MAX;
+			for (auto k = 0u; k < numPoints; ++k)
+			{
+				const auto& point = m_focusPoints[k];
+				const auto boundsX = getBounds(point.Focus.x, x0, x1);
+				const auto boundsY = getBounds(point.Focus.y, y0, y1);
+				bounds[k].x = point.SigmaScale * (boundsX.x + boundsY.x);
+				bounds[k].y = point.SigmaScale * (boundsX.y + boundsY.y);
+				nearest = (min)(bounds[k].y, nearest);
+			}
+
+			auto& candidates = m_focusCandidates[g_focusGridSize * j + i];
+			candidates.clear();
+			for (auto k = 0u; k < numPoints; ++k)
+				if (bounds[k].x <= nearest + smoothness) candidates.push_back(k);
+		}
+	}
+
+	return true;
+}
+
+bool FilterCPU::hasFalloffMap() const
+{
+	return !m_sigmaMap.Values.empty() || !m_focusPoints.empty();
+}
+
+void FilterCPU::updateFalloffs()
+{
+	m_falloffs.clear();
+	m_falloffBounds.clear();
+	if (!hasFalloffMap()) return;
+
+	// Sampled at each up-sampled level, with the min/max pyramid of the blocks; levels that are not
+	// held whole sample the falloffs per row instead
+	const auto numMips = m_mips.size();
+	m_falloffs.resize(numMips);
+	m_falloffBounds.resize(numMips);
+	for (size_t i = 0; i + 1 < numMips; ++i)
+		if (!m_mips[i].Pixels.empty()) updateFalloffs(static_cast<uint8_t>(i));
+}
+
+void FilterCPU::updateFalloffs(uint8_t level)
+{
+	const auto width = m_mips[level].Width;
+	const auto height = m_mips[level].Height;
+	auto& falloffs = m_falloffs[level];
+	falloffs.resize(static_cast<size_t>(width) * height);
+	for (auto y = 0u; y < height; ++y)
+		sampleFalloffs(&falloffs[static_cast<size_t>(width) * y], y, width, height, 0, width);
+
+	const auto numBlocksX = (width + g_blockSize - 1) / g_blockSize;
+	const auto numBlocksY = (height + g_blockSize - 1) / g_blockSize;
+	auto& bounds = m_falloffBounds[level];
+	bounds.resize(static_cast<size_t>(numBlocksX) * numBlocksY);
+	for (auto j = 0u; j < numBlocksY; ++j)
+	{
+		for (auto k = 0u; k < numBlocksX; ++k)
+		{
+			auto& bound = bounds[numBlocksX * j + k];
+			bound.x = bound.y = falloffs[static_cast<size_t>(width) * g_blockSize * j + g_blockSize * k];
+			for (auto y = g_blockSize * j; y < (min)(g_blockSize * (j + 1), height); ++y)
+			{
+				for (auto x = g_blockSize * k; x < (min)(g_blockSize * (k + 1), width); ++x)
+				{
+					const auto falloff = falloffs[static_cast<size_t>(width) * y + x];
+					bound.x = (min)(falloff, bound.x);
+					bound.y = (max)(falloff, bound.y);
+				}
+			}
+		}
+	}
+}
+
+void FilterCPU::resizeLevels(uint32_t width, uint32_t height)
+{
+	// Full mip chain, as created for the GPU filter
+	uint8_t numMips = 1;
+	while ((max)(width, height) >> numMips) ++numMips;
+	m_mips.resize(numMips);
+	m_blended.resize(numMips);
+
+	for (uint8_t i = 0; i < numMips; ++i)
+	{
+		auto& mip = m_mips[i];
+		mip.Width = (max)(width >> i, 1u);
+		mip.Height = (max)(height >> i, 1u);
+		mip.Pixels.resize(static_cast<size_t>(mip.Width) * mip.Height);
+
+		auto& blended = m_blended[i];
+		blended.Width = mip.Width;
+		blended.Height = mip.Height;
+		blended.Pixels.resize(i + 1 < numMips ? mip.Pixels.size() : 0);
+	}
+}
+
+void FilterCPU::buildLevels()
+{
+	// The guide image is of the previous source
+	m_guides.clear();
+
+	// Generate mipmaps
+	const auto numMips = static_cast<uint8_t>(m_mips.size());
+	for (uint8_t i = 1; i < numMips; ++i) generateMips(i, 0, m_mips[i].Height);
+
+	initLevels();
+	updateFalloffs();
+}
+
+void FilterCPU::initLevels()
+{
+	const auto numMips = m_mips.size();
+	m_tapsX.resize(numMips);
+	m_tapsY.resize(numMips);
+	m_blendedBlocks.resize(numMips);
+	m_dirtyRects.assign(numMips, vector<Rect>());
+	m_errorBound = 0.0f;
+	for (size_t i = 0; i + 1 < numMips; ++i)
+	{
+		const auto& mip = m_mips[i];
+		computeTaps(m_tapsX[i], mip.Width, m_mips[i + 1].Width);
+		computeTaps(m_tapsY[i], mip.Height, m_mips[i + 1].Height);
+
+		const auto numBlocksX = (mip.Width + g_blockSize - 1) / g_blockSize;
+		const auto numBlocksY = (mip.Height + g_blockSize - 1) / g_blockSize;
+		m_blendedBlocks[i].assign(static_cast<size_t>(numBlocksX) * numBlocksY, 0);
+	}
+
+	updateDistances();
+}
+
+void FilterCPU::updateDistances()
+{
+	const auto isUniform = reinterpret_cast<const uint32_t&>(m_focus.x) == UINT32_MAX;
+	m_dist2X.resize(m_tapsX.size());
+	for (size_t i = 0; i < m_dist2X.size(); ++i)
+	{
+		if (isUniform) m_dist2X[i].clear();
+		else computeDistances(m_dist2X[i], m_mips[i].Width, m_focus.x);
+	}
+}
+
+void FilterCPU::generateMips(uint8_t level, uint32_t rowStart, uint32_t rowEnd, uint32_t colStart, uint32_t colEnd)
+{
+	downsample(m_mips[level], m_mips[level - 1], rowStart, rowEnd, colStart, colEnd);
+}
+
+void FilterCPU::downsample(Image& dst, const Image& src, uint32_t rowStart, uint32_t rowEnd, uint32_t colStart, uint32_t colEnd)
+{
+	// 5 bilinear taps (Resample() in Blit2D.hlsli with _HIGH_QUALITY_)
+	vector<Tap> tapsX[3], tapsY[3];
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		computeTaps(tapsX[i], dst.Width, src.Width, i - 1.0f);
+		computeTaps(tapsY[i], dst.Height, src.Height, i - 1.0f);
+	}
+
+	const auto pSrc = src.Pixels.data();
+	for (auto y = rowStart; y < rowEnd; ++y)
+	{
+		const XMFLOAT4* pRows[3][2];
+		const Tap* pTapsY[3];
+		for (uint8_t i = 0; i < 3; ++i)
+		{
+			pTapsY[i] = &tapsY[i][y];
+			pRows[i][0] = &pSrc[static_cast<size_t>(src.Width) * pTapsY[i]->I0];
+			pRows[i][1] = &pSrc[static_cast<size_t>(src.Width) * pTapsY[i]->I1];
+		}
+
+		downsampleRow(&dst.Pixels[static_cast<size_t>(dst.Width) * y], pRows, pTapsY, tapsX, colStart, colEnd);
+	}
+}
+
+void FilterCPU::upsample(uint8_t level, uint32_t rowStart, uint32_t rowEnd, uint32_t colStart, uint32_t colEnd)
+{
+	const auto& src = m_mips[level];
+	const auto& coarser = getBlended(level + 1);
+	auto& dst = m_blended[level];
+	const auto& tapsY = m_tapsY[level];
+
+	const auto sigmas = getChannelSigmas(m_sigma);
+	const auto pCoarser = coarser.Pixels.data();
+	vector<float> rangeRow;
+	for (auto y = rowStart; y < rowEnd; ++y)
+	{
+		const auto& ty = tapsY[y];
+		const auto rowOffset = static_cast<size_t>(dst.Width) * y;
+		float falloffY;
+		const auto pFalloffX = getFalloffRow(level, y, m_focus, m_dist2X[level], falloffY);
+		upsampleRow(level, &dst.Pixels[rowOffset], &src.Pixels[rowOffset],
+			&pCoarser[static_cast<size_t>(coarser.Width) * ty.I0],
+			&pCoarser[static_cast<size_t>(coarser.Width) * ty.I1], ty, m_tapsX[level],
+			pFalloffX, falloffY, sigmas, colStart, colEnd, getRangeRow(level, y, rangeRow, colStart, colEnd));
+	}
+}
+
+void FilterCPU::ensureBlended(uint8_t level, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+	if (level + 1u >= m_mips.size()) return;
+
+	const auto& dst = m_blended[level];
+	const auto& tapsX = m_tapsX[level];
+	const auto& tapsY = m_tapsY[level];
+	const auto numBlocksX = (dst.Width + g_blockSize - 1) / g_blockSize;
+	auto& blocks = m_blendedBlocks[level];
+
+	// Footprint of the missing blocks in the coarser level, which saturated blocks do not read
+	auto isMissing = false;
+	auto hasFootprint = false;
+	uint32_t srcX0 = UINT32_MAX, srcY0 = UINT32_MAX, srcX1 = 0, srcY1 = 0;
+	for (auto j = y0 / g_blockSize; j <= y1 / g_blockSize; ++j)
+	{
+		for (auto i = x0 / g_blockSize; i <= x1 / g_blockSize; ++i)
+		{
+			if (blocks[numBlocksX * j + i]) continue;
+
+			isMissing = true;
+			const auto blockX1 = (min)(g_blockSize * (i + 1), dst.Width);
+			const auto blockY1 = (min)(g_blockSize * (j + 1), dst.Height);
+			if (isSaturated(level, getMaxChannelSigma(m_sigma), getMaxFalloff(level, m_focus, g_blockSize * i, g_blockSize * j, blockX1, blockY1))) continue;
+
+			hasFootprint = true;
+			srcX0 = (min)(tapsX[g_blockSize * i].I0, srcX0);
+			srcY0 = (min)(tapsY[g_blockSize * j].I0, srcY0);
+			srcX1 = (max)(tapsX[blockX1 - 1].I1, srcX1);
+			srcY1 = (max)(tapsY[blockY1 - 1].I1, srcY1);
+		}
+	}
+
+	if (!isMissing) return;
+	if (hasFootprint) ensureBlended(level + 1, srcX0, srcY0, srcX1, srcY1);
+
+	for (auto j = y0 / g_blockSize; j <= y1 / g_blockSize; ++j)
+	{
+		for (auto i = x0 / g_blockSize; i <= x1 / g_blockSize; ++i)
+		{
+			auto& block = blocks[numBlocksX * j + i];
+			if (block) continue;
+
+			upsample(level, g_blockSize * j, (min)(g_blockSize * (j + 1), dst.Height),
+				g_blockSize * i, (min)(g_blockSize * (i + 1), dst.Width));
+			block = 1;
+		}
+	}
+}
+
+float FilterCPU::reblendBlocks(uint8_t level, const vector<uint8_t>& dirty, const vector<uint8_t>& coarserChanged,
+	vector<uint8_t>& changed, float tolerance, size_t& numPixels)
+{
+	const auto& dst = m_blended[level];
+	const auto& tapsX = m_tapsX[level];
+	const auto& tapsY = m_tapsY[level];
+	const auto& blocks = m_blendedBlocks[level];
+	const auto numBlocksX = (dst.Width + g_blockSize - 1) / g_blockSize;
+	const auto numBlocksY = (dst.Height + g_blockSize - 1) / g_blockSize;
+	const auto numCoarserBlocksX = (m_mips[level + 1].Width + g_blockSize - 1) / g_blockSize;
+	changed.assign(blocks.size(), 0);
+
+	auto residual = 0.0f;
+	vector<XMFLOAT4> prevPixels;
+	for (auto j = 0u; j < numBlocksY; ++j)
+	{
+		for (auto i = 0u; i < numBlocksX; ++i)
+		{
+			// Blocks not up-sampled yet are left to Query()
+			const auto block = numBlocksX * j + i;
+			if (!blocks[block]) continue;
+
+			// Dirty mip, or changed coarser blocks under the bilinear footprint unless saturated
+			const auto x0 = g_blockSize * i;
+			const auto y0 = g_blockSize * j;
+			const auto x1 = (min)(x0 + g_blockSize, dst.Width);
+			const auto y1 = (min)(y0 + g_blockSize, dst.Height);
+			auto isDirty = dirty[block] != 0;
+			if (!isDirty && !isSaturated(level, getMaxChannelSigma(m_sigma), getMaxFalloff(level, m_focus, x0, y0, x1, y1)))
+				for (auto n = tapsY[y0].I0 / g_blockSize; n <= tapsY[y1 - 1].I1 / g_blockSize && !isDirty; ++n)
+					for (auto m = tapsX[x0].I0 / g_blockSize; m <= tapsX[x1 - 1].I1 / g_blockSize && !isDirty; ++m)
+						isDirty = coarserChanged[numCoarserBlocksX * n + m] != 0;
+			if (!isDirty) continue;
+
+			const auto width = x1 - x0;
+			prevPixels.resize(static_cast<size_t>(width) * (y1 - y0));
+			for (auto y = y0; y < y1; ++y)
+				memcpy(&prevPixels[static_cast<size_t>(width) * (y - y0)], &dst.Pixels[static_cast<size_t>(dst.Width) * y + x0],
+					sizeof(XMFLOAT4) * width);
+
+			upsample(level, y0, y1, x0, x1);
+			numPixels += prevPixels.size();
+
+			// Only changes beyond the tolerance are propagated
+			auto change = 0.0f;
+			for (auto y = y0; y < y1; ++y)
+			{
+				const auto pPrev = &prevPixels[static_cast<size_t>(width) * (y - y0)];
+				const auto pCur = &dst.Pixels[static_cast<size_t>(dst.Width) * y + x0];
+				for (auto x = 0u; x < width; ++x)
+					change = (max)({ change, fabsf(pCur[x].x - pPrev[x].x), fabsf(pCur[x].y - pPrev[x].y),
+						fabsf(pCur[x].z - pPrev[x].z), fabsf(pCur[x].w - pPrev[x].w) });
+			}
+
+			if (change > tolerance) changed[block] = 1;
+			else residual = (max)(change, residual);
+		}
+	}
+
+	return residual;
+}
+
+void FilterCPU::downsampleRow(XMFLOAT4* pDst, const XMFLOAT4* const pRows[3][2],
+	const Tap* const pTapsY[3], const vector<Tap> tapsX[3], uint32_t xStart, uint32_t xEnd)
+{
+	__m128 fy[3];
+	for (uint8_t i = 0; i < 3; ++i) fy[i] = _mm_set1_ps(pTapsY[i]->F);
+
+	const auto two = _mm_set1_ps(2.0f);
+	const auto oneSixth = _mm_set1_ps(1.0f / 6.0f);
+	xEnd = (min)(xEnd, static_cast<uint32_t>(tapsX[1].size()));
+	for (auto x = xStart; x < xEnd; ++x)
+	{
+		auto result = _mm_mul_ps(Sample(pRows[1][0], pRows[1][1], fy[1], tapsX[1][x]), two);
+		result = _mm_add_ps(result, Sample(pRows[1][0], pRows[1][1], fy[1], tapsX[0][x]));
+		result = _mm_add_ps(result, Sample(pRows[1][0], pRows[1][1], fy[1], tapsX[2][x]));
+		result = _mm_add_ps(result, Sample(pRows[0][0], pRows[0][1], fy[0], tapsX[1][x]));
+		result = _mm_add_ps(result, Sample(pRows[2][0], pRows[2][1], fy[2], tapsX[1][x]));
+		_mm_storeu_ps(&pDst[x].x, _mm_mul_ps(result, oneSixth));
+	}
+}
+
+void FilterCPU::upsampleRow(float level, XMFLOAT4* pDst, const XMFLOAT4* pSrc,
+	const XMFLOAT4* pCoarser0, const XMFLOAT4* pCoarser1, const Tap& tapY,
+	const vector<Tap>& tapsX, const float* pFalloffX, float falloffY, XMFLOAT4 sigmas,
+	uint32_t xStart, uint32_t xEnd, const float* pRangeX)
+{
+	// The falloffs are null for the uniform blur, whose weights are those of the row
+	const auto isUniform = !pFalloffX;
+	const auto numerator = _mm_set1_ps(ldexpf(logf(4.0f), static_cast<int>(4.0f * level)));
+	const auto levelScale = _mm_set1_ps(ldexpf(1.0f, static_cast<int>(2.0f * level)));
+	const auto sigma = _mm_loadu_ps(&sigmas.x);
+	const auto one = _mm_set1_ps(1.0f);
+	auto weight = BlendWeights(sigma, numerator, levelScale);
+
+	const auto fy = _mm_set1_ps(tapY.F);
+	xEnd = (min)(xEnd, static_cast<uint32_t>(tapsX.size()));
+	for (auto x = xStart; x < xEnd; ++x)
+	{
+		if (!isUniform) weight = BlendWeights(_mm_mul_ps(sigma, _mm_set1_ps(pFalloffX[x] + falloffY)), numerator, levelScale);
+		const auto w = pRangeX ? _mm_sub_ps(one, _mm_mul_ps(_mm_sub_ps(one, weight), _mm_set1_ps(pRangeX[x]))) : weight;
+
+		const auto src = _mm_loadu_ps(&pSrc[x].x);
+		const auto isSaturated = _mm_movemask_ps(_mm_cmplt_ps(w, one)) == 0;
+		const auto result = isSaturated ? src : Lerp(Sample(pCoarser0, pCoarser1, fy, tapsX[x]), src, w);
+		_mm_storeu_ps(&pDst[x].x, result);
+	}
+}
+
+void FilterCPU::computeBlendWeights(float* pWeights, float level, const float* pFalloffX, float falloffY,
+	float sigma, uint32_t xStart, uint32_t xEnd)
+{
+	const auto isUniform = !pFalloffX;
+	const auto numerator = ldexpf(logf(4.0f), static_cast<int>(4.0f * level));
+	const auto levelScale = ldexpf(1.0f, static_cast<int>(2.0f * level));
+	for (auto x = xStart; x < xEnd; ++x)
+		pWeights[x - xStart] = BlendWeight(isUniform ? sigma : sigma * (pFalloffX[x] + falloffY), numerator, levelScale);
+}
+
+FilterCPU::Tap FilterCPU::computeTap(uint32_t i, uint32_t dstSize, uint32_t srcSize, float offset)
+{
+	const auto x = (i + 0.5f) * (static_cast<float>(srcSize) / dstSize) - 0.5f + offset;
+	const auto x0 = floorf(x);
+	const auto i0 = static_cast<int64_t>(x0);
+	const auto maxIndex = static_cast<int64_t>(srcSize) - 1;
+
+	Tap tap;
+	tap.I0 = static_cast<uint32_t>((min)((max)(i0, int64_t(0)), maxIndex));
+	tap.I1 = static_cast<uint32_t>((min)((max)(i0 + 1, int64_t(0)), maxIndex));
+	tap.F = x - x0;
+
+	return tap;
+}
+
+void FilterCPU::computeTaps(vector<Tap>& taps, uint32_t dstSize, uint32_t srcSize, float offset)
+{
+	taps.resize(dstSize);
+	for (auto i = 0u; i < dstSize; ++i) taps[i] = computeTap(i, dstSize, srcSize, offset);
+}
+
+const float* FilterCPU::getRangeRow(uint8_t level, uint32_t y, vector<float>& rangeRow, uint32_t xStart, uint32_t xEnd) const
+{
+	if (m_rangeSigma <= 0.0f) return nullptr;
+
+	// Between the guide texels and the guide bilinearly sampled at the coarser level
+	const auto& guides = m_guides.empty() ? m_mips : m_guides;
+	const auto& guide = guides[level];
+	const auto& coarser = guides[level + 1];
+	const auto& ty = m_tapsY[level][y];
+	const auto pGuide = &guide.Pixels[static_cast<size_t>(guide.Width) * y];
+	const auto pCoarser0 = &coarser.Pixels[static_cast<size_t>(coarser.Width) * ty.I0];
+	const auto pCoarser1 = &coarser.Pixels[static_cast<size_t>(coarser.Width) * ty.I1];
+	const auto fy = _mm_set1_ps(ty.F);
+	const auto scale = -0.5f / (m_rangeSigma * m_rangeSigma);
+	rangeRow.resize(guide.Width);
+	xEnd = (min)(xEnd, guide.Width);
+	for (auto x = xStart; x < xEnd; ++x)
+	{
+		const auto d = _mm_sub_ps(_mm_loadu_ps(&pGuide[x].x), Sample(pCoarser0, pCoarser1, fy, m_tapsX[level][x]));
+		XMFLOAT4 d2;
+		_mm_storeu_ps(&d2.x, _mm_mul_ps(d, d));
+		rangeRow[x] = expf(scale * (d2.x + d2.y + d2.z));
+	}
+
+	return rangeRow.data();
+}
+
+void FilterCPU::sampleFalloffs(float* pDst, uint32_t y, uint32_t width, uint32_t height, uint32_t xStart, uint32_t xEnd) const
+{
+	if (!m_focusPoints.empty())
+	{
+		// Only the candidates of the tile of each texel are evaluated
+		const auto tileY = (min)(static_cast<uint32_t>((y + 0.5f) * g_focusGridSize / height), g_focusGridSize - 1);
+		const auto pCandidates = &m_focusCandidates[g_focusGridSize * tileY];
+		const auto v = 2.0f * (y + 0.5f) / height - 1.0f;
+		const auto smoothness = m_focusSmoothness;
+		for (auto x = xStart; x < xEnd; ++x)
+		{
+			const auto tileX = (min)(static_cast<uint32_t>((x + 0.5f) * g_focusGridSize / width), g_focusGridSize - 1);
+			const auto u = 2.0f * (x + 0.5f) / width - 1.0f;
+			auto least = FLT_MAX;
+			auto next = FLT_MAX;
+			for (const auto& k : pCandidates[tileX])
+			{
+				const auto& point = m_focusPoints[k];
+				const auto du = u - point.Focus.x;
+				const auto dv = v - point.Focus.y;
+				const auto falloff = point.SigmaScale * (du * du + dv * dv);
+				next = (min)((max)(falloff, least), next);
+				least = (min)(falloff, least);
+			}
+
+			const auto h = smoothness > 0.0f ? (max)(smoothness - (next - least), 0.0f) / smoothness : 0.0f;
+			pDst[x - xStart] = (max)(least - 0.25f * h * h * smoothness, 0.0f);
+		}
+
+		return;
+	}
+
+	// Bilinear with clamped addresses, as the texture would be sampled
+	const auto& map = m_sigmaMap;
+	const auto ty = computeTap(y, height, map.Height);
+	const auto pRow0 = &map.Values[static_cast<size_t>(map.Width) * ty.I0];
+	const auto pRow1 = &map.Values[static_cast<size_t>(map.Width) * ty.I1];
+	for (auto x = xStart; x < xEnd; ++x)
+	{
+		const auto tx = computeTap(x, width, map.Width);
+		const auto top = pRow0[tx.I0] + (pRow0[tx.I1] - pRow0[tx.I0]) * tx.F;
+		const auto bottom = pRow1[tx.I0] + (pRow1[tx.I1] - pRow1[tx.I0]) * tx.F;
+		pDst[x - xStart] = top + (bottom - top) * ty.F;
+	}
+}
+
+const float* FilterCPU::getFalloffRow(uint8_t level, uint32_t y, XMFLOAT2 focus, const vector<float>& dist2X, float& falloffY) const
+{
+	falloffY = 0.0f;
+	if (reinterpret_cast<const uint32_t&>(focus.x) == UINT32_MAX) return nullptr;
+	if (!m_falloffs.empty()) return &m_falloffs[level][static_cast<size_t>(m_mips[level].Width) * y];
+
+	falloffY = computeDistance(y, m_mips[level].Height, focus.y);
+
+	return dist2X.data();
+}
+
+float FilterCPU::getMaxFalloff(uint8_t level, XMFLOAT2 focus, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const
+{
+	if (reinterpret_cast<const uint32_t&>(focus.x) == UINT32_MAX) return 1.0f;
+
+	// The squared distances only grow away from the focus along each axis
+	const auto& mip = m_mips[level];
+	if (m_falloffs.empty())
+		return (max)(computeDistance(x0, mip.Width, focus.x), computeDistance(x1 - 1, mip.Width, focus.x)) +
+			(max)(computeDistance(y0, mip.Height, focus.y), computeDistance(y1 - 1, mip.Height, focus.y));
+
+	// The weights only depend on the magnitude of the sigma
+	const auto& bounds = m_falloffBounds[level];
+	const auto numBlocksX = (mip.Width + g_blockSize - 1) / g_blockSize;
+	auto maxFalloff = 0.0f;
+	for (auto j = y0 / g_blockSize; j <= (y1 - 1) / g_blockSize; ++j)
+	{
+		for (auto i = x0 / g_blockSize; i <= (x1 - 1) / g_blockSize; ++i)
+		{
+			const auto& bound = bounds[numBlocksX * j + i];
+			maxFalloff = (max)({ maxFalloff, -bound.x, bound.y });
+		}
+	}
+
+	return maxFalloff;
+}
+
+XMFLOAT4 FilterCPU::getChannelSigmas(float sigma) const
+{
+	return XMFLOAT4(sigma * m_channelScales.x, sigma * m_channelScales.y, sigma * m_channelScales.z, sigma * m_channelScales.w);
+}
+
+float FilterCPU::getMaxChannelSigma(float sigma) const
+{
+	// The weights only depend on the magnitude of the sigma
+	return sigma * (max)({ fabsf(m_channelScales.x), fabsf(m_channelScales.y), fabsf(m_channelScales.z), fabsf(m_channelScales.w) });
+}
+
+uint8_t FilterCPU::getDepth(XMFLOAT2 focus, float sigma, uint8_t outputLevel) const
+{
+	const auto numMips = static_cast<uint8_t>(m_mips.size());
+	for (auto i = outputLevel; i + 1 < numMips; ++i)
+	{
+		const auto& mip = m_mips[i];
+		if (isSaturated(i, getMaxChannelSigma(sigma), getMaxFalloff(i, focus, 0, 0, mip.Width, mip.Height))) return i;
+	}
+
+	return numMips - 1;
+}
+
+bool FilterCPU::isSaturated(float level, float sigma, float maxFalloff)
+{
+	// The weights do not increase with the magnitude of the sigma, so they are all saturated if the
+	// one of the largest falloff is
+	return BlendWeight(sigma * maxFalloff, ldexpf(logf(4.0f), static_cast<int>(4.0f * level)),
+		ldexpf(1.0f, static_cast<int>(2.0f * level))) >= 1.0f;
+}
+
+float FilterCPU::computeDistance(uint32_t i, uint32_t size, float focus)
+{
+	const auto r = 2.0f * (i + 0.5f) / size - 1.0f - focus;
+
+	return r * r;
+}
+
+void FilterCPU::computeDistances(vector<float>& dist2, uint32_t size, float focus)
+{
+	dist2.resize(size);
+	for (auto i = 0u; i < size; ++i) dist2[i] = computeDistance(i, size, focus);
+}
+
+void FilterCPU::mergeRects(vector<Rect>& rects)
+{
+	for (auto isMerged = true; isMerged;)
+	{
+		isMerged = false;
+		for (size_t i = 0; i < rects.size(); ++i)
+		{
+			for (auto j = i + 1; j < rects.size();)
+			{
+				auto& a = rects[i];
+				const auto& b = rects[j];
+				if (a.Left < b.Right && b.Left < a.Right && a.Top < b.Bottom && b.Top < a.Bottom)
+				{
+					a.Left = (min)(a.Left, b.Left);
+					a.Top = (min)(a.Top, b.Top);
+					a.Right = (max)(a.Right, b.Right);
+					a.Bottom = (max)(a.Bottom, b.Bottom);
+					rects[j] = rects.back();
+					rects.pop_back();
+
+					// The grown rectangle is checked against the others again, and the earlier
+					// ones in the next sweep
+					j = i + 1;
+					isMerged = true;
+				}
+				else ++j;
+			}
+		}
+	}
+}
+
+const FilterCPU::Image& FilterCPU::getBlended(uint8_t level) const
+{
+	return level + 1u < m_mips.size() ? m_blended[level] : m_mips[level];
+}
@@ -0,0 +1,293 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "ImageFile.h"
+
+// CPU implementation of the filter for batch processing, mirroring the compute pipeline:
+// the mip chain of CSBlit2D (_HIGH_QUALITY_) and the up-sampling V-cycle of CSUpSample
+// (_PREINTEGRATED_), on float4 pixels with SSE. The pixels are held with premultiplied alpha, as
+// the source is premultiplied while it is read from the image file, so the results and queries
+// are premultiplied, and WriteResult() converts back to straight alpha.
+class FilterCPU
+{
+public:
+	struct Image
+	{
+		uint32_t Width;
+		uint32_t Height;
+		std::vector<DirectX::XMFLOAT4> Pixels;
+	};
+
+	// Bilinear footprint along one axis, at the center of a destination texel
+	struct Tap
+	{
+		uint32_t	I0;
+		uint32_t	I1;
+		float		F;
+	};
+
+	// Half-open pixel rectangle
+	struct Rect
+	{
+		uint32_t	Left;
+		uint32_t	Top;
+		uint32_t	Right;
+		uint32_t	Bottom;
+	};
+
+	// Focus with its own scale of the sigma
+	struct FocusPoint
+	{
+		DirectX::XMFLOAT2	Focus;
+		float				SigmaScale;
+	};
+
+	// Band-pass outputs of ProcessBandPass()
+	enum BandPassMode : uint8_t
+	{
+		DIFFERENCE_OF_GAUSSIANS,
+		UNSHARP_MASK,
+		CLARITY
+	};
+
+	struct BandPass
+	{
+		BandPassMode	Mode;
+		float			Sigma;	// Of the blur, or of the finer blur of the DoG
+		float			Sigma2;	// Of the coarser blur of the DoG
+		float			Amount;
+		float			Bias;	// Added to the DoG, which is signed
+	};
+
+	// Bright pass with a soft knee of the given width around the threshold, and the weight of the
+	// coarser levels in the up-sampling chain of ProcessBloom()
+	struct Bloom
+	{
+		float			Threshold;
+		float			Knee;
+		float			Intensity;
+		float			Scatter;
+	};
+
+	// Parameters and up-sampled levels of a frame processed on its own from the mip chain
+	struct Frame
+	{
+		DirectX::XMFLOAT2				Focus;
+		float							Sigma;
+		std::vector<Image>				Blended;
+		std::vector<std::vector<float>>	Dist2X;
+	};
+
+	FilterCPU();
+	virtual ~FilterCPU();
+
+	// The mip chain only depends on the source, so it is generated once here; the pixels moved in
+	// are taken as premultiplied already
+	bool Init(const ImageFile& source);
+	bool Init(std::vector<DirectX::XMFLOAT4>&& pixels, uint32_t width, uint32_t height);
+
+	void UpdateFrame(DirectX::XMFLOAT2 focus, float sigma);
+
+	// Per-pixel sigma map in place of the radial falloff around the focus: the sigma of a texel is
+	// the sigma of UpdateFrame() times the first channel of the map, sampled bilinearly at the texel
+	// center, so the map may be of any size. The uniform blur ignores it, and an empty map restores
+	// the radial falloff
+	bool SetSigmaMap(const ImageFile& sigmaMap);
+	bool SetSigmaMap(const float* pSigmaMap, uint32_t width, uint32_t height);
+
+	// Several focus points in place of the focus of UpdateFrame(), e.g. the gazes of both eyes, or
+	// the regions of a UI: the falloff of a texel is the least of its squared distances to the points
+	// times their sigma scales, blended with the next least by a polynomial smooth minimum of the
+	// smoothness. They replace the sigma map and vice versa, and no points restore the radial falloff
+	bool SetFocusPoints(const FocusPoint* pPoints, uint32_t numPoints, float smoothness = 0.0f);
+
+	// Scales of the sigma per channel, e.g. slightly different radii of R, G and B for a chromatic
+	// separation: the blend weights are computed per lane, so that one V-cycle blurs each channel
+	// with its own sigma. The alpha scale applies to the premultiplied alpha; all scales are 1 by default
+	void SetChannelScales(DirectX::XMFLOAT4 scales);
+
+	// Edge-aware blending, an O(N) approximation of a cross-bilateral blur: the blend of a texel
+	// toward the coarser level is scaled by the range term exp(-d^2 / (2 rangeSigma^2)) of the color
+	// distance d between the guide at the texel and the guide sampled from the coarser level, so
+	// that the blur does not leak across the edges of the guide. The guide is the source itself if
+	// null, or else an image of the size of the source, which Init() drops; a range sigma of 0
+	// disables it
+	bool SetEdgeAware(float rangeSigma, const ImageFile* pGuide = nullptr);
+
+	// Up-sampling stops at the output level, whose result is then a reduced-resolution image
+	void Process(uint8_t outputLevel = 0);
+
+	// Region-of-interest evaluation: each level is only up-sampled over the footprints of the
+	// ROIs, widened by the bilinear halos, so that the ROIs of the result match a full Process()
+	void Process(const Rect* pROIs, uint32_t numROIs);
+
+	// The mip chain is only read, so frames of different parameters can be processed concurrently
+	// from one pyramid, e.g. for rendering a parameter animation
+	void Process(Frame& frame, uint8_t outputLevel = 0) const;
+
+	// Fan-out of several parameter sets in one sweep over the levels: each mip row is read once for
+	// all the frames, and frames whose levels are up-sampled alike, i.e. from the same coarser level
+	// with the same weights, e.g. saturated ones, share them. With a tolerance, frames of weights
+	// that differ, e.g. uniform blurs of close sigmas, or ones near saturation, also share a level as
+	// long as the bound of the deviation of their results, accumulated over the levels, is within the
+	// tolerance. Only the output levels are then complete
+	void Process(Frame* pFrames, uint32_t numFrames, uint8_t outputLevel = 0, float tolerance = 0.0f) const;
+
+	// Sharpening and local contrast from the same pyramid and weights as the blur: the difference
+	// of the blurs of two sigmas (DoG), with an opaque alpha, or the source plus the amount of its
+	// difference to the blur (unsharp mask), or that of a large sigma toward the midtones (clarity).
+	// The blurs are frames of the fan-out with the focus and falloffs of the current frame
+	void ProcessBandPass(Image& result, const BandPass& bandPass, uint8_t outputLevel = 0) const;
+
+	// Bloom from the same mip chain as the blur: the bright passes of the mips below the output level
+	// are accumulated up to the output level with the up-sampling taps of the V-cycle, or that of the
+	// output mip at the coarsest level. It is added by its intensity to the result of Process() at
+	// the output level if composited, with the alpha of the glow over it, or else output on its own
+	// with an opaque alpha
+	void ProcessBloom(Image& result, const Bloom& bloom, uint8_t outputLevel = 0, bool isComposited = true) const;
+
+	// Incremental update after the source changed within the dirty rectangles: they are re-read,
+	// and the mips are only regenerated over their footprints up the pyramid
+	bool UpdateSource(const ImageFile& source, const Rect* pDirtyRects, uint32_t numRects);
+
+	// Re-blurs only the up-sampled blocks affected by the updated source, and returns the number
+	// of pixels re-blended. Changes of a block within the tolerance are not propagated to the finer
+	// levels, and the deviation of the result this leaves is kept within the tolerance over the
+	// successive updates
+	size_t ProcessDirty(float tolerance = 0.0f);
+
+	const Image& GetResult(uint8_t level = 0) const;
+	const Image& GetResult(const Frame& frame, uint8_t level = 0) const;
+
+	// Pull-based queries of the result, without Process(): only the blocks of each level in the
+	// cones of the queried pixels are up-sampled, and they are kept until the next UpdateFrame()
+	void Query(DirectX::XMFLOAT4* pDst, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+	void Query(DirectX::XMFLOAT4* pDst, const DirectX::XMUINT2* pPoints, uint32_t numPoints);
+	void GetImageSize(uint32_t& width, uint32_t& height, uint8_t level = 0) const;
+	uint8_t GetNumLevels() const;
+
+	// Write the result rows at a level, converted to the layout of the image file
+	void WriteResult(ImageFile& imageFile, uint8_t level = 0) const;
+
+	// Bytes of the mip chain and the up-sampled levels for an image size
+	static size_t GetWorkingSetSize(uint32_t width, uint32_t height);
+
+	// Conversions from straight to premultiplied alpha and back; transparent pixels turn black
+	static void Premultiply(DirectX::XMFLOAT4* pPixels, size_t numPixels);
+	static void Unpremultiply(DirectX::XMFLOAT4* pDst, const DirectX::XMFLOAT4* pSrc, size_t numPixels);
+
+protected:
+	struct SigmaMap
+	{
+		uint32_t			Width;
+		uint32_t			Height;
+		std::vector<float>	Values;
+	};
+
+	bool loadSigmaMap(const ImageFile& sigmaMap);
+	bool loadSigmaMap(const float* pSigmaMap, uint32_t width, uint32_t height);
+	bool loadFocusPoints(const FocusPoint* pPoints, uint32_t numPoints, float smoothness);
+	bool hasFalloffMap() const;	// With a sigma map or focus points, whose falloffs are sampled per texel
+	void updateFalloffs();
+	void updateFalloffs(uint8_t level);	// Samples the falloffs of a level with the min/max of its blocks
+
+	void resizeLevels(uint32_t width, uint32_t height);
+	void buildLevels();
+	void initLevels();
+	void updateDistances();
+	void generateMips(uint8_t level, uint32_t rowStart, uint32_t rowEnd, uint32_t colStart = 0, uint32_t colEnd = UINT32_MAX);
+	static void downsample(Image& dst, const Image& src, uint32_t rowStart, uint32_t rowEnd,
+		uint32_t colStart = 0, uint32_t colEnd = UINT32_MAX);
+	void upsample(uint8_t level, uint32_t rowStart, uint32_t rowEnd, uint32_t colStart = 0, uint32_t colEnd = UINT32_MAX);
+	void ensureBlended(uint8_t level, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1);
+
+	// Re-blends the up-sampled blocks over the dirty mip or the changed coarser blocks, and returns
+	// the largest change within the tolerance, which is not propagated
+	float reblendBlocks(uint8_t level, const std::vector<uint8_t>& dirty, const std::vector<uint8_t>& coarserChanged,
+		std::vector<uint8_t>& changed, float tolerance, size_t& numPixels);
+
+	// Row kernels; pRows holds the source rows at I0 and I1 of each vertical tap. The sigmas of texel
+	// x are those of the channels times (pFalloffX[x] + falloffY), from the squared distances to the
+	// focus, or a row of the sigma map and 0, and they are uniform if pFalloffX is null. Texels of
+	// weights all saturated take the source without reading the coarser rows, and the range terms
+	// of the edge-aware blend, unless pRangeX is null, scale the weights of the coarser level. The
+	// level is half-integer for the texels of a rip-map, as the blend weight only depends on the
+	// texel area 4^level
+	static void downsampleRow(DirectX::XMFLOAT4* pDst, const DirectX::XMFLOAT4* const pRows[3][2],
+		const Tap* const pTapsY[3], const std::vector<Tap> tapsX[3], uint32_t xStart, uint32_t xEnd);
+	static void upsampleRow(float level, DirectX::XMFLOAT4* pDst, const DirectX::XMFLOAT4* pSrc,
+		const DirectX::XMFLOAT4* pCoarser0, const DirectX::XMFLOAT4* pCoarser1, const Tap& tapY,
+		const std::vector<Tap>& tapsX, const float* pFalloffX, float falloffY, DirectX::XMFLOAT4 sigmas,
+		uint32_t xStart, uint32_t xEnd, const float* pRangeX = nullptr);
+
+	// Blend weights of the texels [xStart, xEnd) of a row, as taken by upsampleRow()
+	static void computeBlendWeights(float* pWeights, float level, const float* pFalloffX, float falloffY,
+		float sigma, uint32_t xStart, uint32_t xEnd);
+
+	// Texel offsets are in source texels, and addresses are clamped (LINEAR_CLAMP)
+	static Tap computeTap(uint32_t i, uint32_t dstSize, uint32_t srcSize, float offset = 0.0f);
+	static void computeTaps(std::vector<Tap>& taps, uint32_t dstSize, uint32_t srcSize, float offset = 0.0f);
+
+	// Range terms of the guide over [xStart, xEnd) of row y of a level, or null if not edge-aware
+	const float* getRangeRow(uint8_t level, uint32_t y, std::vector<float>& rangeRow,
+		uint32_t xStart = 0, uint32_t xEnd = UINT32_MAX) const;
+
+	// Falloffs of the sigma map or the focus points at the texel centers [xStart, xEnd) of row y of a level
+	void sampleFalloffs(float* pDst, uint32_t y, uint32_t width, uint32_t height, uint32_t xStart, uint32_t xEnd) const;
+
+	// Falloff row of a level for upsampleRow(), from the sampled sigma map or the distances to the focus
+	const float* getFalloffRow(uint8_t level, uint32_t y, DirectX::XMFLOAT2 focus,
+		const std::vector<float>& dist2X, float& falloffY) const;
+
+	// Largest falloff over [x0, x1) x [y0, y1) of a level: at the farthest corner from the focus, or
+	// from the min/max pyramid of the sigma map over the blocks covering it
+	float getMaxFalloff(uint8_t level, DirectX::XMFLOAT2 focus, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const;
+
+	// Finest level from the output level on whose weights are all saturated, so that the coarser
+	// levels are not read; the V-cycle starts there
+	uint8_t getDepth(DirectX::XMFLOAT2 focus, float sigma, uint8_t outputLevel) const;
+
+	// Whether the weights of a level are all saturated up to the falloff; the sigma is the largest of the channels
+	static bool isSaturated(float level, float sigma, float maxFalloff);
+
+	// Sigmas of the channels, and the largest of them, for a sigma
+	DirectX::XMFLOAT4 getChannelSigmas(float sigma) const;
+	float getMaxChannelSigma(float sigma) const;
+
+	// Squared distances to the focus along one axis, in [-1, 1] screen space
+	static float computeDistance(uint32_t i, uint32_t size, float focus);
+	static void computeDistances(std::vector<float>& dist2, uint32_t size, float focus);
+
+	// Merges overlapping rectangles into their bounds
+	static void mergeRects(std::vector<Rect>& rects);
+
+	const Image& getBlended(uint8_t level) const;
+
+	std::vector<Image>	m_mips;
+	std::vector<Image>	m_blended;	// Up-sampled levels, with the result at level 0; the coarsest level is the mip itself
+
+	std::vector<std::vector<Tap>>		m_tapsX;	// Up-sampling taps of each level from the coarser one
+	std::vector<std::vector<Tap>>		m_tapsY;
+	std::vector<std::vector<float>>		m_dist2X;	// Empty if uniform
+	std::vector<std::vector<float>>		m_falloffs;	// Sigma map sampled at each level; empty without one
+	std::vector<std::vector<DirectX::XMFLOAT2>>	m_falloffBounds;	// Min and max falloffs of the blocks of each level
+	std::vector<std::vector<uint8_t>>	m_blendedBlocks;	// Up-sampled blocks of each level
+	std::vector<std::vector<Rect>>		m_dirtyRects;		// Regenerated mip rectangles of each level
+
+	SigmaMap			m_sigmaMap;	// Empty for the radial falloff
+
+	std::vector<FocusPoint>				m_focusPoints;		// Empty for the single focus
+	std::vector<std::vector<uint32_t>>	m_focusCandidates;	// Points that may be the least within each tile of the screen
+	float								m_focusSmoothness;
+
+	DirectX::XMFLOAT2	m_focus;
+	float				m_sigma;
+	DirectX::XMFLOAT4	m_channelScales;	// Of the sigma
+	float				m_errorBound;	// Deviation of the result left by ProcessDirty()
+
+	std::vector<Image>	m_guides;		// Mip chain of the guide image; empty for the source itself
+	float				m_rangeSigma;	// Of the edge-aware blend, or 0
+};
@@ -0,0 +1,15 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "FilterChannelsCPU.h"
+
+using namespace DirectX::PackedVector;
+
+// Explicit instantiations, so that the template is compiled with the project;
+// other channel counts are instantiated where they are used
+template class FilterChannelsCPU<1>;
+template class FilterChannelsCPU<3>;
+template class FilterChannelsCPU<4>;
+template class FilterChannelsCPU<4, HALF>;
+template class FilterChannelsCPU<16, HALF>;
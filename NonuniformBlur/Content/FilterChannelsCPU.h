@@ -0,0 +1,340 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "FilterCPU.h"
+#include <DirectXPackedVector.h>
+#include <xmmintrin.h>
+
+// Conversions of a channel from and to float
+template<typename T>
+struct ChannelElement;
+
+template<>
+struct ChannelElement<float>
+{
+	static float ToFloat(float v) { return v; }
+	static float FromFloat(float v) { return v; }
+};
+
+template<>
+struct ChannelElement<DirectX::PackedVector::HALF>
+{
+	static float ToFloat(DirectX::PackedVector::HALF v) { return DirectX::PackedVector::XMConvertHalfToFloat(v); }
+	static DirectX::PackedVector::HALF FromFloat(float v) { return DirectX::PackedVector::XMConvertFloatToHalf(v); }
+};
+
+// Multichannel variant of the CPU filter for ML feature maps and multispectral images, of 1 to 64
+// channels of float or half (DirectX::PackedVector::HALF). The pixels are held in blocks of 4
+// channels, the last one padded with zeros, and the taps and blend weights of a texel are computed
+// once for all its blocks, so that one pass over each level blurs all the channels. The levels are
+// float, so half pixels are only converted when they are read and when the result is copied. The
+// channels are independent, with no alpha, and the pixels are read and written interleaved in
+// memory; only raw image files hold more than 4 channels.
+template<uint8_t N, typename T = float>
+class FilterChannelsCPU :
+	protected FilterCPU
+{
+public:
+	static_assert(N >= 1 && N <= 64, "FilterChannelsCPU supports 1 to 64 channels");
+
+	FilterChannelsCPU();
+	virtual ~FilterChannelsCPU();
+
+	// The mip chain is generated once here from the interleaved channels of each pixel, of which
+	// there may be fewer than N, the rest being zeros
+	bool Init(const T* pPixels, uint32_t width, uint32_t height, uint8_t numChannels = N);
+
+	// The falloffs of the sigma map or the focus points are sampled at each level, as for FilterCPU
+	bool SetSigmaMap(const ImageFile& sigmaMap);
+	bool SetSigmaMap(const float* pSigmaMap, uint32_t width, uint32_t height);
+	bool SetFocusPoints(const FocusPoint* pPoints, uint32_t numPoints, float smoothness = 0.0f);
+
+	using FilterCPU::UpdateFrame;
+	using FilterCPU::GetImageSize;
+	using FilterCPU::GetNumLevels;
+
+	// Up-sampling stops at the output level, as for FilterCPU
+	void Process(uint8_t outputLevel = 0);
+
+	// Copies the result at a level, with the channels of each pixel interleaved
+	void GetResult(T* pDst, uint8_t level = 0, uint8_t numChannels = N) const;
+
+	// Bytes of the mip chain and the up-sampled levels for an image size
+	static size_t GetWorkingSetSize(uint32_t width, uint32_t height);
+
+protected:
+	static const uint32_t NumBlocks = (N + 3) / 4;
+	static const uint32_t Stride = 4 * NumBlocks;	// Elements of a padded pixel
+
+	struct Level
+	{
+		uint32_t			Width;
+		uint32_t			Height;
+		std::vector<float>	Pixels;
+	};
+
+	void updateLevelFalloffs();
+	void generateLevel(uint8_t level);
+	void blendLevel(uint8_t level);
+	const Level& getBlendedLevel(uint8_t level) const;
+
+	static __m128 sample(const float* pRow0, const float* pRow1, __m128 fy, const Tap& tx, uint32_t block);
+
+	std::vector<Level>	m_levels;			// Mip chain
+	std::vector<Level>	m_blendedLevels;	// Up-sampled levels; the coarsest level is the mip itself
+	std::vector<float>	m_weightRow;
+};
+
+template<uint8_t N, typename T>
+FilterChannelsCPU<N, T>::FilterChannelsCPU()
+{
+}
+
+template<uint8_t N, typename T>
+FilterChannelsCPU<N, T>::~FilterChannelsCPU()
+{
+}
+
+template<uint8_t N, typename T>
+bool FilterChannelsCPU<N, T>::Init(const T* pPixels, uint32_t width, uint32_t height, uint8_t numChannels)
+{
+	XUSG_N_RETURN(pPixels && width > 0 && height > 0 && numChannels >= 1 && numChannels <= N, false);
+
+	// FilterCPU only keeps the sizes of the levels, for the taps and the falloffs
+	uint8_t numMips = 1;
+	while ((std::max)(width, height) >> numMips) ++numMips;
+	m_mips.resize(numMips);
+	m_blended.resize(numMips);
+	m_levels.resize(numMips);
+	m_blendedLevels.resize(numMips);
+	for (uint8_t i = 0; i < numMips; ++i)
+	{
+		auto& mip = m_mips[i];
+		mip.Width = (std::max)(width >> i, 1u);
+		mip.Height = (std::max)(height >> i, 1u);
+		mip.Pixels.clear();
+		m_blended[i].Width = mip.Width;
+		m_blended[i].Height = mip.Height;
+		m_blended[i].Pixels.clear();
+
+		const auto numElements = static_cast<size_t>(Stride) * mip.Width * mip.Height;
+		auto& level = m_levels[i];
+		level.Width = mip.Width;
+		level.Height = mip.Height;
+		level.Pixels.resize(numElements);
+
+		auto& blended = m_blendedLevels[i];
+		blended.Width = mip.Width;
+		blended.Height = mip.Height;
+		blended.Pixels.resize(i + 1 < numMips ? numElements : 0);
+	}
+
+	// Convert and pad the channels to whole blocks
+	auto& level0 = m_levels[0];
+	const auto numPixels = static_cast<size_t>(width) * height;
+	for (size_t i = 0; i < numPixels; ++i)
+	{
+		const auto pSrc = &pPixels[numChannels * i];
+		const auto pDst = &level0.Pixels[Stride * i];
+		for (uint8_t c = 0; c < numChannels; ++c) pDst[c] = ChannelElement<T>::ToFloat(pSrc[c]);
+		std::fill(pDst + numChannels, pDst + Stride, 0.0f);
+	}
+
+	for (uint8_t i = 1; i < numMips; ++i) generateLevel(i);
+	initLevels();
+	updateLevelFalloffs();
+
+	return true;
+}
+
+template<uint8_t N, typename T>
+bool FilterChannelsCPU<N, T>::SetSigmaMap(const ImageFile& sigmaMap)
+{
+	XUSG_N_RETURN(FilterCPU::SetSigmaMap(sigmaMap), false);
+	updateLevelFalloffs();
+
+	return true;
+}
+
+template<uint8_t N, typename T>
+bool FilterChannelsCPU<N, T>::SetSigmaMap(const float* pSigmaMap, uint32_t width, uint32_t height)
+{
+	XUSG_N_RETURN(FilterCPU::SetSigmaMap(pSigmaMap, width, height), false);
+	updateLevelFalloffs();
+
+	return true;
+}
+
+template<uint8_t N, typename T>
+bool FilterChannelsCPU<N, T>::SetFocusPoints(const FocusPoint* pPoints, uint32_t numPoints, float smoothness)
+{
+	XUSG_N_RETURN(FilterCPU::SetFocusPoints(pPoints, numPoints, smoothness), false);
+	updateLevelFalloffs();
+
+	return true;
+}
+
+template<uint8_t N, typename T>
+void FilterChannelsCPU<N, T>::Process(uint8_t outputLevel)
+{
+	// The depth is bounded by the distances to the focus, or by the falloff bounds of the blocks
+	const auto numMips = static_cast<uint8_t>(m_mips.size());
+	const auto depth = getDepth(m_focus, m_sigma, outputLevel);
+	for (auto i = (std::min)(depth + 1, numMips - 1); i > outputLevel; --i)
+		blendLevel(static_cast<uint8_t>(i - 1));
+}
+
+template<uint8_t N, typename T>
+void FilterChannelsCPU<N, T>::GetResult(T* pDst, uint8_t level, uint8_t numChannels) const
+{
+	assert(numChannels <= N);
+
+	const auto& result = getBlendedLevel(level);
+	const auto numPixels = static_cast<size_t>(result.Width) * result.Height;
+	for (size_t i = 0; i < numPixels; ++i)
+	{
+		const auto pSrc = &result.Pixels[Stride * i];
+		const auto pPixel = &pDst[numChannels * i];
+		for (uint8_t c = 0; c < numChannels; ++c) pPixel[c] = ChannelElement<T>::FromFloat(pSrc[c]);
+	}
+}
+
+template<uint8_t N, typename T>
+size_t FilterChannelsCPU<N, T>::GetWorkingSetSize(uint32_t width, uint32_t height)
+{
+	// Mips plus the up-sampled levels, which are all but the coarsest
+	size_t numPixels = 0;
+	for (auto i = 0u; (width | height) >> i; ++i)
+	{
+		const auto levelPixels = static_cast<size_t>((std::max)(width >> i, 1u)) * (std::max)(height >> i, 1u);
+		numPixels += 2 * levelPixels;
+	}
+
+	return sizeof(float) * Stride * numPixels;
+}
+
+template<uint8_t N, typename T>
+void FilterChannelsCPU<N, T>::updateLevelFalloffs()
+{
+	// FilterCPU only samples the levels that it holds, which are none here
+	updateFalloffs();
+	if (!hasFalloffMap()) return;
+
+	for (size_t i = 0; i + 1 < m_mips.size(); ++i) updateFalloffs(static_cast<uint8_t>(i));
+}
+
+template<uint8_t N, typename T>
+void FilterChannelsCPU<N, T>::generateLevel(uint8_t level)
+{
+	const auto& src = m_levels[level - 1];
+	auto& dst = m_levels[level];
+
+	// 5 bilinear taps, as in FilterCPU::downsampleRow()
+	std::vector<Tap> tapsX[3], tapsY[3];
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		computeTaps(tapsX[i], dst.Width, src.Width, i - 1.0f);
+		computeTaps(tapsY[i], dst.Height, src.Height, i - 1.0f);
+	}
+
+	const auto two = _mm_set1_ps(2.0f);
+	const auto oneSixth = _mm_set1_ps(1.0f / 6.0f);
+	const auto pSrc = src.Pixels.data();
+	for (auto y = 0u; y < dst.Height; ++y)
+	{
+		const float* pRows[3][2];
+		__m128 fy[3];
+		for (uint8_t i = 0; i < 3; ++i)
+		{
+			const auto& ty = tapsY[i][y];
+			pRows[i][0] = &pSrc[static_cast<size_t>(Stride) * src.Width * ty.I0];
+			pRows[i][1] = &pSrc[static_cast<size_t>(Stride) * src.Width * ty.I1];
+			fy[i] = _mm_set1_ps(ty.F);
+		}
+
+		const auto pDst = &dst.Pixels[static_cast<size_t>(Stride) * dst.Width * y];
+		for (auto x = 0u; x < dst.Width; ++x)
+		{
+			for (auto b = 0u; b < NumBlocks; ++b)
+			{
+				auto result = _mm_mul_ps(sample(pRows[1][0], pRows[1][1], fy[1], tapsX[1][x], b), two);
+				result = _mm_add_ps(result, sample(pRows[1][0], pRows[1][1], fy[1], tapsX[0][x], b));
+				result = _mm_add_ps(result, sample(pRows[1][0], pRows[1][1], fy[1], tapsX[2][x], b));
+				result = _mm_add_ps(result, sample(pRows[0][0], pRows[0][1], fy[0], tapsX[1][x], b));
+				result = _mm_add_ps(result, sample(pRows[2][0], pRows[2][1], fy[2], tapsX[1][x], b));
+				_mm_storeu_ps(&pDst[Stride * x + 4 * b], _mm_mul_ps(result, oneSixth));
+			}
+		}
+	}
+}
+
+template<uint8_t N, typename T>
+void FilterChannelsCPU<N, T>::blendLevel(uint8_t level)
+{
+	const auto& src = m_levels[level];
+	const auto& coarser = getBlendedLevel(level + 1);
+	auto& dst = m_blendedLevels[level];
+	const auto& tapsX = m_tapsX[level];
+	const auto& tapsY = m_tapsY[level];
+
+	m_weightRow.resize(dst.Width);
+	const auto pCoarser = coarser.Pixels.data();
+	for (auto y = 0u; y < dst.Height; ++y)
+	{
+		float falloffY;
+		const auto pFalloffX = getFalloffRow(level, y, m_focus, m_dist2X[level], falloffY);
+		computeBlendWeights(m_weightRow.data(), level, pFalloffX, falloffY, m_sigma, 0, dst.Width);
+
+		const auto& ty = tapsY[y];
+		const auto fy = _mm_set1_ps(ty.F);
+		const auto pCoarser0 = &pCoarser[static_cast<size_t>(Stride) * coarser.Width * ty.I0];
+		const auto pCoarser1 = &pCoarser[static_cast<size_t>(Stride) * coarser.Width * ty.I1];
+		const auto rowOffset = static_cast<size_t>(Stride) * dst.Width * y;
+		const auto pSrc = &src.Pixels[rowOffset];
+		const auto pDst = &dst.Pixels[rowOffset];
+		for (auto x = 0u; x < dst.Width; ++x)
+		{
+			// Texels of saturated weights take the source without reading the coarser rows
+			const auto weight = m_weightRow[x];
+			if (weight >= 1.0f)
+			{
+				std::copy(&pSrc[Stride * x], &pSrc[Stride * (x + 1)], &pDst[Stride * x]);
+				continue;
+			}
+
+			const auto w = _mm_set1_ps(weight);
+			for (auto b = 0u; b < NumBlocks; ++b)
+			{
+				const auto offset = Stride * x + 4 * b;
+				const auto a = sample(pCoarser0, pCoarser1, fy, tapsX[x], b);
+				const auto s = _mm_loadu_ps(&pSrc[offset]);
+				_mm_storeu_ps(&pDst[offset], _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(s, a), w)));
+			}
+		}
+	}
+}
+
+template<uint8_t N, typename T>
+const typename FilterChannelsCPU<N, T>::Level& FilterChannelsCPU<N, T>::getBlendedLevel(uint8_t level) const
+{
+	return level + 1u < m_levels.size() ? m_blendedLevels[level] : m_levels[level];
+}
+
+template<uint8_t N, typename T>
+__m128 FilterChannelsCPU<N, T>::sample(const float* pRow0, const float* pRow1, __m128 fy, const Tap& tx, uint32_t block)
+{
+	const auto i0 = Stride * tx.I0 + 4 * block;
+	const auto i1 = Stride * tx.I1 + 4 * block;
+	const auto fx = _mm_set1_ps(tx.F);
+	const auto t0 = _mm_loadu_ps(&pRow0[i0]);
+	const auto t1 = _mm_loadu_ps(&pRow0[i1]);
+	const auto b0 = _mm_loadu_ps(&pRow1[i0]);
+	const auto b1 = _mm_loadu_ps(&pRow1[i1]);
+	const auto top = _mm_add_ps(t0, _mm_mul_ps(_mm_sub_ps(t1, t0), fx));
+	const auto bottom = _mm_add_ps(b0, _mm_mul_ps(_mm_sub_ps(b1, b0), fx));
+
+	return _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fy));
+}
@@ -0,0 +1,323 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "FilterDOFCPU.h"
+#include <xmmintrin.h>
+#include <cfloat>
+
+using namespace std;
+using namespace DirectX;
+
+FilterDOFCPU::FilterDOFCPU() :
+	m_source(),
+	m_result(),
+	m_numLevels(0)
+{
+}
+
+FilterDOFCPU::~FilterDOFCPU()
+{
+}
+
+bool FilterDOFCPU::Init(const ImageFile& source, const ImageFile& depth, uint8_t numSlices)
+{
+	const auto& desc = source.GetDesc();
+	const auto& depthDesc = depth.GetDesc();
+	XUSG_N_RETURN(desc.Width > 0 && desc.Height > 0 && numSlices > 0, false);
+	XUSG_N_RETURN(depthDesc.Width == desc.Width && depthDesc.Height == desc.Height, false);
+
+	const auto numPixels = static_cast<size_t>(desc.Width) * desc.Height;
+	m_source.Width = desc.Width;
+	m_source.Height = desc.Height;
+	m_source.Pixels.resize(numPixels);
+	source.ReadRows(0, desc.Height, &m_source.Pixels[0].x, sizeof(XMFLOAT4) * desc.Width, 4);
+	FilterCPU::Premultiply(m_source.Pixels.data(), numPixels);
+
+	// The CoC is linear in the inverse depth, so the slices are even in it
+	m_invDepths.resize(numPixels);
+	depth.ReadRows(0, desc.Height, m_invDepths.data(), sizeof(float) * desc.Width, 1);
+	auto minInvDepth = FLT_MAX;
+	auto maxInvDepth = 0.0f;
+	for (auto& invDepth : m_invDepths)
+	{
+		invDepth = invDepth > 0.0f ? 1.0f / invDepth : 0.0f;
+		minInvDepth = (min)(invDepth, minInvDepth);
+		maxInvDepth = (max)(invDepth, maxInvDepth);
+	}
+
+	const auto sliceScale = maxInvDepth > minInvDepth ? numSlices / (maxInvDepth - minInvDepth) : 0.0f;
+	m_slices.resize(numPixels);
+	m_sliceRanges.assign(numSlices, XMFLOAT2(FLT_MAX, -FLT_MAX));
+	for (size_t i = 0; i < numPixels; ++i)
+	{
+		const auto invDepth = m_invDepths[i];
+		const auto slice = (min)(static_cast<uint8_t>((maxInvDepth - invDepth) * sliceScale), static_cast<uint8_t>(numSlices - 1));
+		auto& range = m_sliceRanges[slice];
+		range.x = (min)(invDepth, range.x);
+		range.y = (max)(invDepth, range.y);
+		m_slices[i] = slice;
+	}
+
+	// Each slice holds its pixels, and under the nearer slices, what is behind them filled in, so that
+	// it shows where they are blurred; the pixels of the farther slices are left transparent
+	m_layers.assign(numSlices, FilterCPU());
+	for (uint8_t i = 0; i < numSlices; ++i)
+	{
+		if (m_sliceRanges[i].x > m_sliceRanges[i].y) continue;
+
+		vector<XMFLOAT4> layer(numPixels, XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f));
+		for (size_t j = 0; j < numPixels; ++j)
+			if (m_slices[j] == i) layer[j] = m_source.Pixels[j];
+		if (i > 0) fillOccluded(layer, i);
+		m_layers[i].Init(move(layer), desc.Width, desc.Height);
+	}
+
+	// Full mip chain, as for FilterCPU
+	m_numLevels = 1;
+	while ((max)(desc.Width, desc.Height) >> m_numLevels) ++m_numLevels;
+
+	return true;
+}
+
+void FilterDOFCPU::UpdateFrame(float focusDistance, float aperture)
+{
+	const auto numPixels = m_source.Pixels.size();
+	const auto getCoC = [focusDistance, aperture](float invDepth) { return aperture * (1.0f - focusDistance * invDepth); };
+
+	// Only the sigma maps change with the focus. The pixels outside a slice behind the focus take its
+	// least CoC, so that a sharp subject does not spread, and those of a slice in front of it are
+	// dilated into from the CoC of its pixels instead
+	vector<float> sigmaMap(numPixels);
+	const auto numSlices = static_cast<uint8_t>(m_layers.size());
+	for (uint8_t i = 0; i < numSlices; ++i)
+	{
+		const auto& range = m_sliceRanges[i];
+		if (range.x > range.y) continue;
+
+		const auto nearCoC = getCoC(range.y);
+		const auto outsideSigma = (max)(nearCoC, 0.0f);
+		for (size_t j = 0; j < numPixels; ++j)
+			sigmaMap[j] = m_slices[j] == i ? fabsf(getCoC(m_invDepths[j])) : outsideSigma;
+		if (nearCoC < 0.0f) dilateNearField(sigmaMap, -nearCoC);
+
+		// The CoC is in units of sigma, so the map is taken as it is
+		auto& layer = m_layers[i];
+		layer.SetSigmaMap(sigmaMap.data(), m_source.Width, m_source.Height);
+		layer.UpdateFrame(XMFLOAT2(0.0f, 0.0f), 1.0f);
+	}
+}
+
+void FilterDOFCPU::Process(uint8_t outputLevel)
+{
+	outputLevel = (min)(outputLevel, static_cast<uint8_t>(m_numLevels - 1));
+	const auto numSlices = static_cast<uint8_t>(m_layers.size());
+	for (uint8_t i = 0; i < numSlices; ++i)
+		if (m_sliceRanges[i].x <= m_sliceRanges[i].y) m_layers[i].Process(outputLevel);
+
+	composite(outputLevel);
+}
+
+const FilterCPU::Image& FilterDOFCPU::GetResult() const
+{
+	return m_result;
+}
+
+void FilterDOFCPU::GetImageSize(uint32_t& width, uint32_t& height, uint8_t level) const
+{
+	width = (max)(m_source.Width >> level, 1u);
+	height = (max)(m_source.Height >> level, 1u);
+}
+
+uint8_t FilterDOFCPU::GetNumLevels() const
+{
+	return m_numLevels;
+}
+
+void FilterDOFCPU::WriteResult(ImageFile& imageFile) const
+{
+	imageFile.WriteRows(0, m_result.Height, &m_result.Pixels[0].x, sizeof(XMFLOAT4) * m_result.Width, 4);
+}
+
+void FilterDOFCPU::fillOccluded(vector<XMFLOAT4>& layer, uint8_t slice) const
+{
+	// Pull-push of the premultiplied pixels of this slice and the farther ones: their means and
+	// coverages are pulled down to 1x1, and the holes are pushed back up bilinearly from the coarser
+	// means, each level covering the rest of the coarser one
+	vector<FilterCPU::Image> colors(1);
+	vector<vector<float>> coverages(1);
+	colors[0].Width = m_source.Width;
+	colors[0].Height = m_source.Height;
+	colors[0].Pixels.resize(layer.size());
+	coverages[0].resize(layer.size());
+	for (size_t i = 0; i < layer.size(); ++i)
+	{
+		const auto isBehind = m_slices[i] >= slice;
+		colors[0].Pixels[i] = isBehind ? m_source.Pixels[i] : XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+		coverages[0][i] = isBehind ? 1.0f : 0.0f;
+	}
+
+	while (colors.back().Width > 1 || colors.back().Height > 1)
+	{
+		const auto& src = colors.back();
+		const auto& srcCoverages = coverages.back();
+		FilterCPU::Image dst;
+		dst.Width = (src.Width + 1) / 2;
+		dst.Height = (src.Height + 1) / 2;
+		dst.Pixels.resize(static_cast<size_t>(dst.Width) * dst.Height);
+		vector<float> dstCoverages(dst.Pixels.size());
+		for (auto y = 0u; y < dst.Height; ++y)
+		{
+			for (auto x = 0u; x < dst.Width; ++x)
+			{
+				auto sum = _mm_setzero_ps();
+				auto coverage = 0.0f;
+				auto count = 0.0f;
+				for (auto v = 2 * y; v < (min)(2 * y + 2, src.Height); ++v)
+				{
+					for (auto u = 2 * x; u < (min)(2 * x + 2, src.Width); ++u)
+					{
+						const auto j = static_cast<size_t>(src.Width) * v + u;
+						sum = _mm_add_ps(_mm_loadu_ps(&src.Pixels[j].x), sum);
+						coverage += srcCoverages[j];
+						++count;
+					}
+				}
+
+				const auto j = static_cast<size_t>(dst.Width) * y + x;
+				_mm_storeu_ps(&dst.Pixels[j].x, _mm_div_ps(sum, _mm_set1_ps(count)));
+				dstCoverages[j] = coverage / count;
+			}
+		}
+
+		colors.emplace_back(move(dst));
+		coverages.emplace_back(move(dstCoverages));
+	}
+
+	// Each texel is blended with the 2x2 coarser texels around it by 9:3:3:1, clamped at the borders
+	const auto getTap = [](uint32_t i, uint32_t coarserSize, uint32_t& i0, uint32_t& i1)
+	{
+		i0 = i / 2;
+		i1 = i & 1 ? (min)(i0 + 1, coarserSize - 1) : (i0 ? i0 - 1 : 0);
+	};
+
+	for (auto i = colors.size() - 1; i-- > 0;)
+	{
+		const auto& coarser = colors[i + 1];
+		auto& dst = colors[i];
+		const auto& dstCoverages = coverages[i];
+		for (auto y = 0u; y < dst.Height; ++y)
+		{
+			uint32_t j0, j1;
+			getTap(y, coarser.Height, j0, j1);
+			const auto pRow0 = &coarser.Pixels[static_cast<size_t>(coarser.Width) * j0];
+			const auto pRow1 = &coarser.Pixels[static_cast<size_t>(coarser.Width) * j1];
+			for (auto x = 0u; x < dst.Width; ++x)
+			{
+				uint32_t i0, i1;
+				getTap(x, coarser.Width, i0, i1);
+				const auto top = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&pRow0[i0].x), _mm_set1_ps(0.75f)),
+					_mm_mul_ps(_mm_loadu_ps(&pRow0[i1].x), _mm_set1_ps(0.25f)));
+				const auto bottom = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&pRow1[i0].x), _mm_set1_ps(0.75f)),
+					_mm_mul_ps(_mm_loadu_ps(&pRow1[i1].x), _mm_set1_ps(0.25f)));
+				const auto filled = _mm_add_ps(_mm_mul_ps(top, _mm_set1_ps(0.75f)), _mm_mul_ps(bottom, _mm_set1_ps(0.25f)));
+
+				const auto j = static_cast<size_t>(dst.Width) * y + x;
+				const auto color = _mm_loadu_ps(&dst.Pixels[j].x);
+				_mm_storeu_ps(&dst.Pixels[j].x, _mm_add_ps(color, _mm_mul_ps(filled, _mm_set1_ps(1.0f - dstCoverages[j]))));
+			}
+		}
+	}
+
+	for (size_t i = 0; i < layer.size(); ++i)
+		if (m_slices[i] < slice) layer[i] = colors[0].Pixels[i];
+}
+
+void FilterDOFCPU::dilateNearField(vector<float>& sigmaMap, float maxSigma) const
+{
+	// A blurred foreground spreads beyond its silhouette, as far as about its sigma in pixels, so its
+	// CoC is spread alike: max-reduced to blocks of at least the largest sigma, maxed with the
+	// neighboring blocks, and then interpolated back at the pixels
+	const auto width = m_source.Width;
+	const auto height = m_source.Height;
+	uint32_t blockSize = 1;
+	while (blockSize < maxSigma && blockSize < (max)(width, height)) blockSize <<= 1;
+	if (blockSize <= 1) return;
+
+	const auto blocksX = (width + blockSize - 1) / blockSize;
+	const auto blocksY = (height + blockSize - 1) / blockSize;
+	vector<float> blockMax(static_cast<size_t>(blocksX) * blocksY);
+	for (auto y = 0u; y < height; ++y)
+	{
+		auto pBlockMax = &blockMax[static_cast<size_t>(blocksX) * (y / blockSize)];
+		const auto pSigma = &sigmaMap[static_cast<size_t>(width) * y];
+		for (auto x = 0u; x < width; ++x)
+		{
+			auto& value = pBlockMax[x / blockSize];
+			value = (max)(pSigma[x], value);
+		}
+	}
+
+	vector<float> dilated(blockMax.size());
+	for (auto j = 0u; j < blocksY; ++j)
+	{
+		for (auto i = 0u; i < blocksX; ++i)
+		{
+			auto value = 0.0f;
+			for (auto v = j ? j - 1 : 0; v <= (min)(j + 1, blocksY - 1); ++v)
+				for (auto u = i ? i - 1 : 0; u <= (min)(i + 1, blocksX - 1); ++u)
+					value = (max)(blockMax[static_cast<size_t>(blocksX) * v + u], value);
+			dilated[static_cast<size_t>(blocksX) * j + i] = value;
+		}
+	}
+
+	// Bilinear between the block centers, clamped at the borders
+	const auto getTap = [blockSize](uint32_t i, uint32_t numBlocks, uint32_t& i0, uint32_t& i1)
+	{
+		const auto u = (max)((i + 0.5f) / blockSize - 0.5f, 0.0f);
+		i0 = (min)(static_cast<uint32_t>(u), numBlocks - 1);
+		i1 = (min)(i0 + 1, numBlocks - 1);
+
+		return u - i0;
+	};
+
+	for (auto y = 0u; y < height; ++y)
+	{
+		uint32_t j0, j1;
+		const auto fy = getTap(y, blocksY, j0, j1);
+		const auto pRow0 = &dilated[static_cast<size_t>(blocksX) * j0];
+		const auto pRow1 = &dilated[static_cast<size_t>(blocksX) * j1];
+		auto pSigma = &sigmaMap[static_cast<size_t>(width) * y];
+		for (auto x = 0u; x < width; ++x)
+		{
+			uint32_t i0, i1;
+			const auto fx = getTap(x, blocksX, i0, i1);
+			const auto s0 = pRow0[i0] + (pRow0[i1] - pRow0[i0]) * fx;
+			const auto s1 = pRow1[i0] + (pRow1[i1] - pRow1[i0]) * fx;
+			pSigma[x] = (max)(s0 + (s1 - s0) * fy, pSigma[x]);
+		}
+	}
+}
+
+void FilterDOFCPU::composite(uint8_t level)
+{
+	GetImageSize(m_result.Width, m_result.Height, level);
+	const auto numPixels = static_cast<size_t>(m_result.Width) * m_result.Height;
+	m_result.Pixels.assign(numPixels, XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f));
+
+	// Premultiplied slices over each other from the farthest, with the alpha of the source
+	for (auto i = m_layers.size(); i-- > 0;)
+	{
+		if (m_sliceRanges[i].x > m_sliceRanges[i].y) continue;
+
+		const auto pLayer = m_layers[i].GetResult(level).Pixels.data();
+		for (size_t j = 0; j < numPixels; ++j)
+		{
+			const auto color = _mm_loadu_ps(&pLayer[j].x);
+			const auto dst = _mm_loadu_ps(&m_result.Pixels[j].x);
+			_mm_storeu_ps(&m_result.Pixels[j].x, _mm_add_ps(color, _mm_mul_ps(dst, _mm_set1_ps(1.0f - pLayer[j].w))));
+		}
+	}
+
+	FilterCPU::Unpremultiply(m_result.Pixels.data(), m_result.Pixels.data(), numPixels);
+}
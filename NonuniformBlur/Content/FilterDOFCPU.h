@@ -0,0 +1,52 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "FilterCPU.h"
+
+// Depth-of-field variant of the CPU filter: the sigma of each pixel is its circle of confusion
+// from a depth image. The source is split into slices of inverse depth, which are blurred on their
+// own and then composited front to back, so that a sharp subject neither bleeds into a blurred
+// background nor is covered by it, while a blurred foreground spreads over the subject. The slices
+// do not depend on the focus, so the mip chain of each is generated once, and only the CoC of each
+// slice, taken as its sigma map, changes per frame; in-focus blocks are culled.
+class FilterDOFCPU
+{
+public:
+	FilterDOFCPU();
+	virtual ~FilterDOFCPU();
+
+	// The first channel of the depth image is the linear depth, in the units of the focus
+	// distance, at the size of the source; 0 is at infinity
+	bool Init(const ImageFile& source, const ImageFile& depth, uint8_t numSlices = 4);
+
+	// The CoC, aperture * (depth - focusDistance) / depth, is the sigma of a pixel
+	void UpdateFrame(float focusDistance, float aperture);
+
+	// Up-sampling stops at the output level
+	void Process(uint8_t outputLevel = 0);
+
+	// The composited result is in straight alpha, carried from the source
+	const FilterCPU::Image& GetResult() const;
+	void GetImageSize(uint32_t& width, uint32_t& height, uint8_t level = 0) const;
+	uint8_t GetNumLevels() const;
+
+	// Write the result rows, converted to the layout of the image file
+	void WriteResult(ImageFile& imageFile) const;
+
+protected:
+	void fillOccluded(std::vector<DirectX::XMFLOAT4>& layer, uint8_t slice) const;
+	void dilateNearField(std::vector<float>& sigmaMap, float maxSigma) const;
+	void composite(uint8_t level);
+
+	FilterCPU::Image				m_source;
+	std::vector<float>				m_invDepths;
+	std::vector<uint8_t>			m_slices;		// Of the pixels, from the nearest
+	std::vector<FilterCPU>			m_layers;		// Of the slices; empty ones are not initialized
+	std::vector<DirectX::XMFLOAT2>	m_sliceRanges;	// Least and greatest inverse depths of each slice; inverted if empty
+	FilterCPU::Image				m_result;
+
+	uint8_t							m_numLevels;
+};
@@ -15,8 +15,33 @@ struct CBGaussian
 {
 	XMFLOAT2	Focus;
 	float		Sigma;
+	uint32_t	UseSigmaMap;
 };
 
+// The up-sampling blend lerps to the premultiplied coarser color by the factor of the second
+// source, so that alpha is blended like the colors
+static const Graphics::Blend* GetUpSampleBlend()
+{
+	static const auto blend = []()
+	{
+		Graphics::Blend blend = {};
+		auto& rtBlend = blend.RenderTargets[0];
+		rtBlend.BlendEnable = true;
+		rtBlend.SrcBlend = BlendFactor::SRC1_ALPHA;
+		rtBlend.DestBlend = BlendFactor::INV_SRC1_ALPHA;
+		rtBlend.BlendOp = BlendOperator::ADD;
+		rtBlend.SrcBlendAlpha = BlendFactor::SRC1_ALPHA;
+		rtBlend.DestBlendAlpha = BlendFactor::INV_SRC1_ALPHA;
+		rtBlend.BlendOpAlpha = BlendOperator::ADD;
+		rtBlend.LogicOp = LogicOperator::NOOP;
+		rtBlend.WriteMask = ColorWrite::ALL;
+
+		return blend;
+	}();
+
+	return &blend;
+}
+
 FilterEZ::FilterEZ() :
 	m_imageSize(1, 1)
 {
@@ -28,7 +53,7 @@ FilterEZ::~FilterEZ()
 }
 
 bool FilterEZ::Init(CommandList* pCommandList, vector<Resource::uptr>& uploaders,
-	XUSG::Format rtFormat, const char* fileName, bool typedUAV)
+	XUSG::Format rtFormat, const char* fileName, bool typedUAV, const char* sigmaMapFileName)
 {
 	const auto pDevice = pCommandList->GetDevice();
 	m_typedUAV = typedUAV;
@@ -39,6 +64,15 @@ bool FilterEZ::Init(CommandList* pCommandList, vector<Resource::uptr>& uploaders
 	XUSG_N_RETURN(CreateTextureFromFile(pCommandList, fileName, m_source.get(),
 		uploaders.back().get(), ResourceState::COMMON, MemoryFlag::NONE, L"Source"), false);
 
+	// Load the sigma map, of any size
+	if (sigmaMapFileName)
+	{
+		m_sigmaMap = Texture::MakeUnique();
+		uploaders.emplace_back(Resource::MakeUnique());
+		XUSG_N_RETURN(CreateTextureFromFile(pCommandList, sigmaMapFileName, m_sigmaMap.get(),
+			uploaders.back().get(), ResourceState::COMMON, MemoryFlag::NONE, L"SigmaMap"), false);
+	}
+
 	// Create resources and pipelines
 	m_imageSize.x = static_cast<uint32_t>(m_source->GetWidth());
 	m_imageSize.y = m_source->GetHeight();
@@ -64,24 +98,27 @@ void FilterEZ::UpdateFrame(DirectX::XMFLOAT2 focus, float sigma, uint8_t frameIn
 		const auto pCbData = reinterpret_cast<CBGaussian*>(m_cbPerFrame->Map(frameIndex));
 		pCbData->Focus = focus;
 		pCbData->Sigma = sigma;
+		pCbData->UseSigmaMap = m_sigmaMap ? 1 : 0;
 	}
 }
 
-void FilterEZ::Process(EZ::CommandList* pCommandList, uint8_t frameIndex, PipelineType pipelineType)
+void FilterEZ::Process(EZ::CommandList* pCommandList, uint8_t frameIndex, PipelineType pipelineType, uint8_t outputLevel)
 {
+	outputLevel = (min)(outputLevel, static_cast<uint8_t>(m_filtered->GetNumMips() - 1));
+
 	switch (pipelineType)
 	{
 	case GRAPHICS:
 		generateMipsGraphics(pCommandList);
-		upsampleGraphics(pCommandList, frameIndex);
+		upsampleGraphics(pCommandList, frameIndex, outputLevel);
 		break;
 	case COMPUTE:
 		generateMipsCompute(pCommandList);
-		upsampleCompute(pCommandList, frameIndex);
+		upsampleCompute(pCommandList, frameIndex, outputLevel);
 		break;
 	default:
 		generateMipsCompute(pCommandList);
-		upsampleGraphics(pCommandList, frameIndex);
+		upsampleGraphics(pCommandList, frameIndex, outputLevel);
 	}
 }
 
@@ -90,10 +127,15 @@ Resource* FilterEZ::GetResult() const
 	return m_filtered.get();
 }
 
-void FilterEZ::GetImageSize(uint32_t& width, uint32_t& height) const
+void FilterEZ::GetImageSize(uint32_t& width, uint32_t& height, uint8_t level) const
+{
+	width = (max)(m_imageSize.x >> level, 1u);
+	height = (max)(m_imageSize.y >> level, 1u);
+}
+
+uint8_t FilterEZ::GetNumLevels() const
 {
-	width = m_imageSize.x;
-	height = m_imageSize.y;
+	return m_filtered->GetNumMips();
 }
 
 bool FilterEZ::createShaders()
@@ -108,6 +150,9 @@ bool FilterEZ::createShaders()
 	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::PS, psIndex, L"PSBlit2D.cso"), false);
 	m_shaders[PS_BLIT_2D] = m_shaderLib->GetShader(Shader::Stage::PS, psIndex++);
 
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::PS, psIndex, L"PSBlit2D_premul.cso"), false);
+	m_shaders[PS_BLIT_2D_PREMUL] = m_shaderLib->GetShader(Shader::Stage::PS, psIndex++);
+
 	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::PS, psIndex, L"PSUpSample.cso"), false);
 	m_shaders[PS_UP_SAMPLE] = m_shaderLib->GetShader(Shader::Stage::PS, psIndex++);
 
@@ -117,12 +162,18 @@ bool FilterEZ::createShaders()
 	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSBlit2D.cso"), false);
 	m_shaders[CS_BLIT_2D] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
 
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSBlit2D_premul.cso"), false);
+	m_shaders[CS_BLIT_2D_PREMUL] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
 	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSUpSample.cso"), false);
 	m_shaders[CS_UP_SAMPLE] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
 
 	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, m_typedUAV ? L"CSUpSample_in_place.cso" : L"CSUpSample_typeless.cso"), false);
 	m_shaders[CS_UP_SAMPLE_INPLACE] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
 
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, m_typedUAV ? L"CSUnpremultiply.cso" : L"CSUnpremultiply_typeless.cso"), false);
+	m_shaders[CS_UNPREMULTIPLY] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
 	return true;
 }
 
@@ -131,7 +182,6 @@ void FilterEZ::generateMipsGraphics(EZ::CommandList* pCommandList)
 	// Generate mipmaps
 	// Set pipeline state
 	pCommandList->SetGraphicsShader(Shader::Stage::VS, m_shaders[VS_SCREEN_QUAD]);
-	pCommandList->SetGraphicsShader(Shader::Stage::PS, m_shaders[PS_BLIT_2D]);
 	pCommandList->DSSetState(Graphics::DEPTH_STENCIL_NONE);
 	pCommandList->OMSetBlendState(Graphics::DEFAULT_OPAQUE);
 
@@ -147,6 +197,9 @@ void FilterEZ::generateMipsGraphics(EZ::CommandList* pCommandList)
 	const uint8_t numMips = m_filtered->GetNumMips();
 	for (uint8_t i = 1; i < numMips; ++i)
 	{
+		// The first mip premultiplies the source
+		if (i <= 2) pCommandList->SetGraphicsShader(Shader::Stage::PS, m_shaders[i > 1 ? PS_BLIT_2D : PS_BLIT_2D_PREMUL]);
+
 		// Set render target
 		const auto rtv = EZ::GetRTV(m_filtered.get(), 0, i);
 		pCommandList->OMSetRenderTargets(1, &rtv);
@@ -171,9 +224,6 @@ void FilterEZ::generateMipsGraphics(EZ::CommandList* pCommandList)
 void FilterEZ::generateMipsCompute(EZ::CommandList* pCommandList)
 {
 	// Generate mipmaps
-	// Set pipeline state
-	pCommandList->SetComputeShader(m_shaders[CS_BLIT_2D]);
-
 	// Set sampler
 	const auto sampler = LINEAR_CLAMP;
 	pCommandList->SetSamplerStates(Shader::Stage::CS, 0, 1, &sampler);
@@ -183,6 +233,9 @@ void FilterEZ::generateMipsCompute(EZ::CommandList* pCommandList)
 	const uint8_t numMips = m_filtered->GetNumMips();
 	for (uint8_t i = 1; i < numMips; ++i)
 	{
+		// The first mip premultiplies the source
+		if (i <= 2) pCommandList->SetComputeShader(m_shaders[i > 1 ? CS_BLIT_2D : CS_BLIT_2D_PREMUL]);
+
 		// Set UAV
 		const auto uav = EZ::GetUAV(m_filtered.get(), i);
 		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, 1, &uav);
@@ -198,13 +251,13 @@ void FilterEZ::generateMipsCompute(EZ::CommandList* pCommandList)
 	}
 }
 
-void FilterEZ::upsampleGraphics(EZ::CommandList* pCommandList, uint8_t frameIndex)
+void FilterEZ::upsampleGraphics(EZ::CommandList* pCommandList, uint8_t frameIndex, uint8_t outputLevel)
 {
 	// Set pipeline state
 	pCommandList->SetGraphicsShader(Shader::Stage::VS, m_shaders[VS_SCREEN_QUAD]);
 	pCommandList->SetGraphicsShader(Shader::Stage::PS, m_shaders[PS_UP_SAMPLE_BLEND]);
 	pCommandList->DSSetState(Graphics::DEPTH_STENCIL_NONE);
-	pCommandList->OMSetBlendState(Graphics::NON_PRE_MUL);
+	pCommandList->OMSetBlendState(GetUpSampleBlend());
 
 	// Set IA
 	pCommandList->IASetPrimitiveTopology(PrimitiveTopology::TRIANGLELIST);
@@ -217,10 +270,15 @@ void FilterEZ::upsampleGraphics(EZ::CommandList* pCommandList, uint8_t frameInde
 	const auto sampler = LINEAR_CLAMP;
 	pCommandList->SetSamplerStates(Shader::Stage::PS, 0, 1, &sampler);
 
+	// Set the SRV of the sigma map; the source stands in without one
+	const auto sigmaMapSrv = EZ::GetSRV(m_sigmaMap ? m_sigmaMap.get() : m_source.get());
+	pCommandList->SetResources(Shader::Stage::PS, DescriptorType::SRV, 2, 1, &sigmaMapSrv);
+
 	const uint32_t width = static_cast<uint32_t>(m_filtered->GetWidth());
 	const uint32_t height = m_filtered->GetHeight();
 	const uint8_t numPasses = m_filtered->GetNumMips() - 1;
-	for (uint8_t i = 0; i + 1 < numPasses; ++i)
+	const auto lastLevel = (max)(outputLevel, static_cast<uint8_t>(1));
+	for (uint8_t i = 0; i + lastLevel < numPasses; ++i)
 	{
 		const auto c = numPasses - i;
 		const auto level = c - 1;
@@ -248,8 +306,15 @@ void FilterEZ::upsampleGraphics(EZ::CommandList* pCommandList, uint8_t frameInde
 		pCommandList->Draw(3, 1, 0, 0);
 	}
 
-	// Final pass
+	// Final pass at the full resolution; a reduced-level result is only made straight
+	if (outputLevel > 0)
+	{
+		unpremultiply(pCommandList, outputLevel);
+		return;
+	}
+
 	pCommandList->SetGraphicsShader(Shader::Stage::PS, m_shaders[PS_UP_SAMPLE]);
+	pCommandList->OMSetBlendState(Graphics::DEFAULT_OPAQUE);
 
 	// Set render target
 	const auto rtv = EZ::GetRTV(m_filtered.get());
@@ -276,7 +341,7 @@ void FilterEZ::upsampleGraphics(EZ::CommandList* pCommandList, uint8_t frameInde
 	pCommandList->Draw(3, 1, 0, 0);
 }
 
-void FilterEZ::upsampleCompute(EZ::CommandList* pCommandList, uint8_t frameIndex)
+void FilterEZ::upsampleCompute(EZ::CommandList* pCommandList, uint8_t frameIndex, uint8_t outputLevel)
 {
 	// Up sampling
 	// Set pipeline state
@@ -290,10 +355,15 @@ void FilterEZ::upsampleCompute(EZ::CommandList* pCommandList, uint8_t frameIndex
 	const auto sampler = LINEAR_CLAMP;
 	pCommandList->SetSamplerStates(Shader::Stage::CS, 0, 1, &sampler);
 
+	// Set the SRV of the sigma map; the source stands in without one
+	const auto sigmaMapSrv = EZ::GetSRV(m_sigmaMap ? m_sigmaMap.get() : m_source.get());
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 2, 1, &sigmaMapSrv);
+
 	const uint32_t width = static_cast<uint32_t>(m_filtered->GetWidth());
 	const uint32_t height = m_filtered->GetHeight();
 	const uint8_t numPasses = m_filtered->GetNumMips() - 1;
-	for (uint8_t i = 0; i + 1 < numPasses; ++i)
+	const auto lastLevel = (max)(outputLevel, static_cast<uint8_t>(1));
+	for (uint8_t i = 0; i + lastLevel < numPasses; ++i)
 	{
 		const auto c = numPasses - i;
 		const auto level = c - 1;
@@ -315,7 +385,13 @@ void FilterEZ::upsampleCompute(EZ::CommandList* pCommandList, uint8_t frameIndex
 		pCommandList->Dispatch(XUSG_DIV_UP(threadsX, 8), XUSG_DIV_UP(threadsY, 8), 1);
 	}
 
-	// Final pass
+	// Final pass at the full resolution; a reduced-level result is only made straight
+	if (outputLevel > 0)
+	{
+		unpremultiply(pCommandList, outputLevel);
+		return;
+	}
+
 	pCommandList->SetComputeShader(m_shaders[CS_UP_SAMPLE]);
 
 	// Set UAV
@@ -336,3 +412,19 @@ void FilterEZ::upsampleCompute(EZ::CommandList* pCommandList, uint8_t frameIndex
 	// Dispatch grid
 	pCommandList->Dispatch(XUSG_DIV_UP(width, 8), XUSG_DIV_UP(height, 8), 1);
 }
+
+void FilterEZ::unpremultiply(EZ::CommandList* pCommandList, uint8_t outputLevel)
+{
+	// A pixel shader cannot read its own render target, so the result at a reduced level
+	// is made straight in-place by compute in either pipeline
+	pCommandList->SetComputeShader(m_shaders[CS_UNPREMULTIPLY]);
+
+	// Set UAV
+	const auto uav = m_typedUAV ? EZ::GetUAV(m_filtered.get(), outputLevel) : EZ::GetUAV(m_filtered.get(), outputLevel, Format::R32_UINT);
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, 1, &uav);
+
+	// Dispatch grid
+	uint32_t width, height;
+	GetImageSize(width, height, outputLevel);
+	pCommandList->Dispatch(XUSG_DIV_UP(width, 8), XUSG_DIV_UP(height, 8), 1);
+}
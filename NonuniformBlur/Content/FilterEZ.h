@@ -21,14 +21,21 @@ public:
 	FilterEZ();
 	virtual ~FilterEZ();
 
+	// The optional sigma map scales the sigma per pixel by its first channel, sampled bilinearly, in
+	// place of the radial falloff around the focus, as in FilterCPU::SetSigmaMap()
 	bool Init(XUSG::CommandList* pCommandList, std::vector<XUSG::Resource::uptr>& uploaders,
-		XUSG::Format rtFormat, const char* fileName, bool typedUAV);
+		XUSG::Format rtFormat, const char* fileName, bool typedUAV, const char* sigmaMapFileName = nullptr);
 
 	void UpdateFrame(DirectX::XMFLOAT2 focus, float sigma, uint8_t frameIndex);
-	void Process(XUSG::EZ::CommandList* pCommandList, uint8_t frameIndex, PipelineType pipelineType);
+
+	// Up-sampling stops at the output level, so that the mip of the result at that level
+	// holds the blurred image at a reduced resolution. The source is taken as straight alpha,
+	// and the levels are premultiplied; only the result at the output level is straight again
+	void Process(XUSG::EZ::CommandList* pCommandList, uint8_t frameIndex, PipelineType pipelineType, uint8_t outputLevel = 0);
 
 	XUSG::Resource* GetResult() const;
-	void GetImageSize(uint32_t& width, uint32_t& height) const;
+	void GetImageSize(uint32_t& width, uint32_t& height, uint8_t level = 0) const;
+	uint8_t GetNumLevels() const;
 
 	static const uint8_t FrameCount = 3;
 
@@ -38,12 +45,15 @@ protected:
 		VS_SCREEN_QUAD,
 
 		PS_BLIT_2D,
+		PS_BLIT_2D_PREMUL,
 		PS_UP_SAMPLE,
 		PS_UP_SAMPLE_BLEND,
 
 		CS_BLIT_2D,
+		CS_BLIT_2D_PREMUL,
 		CS_UP_SAMPLE,
 		CS_UP_SAMPLE_INPLACE,
+		CS_UNPREMULTIPLY,
 
 		NUM_SHADER
 	};
@@ -53,13 +63,15 @@ protected:
 	void generateMipsGraphics(XUSG::EZ::CommandList* pCommandList);
 	void generateMipsCompute(XUSG::EZ::CommandList* pCommandList);
 
-	void upsampleGraphics(XUSG::EZ::CommandList* pCommandList, uint8_t frameIndex);
-	void upsampleCompute(XUSG::EZ::CommandList* pCommandList, uint8_t frameIndex);
+	void upsampleGraphics(XUSG::EZ::CommandList* pCommandList, uint8_t frameIndex, uint8_t outputLevel);
+	void upsampleCompute(XUSG::EZ::CommandList* pCommandList, uint8_t frameIndex, uint8_t outputLevel);
+	void unpremultiply(XUSG::EZ::CommandList* pCommandList, uint8_t outputLevel);
 
 	XUSG::ShaderLib::uptr				m_shaderLib;
 	XUSG::Blob m_shaders[NUM_SHADER];
 
 	XUSG::Texture::uptr					m_source;
+	XUSG::Texture::uptr					m_sigmaMap;
 	XUSG::RenderTarget::uptr			m_filtered;
 
 	XUSG::ConstantBuffer::uptr			m_cbPerFrame;
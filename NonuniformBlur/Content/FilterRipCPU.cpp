@@ -0,0 +1,249 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "FilterRipCPU.h"
+#include <xmmintrin.h>
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+	// Size of an axis down-sampled n times
+	inline uint32_t GetLevelSize(uint32_t size, uint8_t n)
+	{
+		return n < 32 ? (max)(size >> n, 1u) : 1u;
+	}
+
+	inline uint8_t GetNumDownsamplings(uint32_t size)
+	{
+		uint8_t n = 0;
+		while (GetLevelSize(size, n) > 1) ++n;
+
+		return n;
+	}
+
+	// Rip level of step s along the chain of texel aspect 2^k
+	inline void GetChainLevel(int8_t k, uint8_t s, uint8_t& i, uint8_t& j)
+	{
+		i = k >= 0 ? s : static_cast<uint8_t>((max)(s + k, 0));
+		j = k >= 0 ? static_cast<uint8_t>((max)(s - k, 0)) : s;
+	}
+}
+
+FilterRipCPU::FilterRipCPU() :
+	m_result(),
+	m_chainResult(),
+	m_aspect(1.0f),
+	m_numLevelsX(0),
+	m_numLevelsY(0)
+{
+}
+
+FilterRipCPU::~FilterRipCPU()
+{
+}
+
+bool FilterRipCPU::Init(const ImageFile& source)
+{
+	const auto& desc = source.GetDesc();
+	XUSG_N_RETURN(desc.Width > 0 && desc.Height > 0, false);
+
+	// Level 0 is the only mip, and the source of the rip-map
+	m_mips.resize(1);
+	auto& mip0 = m_mips[0];
+	mip0.Width = desc.Width;
+	mip0.Height = desc.Height;
+	mip0.Pixels.resize(static_cast<size_t>(mip0.Width) * mip0.Height);
+	source.ReadRows(0, mip0.Height, &mip0.Pixels[0].x, sizeof(XMFLOAT4) * mip0.Width, 4);
+	Premultiply(mip0.Pixels.data(), mip0.Pixels.size());
+
+	m_ripLevels.clear();
+	m_numLevelsX = GetNumDownsamplings(desc.Width);
+	m_numLevelsY = GetNumDownsamplings(desc.Height);
+
+	return true;
+}
+
+void FilterRipCPU::UpdateFrame(XMFLOAT2 focus, float sigma, float aspect)
+{
+	FilterCPU::UpdateFrame(focus, sigma);
+	m_aspect = aspect > 0.0f ? aspect : 1.0f;
+}
+
+void FilterRipCPU::Process()
+{
+	// Chains beyond a texel along an axis would not change
+	const auto aspectLog2 = (min)((max)(log2f(m_aspect), -static_cast<float>(m_numLevelsY)), static_cast<float>(m_numLevelsX));
+	const auto k = static_cast<int8_t>(floorf(aspectLog2));
+	processChain(k, m_result);
+
+	// The chains have the same sigma along y, and the variance of their blend along x is that of the aspect
+	const auto aspect = exp2f(aspectLog2);
+	const auto t = (aspect * aspect / ldexpf(1.0f, 2 * k) - 1.0f) / 3.0f;
+	if (t <= 0.0f) return;
+
+	processChain(k + 1, m_chainResult);
+	const auto ft = _mm_set1_ps(t);
+	for (size_t i = 0; i < m_result.Pixels.size(); ++i)
+	{
+		const auto a = _mm_loadu_ps(&m_result.Pixels[i].x);
+		const auto b = _mm_loadu_ps(&m_chainResult.Pixels[i].x);
+		_mm_storeu_ps(&m_result.Pixels[i].x, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), ft)));
+	}
+}
+
+const FilterRipCPU::Image& FilterRipCPU::GetResult() const
+{
+	return m_result;
+}
+
+void FilterRipCPU::WriteResult(ImageFile& imageFile) const
+{
+	vector<XMFLOAT4> row(m_result.Width);
+	for (auto y = 0u; y < m_result.Height; ++y)
+	{
+		Unpremultiply(row.data(), &m_result.Pixels[static_cast<size_t>(m_result.Width) * y], m_result.Width);
+		imageFile.WriteRows(y, 1, &row[0].x, sizeof(XMFLOAT4) * m_result.Width, 4);
+	}
+}
+
+size_t FilterRipCPU::GetRipMapSize() const
+{
+	size_t numPixels = 0;
+	for (const auto& ripLevel : m_ripLevels) numPixels += ripLevel.second.Pixels.size();
+
+	return sizeof(XMFLOAT4) * numPixels;
+}
+
+size_t FilterRipCPU::GetWorkingSetSize(uint32_t width, uint32_t height)
+{
+	// The rip levels of a chain, as well as its up-sampled levels, add up to at most twice the source,
+	// and the results of the chains to twice more
+	return sizeof(XMFLOAT4) * 9 * width * height;
+}
+
+const FilterRipCPU::Image& FilterRipCPU::getRipLevel(uint8_t i, uint8_t j)
+{
+	if (!i && !j) return m_mips[0];
+
+	const auto key = static_cast<uint16_t>(i << 8 | j);
+	const auto found = m_ripLevels.find(key);
+	if (found != m_ripLevels.cend()) return found->second;
+
+	// Both axes are halved at once where they can be, so that each level has one parent whichever
+	// chain reads it. Along a single axis, the 5 taps of the mips reduce to their marginal
+	const auto isHalvedX = i > 0;
+	const auto isHalvedY = j > 0;
+	const auto& src = getRipLevel(isHalvedX ? i - 1 : 0, isHalvedY ? j - 1 : 0);
+	auto& dst = m_ripLevels[key];
+	dst.Width = GetLevelSize(m_mips[0].Width, i);
+	dst.Height = GetLevelSize(m_mips[0].Height, j);
+	dst.Pixels.resize(static_cast<size_t>(dst.Width) * dst.Height);
+
+	vector<Tap> tapsX[3], tapsY[3];
+	for (uint8_t n = 0; n < 3; ++n)
+	{
+		computeTaps(tapsX[n], dst.Width, src.Width, isHalvedX ? n - 1.0f : 0.0f);
+		computeTaps(tapsY[n], dst.Height, src.Height, isHalvedY ? n - 1.0f : 0.0f);
+	}
+
+	const auto pSrc = src.Pixels.data();
+	for (auto y = 0u; y < dst.Height; ++y)
+	{
+		const XMFLOAT4* pRows[3][2];
+		const Tap* pTapsY[3];
+		for (uint8_t n = 0; n < 3; ++n)
+		{
+			pTapsY[n] = &tapsY[n][y];
+			pRows[n][0] = &pSrc[static_cast<size_t>(src.Width) * pTapsY[n]->I0];
+			pRows[n][1] = &pSrc[static_cast<size_t>(src.Width) * pTapsY[n]->I1];
+		}
+
+		downsampleRow(&dst.Pixels[static_cast<size_t>(dst.Width) * y], pRows, pTapsY, tapsX, 0, dst.Width);
+	}
+
+	return dst;
+}
+
+void FilterRipCPU::processChain(int8_t k, Image& result)
+{
+	// The ellipse is of the texel aspect, whose area is that of the circle of sigma * sqrt(2^k)
+	const auto& source = m_mips[0];
+	const auto isUniform = reinterpret_cast<const uint32_t&>(m_focus.x) == UINT32_MAX;
+	const auto sigma = m_sigma * sqrtf(ldexpf(1.0f, k));
+	const auto sigmas = getChannelSigmas(sigma);
+
+	// Levels along the chain, up to the first whose weights are all saturated
+	m_chain.clear();
+	for (uint8_t s = 0;; ++s)
+	{
+		ChainLevel level;
+		GetChainLevel(k, s, level.I, level.J);
+		level.Width = GetLevelSize(source.Width, level.I);
+		level.Height = GetLevelSize(source.Height, level.J);
+
+		auto maxFalloff = 1.0f;
+		if (!isUniform && hasFalloffMap())
+		{
+			level.Falloffs.resize(static_cast<size_t>(level.Width) * level.Height);
+			for (auto y = 0u; y < level.Height; ++y)
+				sampleFalloffs(&level.Falloffs[static_cast<size_t>(level.Width) * y], y, level.Width, level.Height, 0, level.Width);
+
+			maxFalloff = 0.0f;
+			for (const auto& falloff : level.Falloffs) maxFalloff = (max)(fabsf(falloff), maxFalloff);
+		}
+		else if (!isUniform)
+		{
+			computeDistances(level.Falloffs, level.Width, m_focus.x);
+			maxFalloff = (max)(level.Falloffs.front(), level.Falloffs.back()) +
+				(max)(computeDistance(0, level.Height, m_focus.y), computeDistance(level.Height - 1, level.Height, m_focus.y));
+		}
+
+		const auto isCoarsest = level.I >= m_numLevelsX && level.J >= m_numLevelsY;
+		const auto isSaturatedLevel = isSaturated(0.5f * (level.I + level.J), getMaxChannelSigma(sigma), maxFalloff);
+		m_chain.emplace_back(move(level));
+		if (isCoarsest || isSaturatedLevel) break;
+	}
+
+	// V-cycle from the coarsest level read
+	const auto depth = m_chain.size() - 1;
+	if (depth == 0)
+	{
+		result = source;
+
+		return;
+	}
+
+	m_blended.resize(depth);
+	auto pCoarser = &getRipLevel(m_chain[depth].I, m_chain[depth].J);
+	for (auto s = depth; s-- > 0;)
+	{
+		const auto& level = m_chain[s];
+		const auto& src = getRipLevel(level.I, level.J);
+		auto& dst = s > 0 ? m_blended[s] : result;
+		dst.Width = level.Width;
+		dst.Height = level.Height;
+		dst.Pixels.resize(src.Pixels.size());
+
+		vector<Tap> tapsX, tapsY;
+		computeTaps(tapsX, dst.Width, pCoarser->Width);
+		computeTaps(tapsY, dst.Height, pCoarser->Height);
+
+		const auto pCoarserPixels = pCoarser->Pixels.data();
+		for (auto y = 0u; y < dst.Height; ++y)
+		{
+			const auto& ty = tapsY[y];
+			const auto rowOffset = static_cast<size_t>(dst.Width) * y;
+			const auto pFalloffX = isUniform ? nullptr : hasFalloffMap() ? &level.Falloffs[rowOffset] : level.Falloffs.data();
+			const auto falloffY = isUniform || hasFalloffMap() ? 0.0f : computeDistance(y, dst.Height, m_focus.y);
+			upsampleRow(0.5f * (level.I + level.J), &dst.Pixels[rowOffset], &src.Pixels[rowOffset],
+				&pCoarserPixels[static_cast<size_t>(pCoarser->Width) * ty.I0],
+				&pCoarserPixels[static_cast<size_t>(pCoarser->Width) * ty.I1], ty, tapsX,
+				pFalloffX, falloffY, sigmas, 0, dst.Width);
+		}
+
+		pCoarser = &dst;
+	}
+}
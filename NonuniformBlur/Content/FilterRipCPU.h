@@ -0,0 +1,69 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "FilterCPU.h"
+
+// Anisotropic variant of the CPU filter for directional looks, e.g. motion streaks and tilt-shift,
+// whose sigma along x is the sigma along y times an aspect. The levels are taken from a rip-map,
+// down-sampled along x and y independently, along the chain of texel aspect 2^k nearest to it: the
+// levels down-sampled along one axis up to aspect 2^k, then along both. The blend weight takes the
+// texel area and the area of the ellipse in place of the mip level and sigma, and an aspect between
+// powers of two blends the results of the two nearest chains, so that the variance along x is that
+// of the aspect. Rip levels are only built as far as the weights of the largest sigma read them,
+// and they are kept for the following frames.
+class FilterRipCPU :
+	protected FilterCPU
+{
+public:
+	using FilterCPU::Image;
+	using FilterCPU::FocusPoint;
+
+	FilterRipCPU();
+	virtual ~FilterRipCPU();
+
+	// Only the source is loaded here; the rip levels are built on demand
+	bool Init(const ImageFile& source);
+
+	void UpdateFrame(DirectX::XMFLOAT2 focus, float sigma, float aspect = 1.0f);
+	using FilterCPU::SetSigmaMap;
+	using FilterCPU::SetFocusPoints;
+	using FilterCPU::SetChannelScales;
+
+	// The result is at the full resolution
+	void Process();
+
+	const Image& GetResult() const;
+	void WriteResult(ImageFile& imageFile) const;
+
+	// Bytes of the rip levels built so far
+	size_t GetRipMapSize() const;
+
+	// Upper bound of the bytes of the source, the rip levels of two chains, and the up-sampled levels
+	static size_t GetWorkingSetSize(uint32_t width, uint32_t height);
+
+protected:
+	// Level along a chain, with its falloffs: sampled per texel, or the squared distances along x
+	struct ChainLevel
+	{
+		uint8_t				I;
+		uint8_t				J;
+		uint32_t			Width;
+		uint32_t			Height;
+		std::vector<float>	Falloffs;
+	};
+
+	const Image& getRipLevel(uint8_t i, uint8_t j);
+	void processChain(int8_t k, Image& result);
+
+	std::map<uint16_t, Image>	m_ripLevels;	// By I << 8 | J, but for the source
+	std::vector<ChainLevel>		m_chain;
+	Image						m_result;
+	Image						m_chainResult;	// Of the second chain
+
+	float						m_aspect;
+	uint8_t						m_numLevelsX;	// Down-samplings along each axis down to a texel
+	uint8_t						m_numLevelsY;
+};
@@ -0,0 +1,293 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "FilterStreamCPU.h"
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+	// Rows held per level for a bilinear footprint, and the look-ahead added by each coarser
+	// streamed level, since blending a row reads the coarser levels a few of their rows ahead
+	const uint32_t g_windowRows = 6;
+	const uint32_t g_leadRows = 1;
+}
+
+FilterStreamCPU::FilterStreamCPU() :
+	m_pSource(nullptr),
+	m_numStreamed(0)
+{
+}
+
+FilterStreamCPU::~FilterStreamCPU()
+{
+}
+
+bool FilterStreamCPU::Init(const ImageFile& source)
+{
+	const auto& desc = source.GetDesc();
+	XUSG_N_RETURN(desc.Width > 0 && desc.Height > 0, false);
+	m_pSource = &source;
+
+	uint8_t numMips = 1;
+	while ((max)(desc.Width, desc.Height) >> numMips) ++numMips;
+	m_mips.resize(numMips);
+	m_blended.resize(numMips);
+	m_taps.resize(numMips);
+	for (uint8_t i = 0; i < numMips; ++i)
+	{
+		auto& mip = m_mips[i];
+		mip.Width = (max)(desc.Width >> i, 1u);
+		mip.Height = (max)(desc.Height >> i, 1u);
+		mip.Pixels.clear();
+		m_blended[i].Width = mip.Width;
+		m_blended[i].Height = mip.Height;
+		m_blended[i].Pixels.clear();
+
+		auto& taps = m_taps[i];
+		for (uint8_t j = 0; j < 3 && i > 0; ++j)
+		{
+			computeTaps(taps.DownX[j], mip.Width, m_mips[i - 1].Width, j - 1.0f);
+			computeTaps(taps.DownY[j], mip.Height, m_mips[i - 1].Height, j - 1.0f);
+		}
+	}
+
+	initLevels();
+
+	// Stream as many fine levels as minimize the working set
+	m_numStreamed = 0;
+	for (uint8_t i = 1; i < numMips; ++i)
+		if (estimateWorkingSetSize(desc.Width, desc.Height, i) <
+			estimateWorkingSetSize(desc.Width, desc.Height, m_numStreamed))
+			m_numStreamed = i;
+
+	m_mipRows.resize(m_numStreamed);
+	m_blendedRows.resize(m_numStreamed);
+	resetWindows(false);
+
+	// The first whole level is generated from the rolling windows, and the coarser ones as usual
+	for (auto i = m_numStreamed; i < numMips; ++i)
+	{
+		auto& mip = m_mips[i];
+		mip.Pixels.resize(static_cast<size_t>(mip.Width) * mip.Height);
+		if (i > m_numStreamed) generateMips(i, 0, mip.Height);
+		else if (i > 0)
+			for (auto y = 0u; y < mip.Height; ++y)
+				generateMipRow(i, y, &mip.Pixels[static_cast<size_t>(mip.Width) * y]);
+		else
+		{
+			source.ReadRows(0, mip.Height, &mip.Pixels[0].x, sizeof(XMFLOAT4) * mip.Width, 4);
+			Premultiply(mip.Pixels.data(), mip.Pixels.size());
+		}
+	}
+
+	for (auto i = m_numStreamed; i + 1 < numMips; ++i)
+		m_blended[i].Pixels.resize(m_mips[i].Pixels.size());
+
+	for (auto& window : m_mipRows) window = RowWindow();
+	updateFalloffs();
+
+	return true;
+}
+
+bool FilterStreamCPU::Process(ImageFile& output, uint8_t outputLevel)
+{
+	const auto numMips = static_cast<uint8_t>(m_mips.size());
+	XUSG_N_RETURN(m_pSource && outputLevel < numMips, false);
+
+	const auto& desc = output.GetDesc();
+	const auto& mip = m_mips[outputLevel];
+	XUSG_N_RETURN(desc.Width == mip.Width && desc.Height == mip.Height, false);
+
+	// Whole levels, down to the finest one or the output level
+	for (auto i = numMips - 1; i > (max)(m_numStreamed, outputLevel); --i)
+	{
+		const auto level = static_cast<uint8_t>(i - 1);
+		upsample(level, 0, m_blended[level].Height);
+	}
+
+	if (outputLevel >= m_numStreamed)
+	{
+		WriteResult(output, outputLevel);
+
+		return true;
+	}
+
+	// Streamed levels, row by row; the finer mips are only streamed to generate the output level
+	resetWindows(true, outputLevel);
+	vector<XMFLOAT4> row(mip.Width);
+	for (auto y = 0u; y < mip.Height; ++y)
+	{
+		blendRow(outputLevel, y, row.data());
+		Unpremultiply(row.data(), row.data(), mip.Width);
+		output.WriteRows(y, 1, &row[0].x, sizeof(XMFLOAT4) * mip.Width, 4);
+	}
+
+	for (auto& window : m_mipRows) window = RowWindow();
+	for (auto& window : m_blendedRows) window = RowWindow();
+
+	return true;
+}
+
+size_t FilterStreamCPU::GetWorkingSetSize(uint32_t width, uint32_t height)
+{
+	uint8_t numMips = 1;
+	while ((max)(width, height) >> numMips) ++numMips;
+
+	auto size = estimateWorkingSetSize(width, height, 0);
+	for (uint8_t i = 1; i < numMips; ++i)
+		size = (min)(estimateWorkingSetSize(width, height, i), size);
+
+	return size;
+}
+
+void FilterStreamCPU::resetWindows(bool isBlending, uint8_t outputLevel)
+{
+	const auto reset = [](RowWindow& window, uint32_t neededByMip, uint32_t neededByBlend)
+	{
+		for (auto& row : window.Rows) window.FreeRows.emplace_back(move(row));
+		window.Rows.clear();
+		window.First = 0;
+		window.Needed[MIP] = neededByMip;
+		window.Needed[BLEND] = neededByBlend;
+	};
+
+	// Only the first pass generates the first whole level from the streamed ones
+	for (uint8_t i = 0; i < m_numStreamed; ++i)
+	{
+		reset(m_mipRows[i], isBlending && i + 1u == m_numStreamed ? UINT32_MAX : 0,
+			isBlending && i >= outputLevel ? 0 : UINT32_MAX);
+		reset(m_blendedRows[i], UINT32_MAX, 0);
+	}
+}
+
+const XMFLOAT4* FilterStreamCPU::getMipRow(uint8_t level, uint32_t y)
+{
+	const auto& mip = m_mips[level];
+	if (level >= m_numStreamed) return &mip.Pixels[static_cast<size_t>(mip.Width) * y];
+
+	auto& window = m_mipRows[level];
+	assert(y >= window.First);
+	for (auto i = window.First + static_cast<uint32_t>(window.Rows.size()); i <= y; ++i)
+	{
+		const auto pDst = pushRow(window, mip.Width);
+		if (level > 0) generateMipRow(level, i, pDst);
+		else
+		{
+			m_pSource->ReadRows(i, 1, &pDst->x, sizeof(XMFLOAT4) * mip.Width, 4);
+			Premultiply(pDst, mip.Width);
+		}
+	}
+
+	return window.Rows[y - window.First].data();
+}
+
+const XMFLOAT4* FilterStreamCPU::getBlendedRow(uint8_t level, uint32_t y)
+{
+	if (level >= m_numStreamed)
+	{
+		const auto& blended = getBlended(level);
+
+		return &blended.Pixels[static_cast<size_t>(blended.Width) * y];
+	}
+
+	auto& window = m_blendedRows[level];
+	assert(y >= window.First);
+	for (auto i = window.First + static_cast<uint32_t>(window.Rows.size()); i <= y; ++i)
+		blendRow(level, i, pushRow(window, m_mips[level].Width));
+
+	return window.Rows[y - window.First].data();
+}
+
+void FilterStreamCPU::generateMipRow(uint8_t level, uint32_t y, XMFLOAT4* pDst)
+{
+	const auto& taps = m_taps[level];
+	const auto& mip = m_mips[level];
+
+	// The last row first, so that the finer window already holds the others
+	const XMFLOAT4* pRows[3][2];
+	const Tap* pTapsY[3];
+	for (auto i = 2; i >= 0; --i)
+	{
+		pTapsY[i] = &taps.DownY[i][y];
+		pRows[i][1] = getMipRow(level - 1, pTapsY[i]->I1);
+		pRows[i][0] = getMipRow(level - 1, pTapsY[i]->I0);
+	}
+
+	downsampleRow(pDst, pRows, pTapsY, taps.DownX, 0, mip.Width);
+
+	if (level - 1 < m_numStreamed)
+		release(m_mipRows[level - 1], MIP, y + 1 < mip.Height ? taps.DownY[0][y + 1].I0 : UINT32_MAX);
+}
+
+void FilterStreamCPU::blendRow(uint8_t level, uint32_t y, XMFLOAT4* pDst)
+{
+	const auto& mip = m_mips[level];
+	const auto& tapsY = m_tapsY[level];
+
+	const auto& ty = tapsY[y];
+	const auto pCoarser1 = getBlendedRow(level + 1, ty.I1);
+	const auto pCoarser0 = getBlendedRow(level + 1, ty.I0);
+	const auto pSrc = getMipRow(level, y);
+
+	const auto isUniform = reinterpret_cast<const uint32_t&>(m_focus.x) == UINT32_MAX;
+	const float* pFalloffX = nullptr;
+	auto falloffY = 0.0f;
+	if (!isUniform && hasFalloffMap())
+	{
+		m_falloffRow.resize(mip.Width);
+		sampleFalloffs(m_falloffRow.data(), y, mip.Width, mip.Height, 0, mip.Width);
+		pFalloffX = m_falloffRow.data();
+	}
+	else if (!isUniform)
+	{
+		pFalloffX = m_dist2X[level].data();
+		falloffY = computeDistance(y, mip.Height, m_focus.y);
+	}
+	upsampleRow(level, pDst, pSrc, pCoarser0, pCoarser1, ty, m_tapsX[level], pFalloffX, falloffY, getChannelSigmas(m_sigma), 0, mip.Width);
+
+	release(m_mipRows[level], BLEND, y + 1);
+	if (level + 1 < m_numStreamed)
+		release(m_blendedRows[level + 1], BLEND, y + 1 < mip.Height ? tapsY[y + 1].I0 : UINT32_MAX);
+}
+
+XMFLOAT4* FilterStreamCPU::pushRow(RowWindow& window, uint32_t width)
+{
+	// Recycle the released rows
+	if (window.FreeRows.empty()) window.Rows.emplace_back(width);
+	else
+	{
+		window.Rows.emplace_back(move(window.FreeRows.back()));
+		window.FreeRows.pop_back();
+	}
+
+	return window.Rows.back().data();
+}
+
+void FilterStreamCPU::release(RowWindow& window, Consumer consumer, uint32_t first)
+{
+	window.Needed[consumer] = first;
+	const auto needed = (min)(window.Needed[MIP], window.Needed[BLEND]);
+	for (; !window.Rows.empty() && window.First < needed; ++window.First)
+	{
+		window.FreeRows.emplace_back(move(window.Rows.front()));
+		window.Rows.pop_front();
+	}
+}
+
+size_t FilterStreamCPU::estimateWorkingSetSize(uint32_t width, uint32_t height, uint8_t numStreamed)
+{
+	// Windows of the mips and the up-sampled levels, plus both for the whole levels
+	size_t numPixels = 0;
+	for (auto i = 0u; (width | height) >> i; ++i)
+	{
+		const auto levelWidth = static_cast<size_t>((max)(width >> i, 1u));
+		const auto levelHeight = (max)(height >> i, 1u);
+		const auto numRows = i < numStreamed ? (min)(g_windowRows + (g_leadRows << (numStreamed - i)), levelHeight) : levelHeight;
+		numPixels += 2 * levelWidth * numRows;
+	}
+
+	return sizeof(XMFLOAT4) * numPixels;
+}
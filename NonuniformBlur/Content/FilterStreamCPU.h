@@ -0,0 +1,78 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "FilterCPU.h"
+
+// Streaming variant of the CPU filter for images that do not fit in memory. The source is
+// read in rows twice: the first pass builds the coarse levels, which are kept whole, and
+// the second pass regenerates the fine levels in rolling windows of rows while blending,
+// so that the result rows are written in order.
+class FilterStreamCPU :
+	protected FilterCPU
+{
+public:
+	FilterStreamCPU();
+	virtual ~FilterStreamCPU();
+
+	// First pass; the source must stay open until processed
+	bool Init(const ImageFile& source);
+
+	using FilterCPU::UpdateFrame;
+	using FilterCPU::SetSigmaMap;
+	using FilterCPU::SetFocusPoints;
+	using FilterCPU::SetChannelScales;
+	using FilterCPU::GetImageSize;
+	using FilterCPU::GetNumLevels;
+
+	// Second pass, writing the result rows at the output level to the output in order
+	bool Process(ImageFile& output, uint8_t outputLevel = 0);
+
+	// Estimated peak bytes of the rolling windows and the whole coarse levels
+	static size_t GetWorkingSetSize(uint32_t width, uint32_t height);
+
+protected:
+	enum Consumer : uint8_t
+	{
+		MIP,	// Generating the next coarser mip
+		BLEND,	// Blending the next finer level
+
+		NUM_CONSUMER
+	};
+
+	// Rows [First, First + Rows.size()) of a level
+	struct RowWindow
+	{
+		uint32_t First;
+		uint32_t Needed[NUM_CONSUMER];	// First row still read by each consumer
+		std::deque<std::vector<DirectX::XMFLOAT4>> Rows;
+		std::vector<std::vector<DirectX::XMFLOAT4>> FreeRows;
+	};
+
+	// From the finer level
+	struct LevelTaps
+	{
+		std::vector<Tap> DownX[3];
+		std::vector<Tap> DownY[3];
+	};
+
+	void resetWindows(bool isBlending, uint8_t outputLevel = 0);
+	const DirectX::XMFLOAT4* getMipRow(uint8_t level, uint32_t y);
+	const DirectX::XMFLOAT4* getBlendedRow(uint8_t level, uint32_t y);
+	void generateMipRow(uint8_t level, uint32_t y, DirectX::XMFLOAT4* pDst);
+	void blendRow(uint8_t level, uint32_t y, DirectX::XMFLOAT4* pDst);
+
+	static DirectX::XMFLOAT4* pushRow(RowWindow& window, uint32_t width);
+	static void release(RowWindow& window, Consumer consumer, uint32_t first);
+	static size_t estimateWorkingSetSize(uint32_t width, uint32_t height, uint8_t numStreamed);
+
+	const ImageFile*	m_pSource;
+	uint8_t				m_numStreamed;	// Fine levels held in rolling windows; the coarser levels are whole
+
+	std::vector<RowWindow>	m_mipRows;
+	std::vector<RowWindow>	m_blendedRows;
+	std::vector<LevelTaps>	m_taps;
+	std::vector<float>		m_falloffRow;	// Falloffs of the streamed row being blended
+};
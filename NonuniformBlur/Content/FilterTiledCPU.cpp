@@ -0,0 +1,419 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "FilterTiledCPU.h"
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+	// Prefetches beyond this are dropped, the oldest first
+	const size_t g_maxPrefetches = 32;
+
+	uint64_t GetTileKey(uint8_t level, uint32_t i, uint32_t j)
+	{
+		return static_cast<uint64_t>(level) << 48 | static_cast<uint64_t>(j) << 24 | i;
+	}
+
+	// Taps of a tile, relative to the first texel of its footprint
+	void SliceTaps(vector<FilterCPU::Tap>& taps, const vector<FilterCPU::Tap>& levelTaps, uint32_t start, uint32_t size, uint32_t origin)
+	{
+		taps.assign(levelTaps.cbegin() + start, levelTaps.cbegin() + start + size);
+		for (auto& tap : taps)
+		{
+			tap.I0 -= origin;
+			tap.I1 -= origin;
+		}
+	}
+}
+
+FilterTiledCPU::FilterTiledCPU() :
+	m_tileSize(128),
+	m_isQuitting(false)
+{
+}
+
+FilterTiledCPU::~FilterTiledCPU()
+{
+	stopPrefetch();
+
+	// The store is scratch
+	m_store.Close();
+	if (!m_storeFileName.empty()) remove(m_storeFileName.c_str());
+}
+
+bool FilterTiledCPU::Init(const ImageFile& source, const char* storeFileName, uint32_t tileSize, uint32_t numCachedTiles)
+{
+	const auto& desc = source.GetDesc();
+	XUSG_N_RETURN(desc.Width > 0 && desc.Height > 0 && tileSize > 0, false);
+	stopPrefetch();
+	m_tileSize = tileSize;
+
+	uint8_t numMips = 1;
+	while ((max)(desc.Width, desc.Height) >> numMips) ++numMips;
+	m_mips.resize(numMips);
+	m_levels.resize(numMips);
+
+	// Tiles are stored in full-size slots, level by level
+	const auto slotSize = sizeof(XMFLOAT4) * tileSize * tileSize;
+	uint64_t storeSize = 0;
+	for (uint8_t i = 0; i < numMips; ++i)
+	{
+		auto& mip = m_mips[i];
+		mip.Width = (max)(desc.Width >> i, 1u);
+		mip.Height = (max)(desc.Height >> i, 1u);
+		mip.Pixels.clear();
+
+		auto& level = m_levels[i];
+		level.NumTilesX = (mip.Width + tileSize - 1) / tileSize;
+		level.NumTilesY = (mip.Height + tileSize - 1) / tileSize;
+		level.Offset = storeSize;
+		storeSize += slotSize * level.NumTilesX * level.NumTilesY;
+
+		for (uint8_t j = 0; j < 3 && i > 0; ++j)
+		{
+			computeTaps(level.DownX[j], mip.Width, m_mips[i - 1].Width, j - 1.0f);
+			computeTaps(level.DownY[j], mip.Height, m_mips[i - 1].Height, j - 1.0f);
+		}
+	}
+
+	for (uint8_t i = 0; i + 1 < numMips; ++i)
+	{
+		computeTaps(m_levels[i].UpX, m_mips[i].Width, m_mips[i + 1].Width);
+		computeTaps(m_levels[i].UpY, m_mips[i].Height, m_mips[i + 1].Height);
+	}
+
+	m_store.Close();
+	if (!m_storeFileName.empty()) remove(m_storeFileName.c_str());
+	m_storeFileName = storeFileName;
+	XUSG_N_RETURN(m_store.Create(storeFileName, static_cast<size_t>(storeSize)), false);
+
+	for (auto& caches : m_caches)
+	{
+		caches.resize(numMips);
+		for (auto& cache : caches)
+		{
+			cache.Clear();
+			cache.SetCapacity(numCachedTiles);
+		}
+	}
+
+	// Scatter the source rows into the tiles of level 0
+	const auto& mip0 = m_mips[0];
+	vector<XMFLOAT4> row(mip0.Width);
+	for (auto y = 0u; y < mip0.Height; ++y)
+	{
+		source.ReadRows(y, 1, &row[0].x, sizeof(XMFLOAT4) * mip0.Width, 4);
+		Premultiply(row.data(), row.size());
+		for (auto i = 0u; i < m_levels[0].NumTilesX; ++i)
+		{
+			uint32_t width, height;
+			getTileSize(0, i, y / tileSize, width, height);
+			const auto pTile = reinterpret_cast<XMFLOAT4*>(getTileData(0, i, y / tileSize));
+			memcpy(&pTile[width * (y % tileSize)], &row[tileSize * i], sizeof(XMFLOAT4) * width);
+		}
+	}
+
+	// Coarser levels, from the cached tiles of the finer ones
+	for (uint8_t level = 1; level < numMips; ++level)
+		for (auto j = 0u; j < m_levels[level].NumTilesY; ++j)
+			for (auto i = 0u; i < m_levels[level].NumTilesX; ++i)
+				storeTile(level, i, j, *generateMipTile(level, i, j));
+
+	m_isQuitting = false;
+	m_prefetchThread = thread(&FilterTiledCPU::prefetchMain, this);
+
+	return true;
+}
+
+void FilterTiledCPU::UpdateFrame(XMFLOAT2 focus, float sigma)
+{
+	FilterCPU::UpdateFrame(focus, sigma);
+
+	lock_guard<mutex> lock(m_mutex);
+	for (auto& cache : m_caches[BLENDED]) cache.Clear();
+}
+
+bool FilterTiledCPU::SetSigmaMap(const ImageFile& sigmaMap)
+{
+	XUSG_N_RETURN(loadSigmaMap(sigmaMap), false);
+	UpdateFrame(m_focus, m_sigma);
+
+	return true;
+}
+
+bool FilterTiledCPU::SetSigmaMap(const float* pSigmaMap, uint32_t width, uint32_t height)
+{
+	XUSG_N_RETURN(loadSigmaMap(pSigmaMap, width, height), false);
+	UpdateFrame(m_focus, m_sigma);
+
+	return true;
+}
+
+bool FilterTiledCPU::SetFocusPoints(const FocusPoint* pPoints, uint32_t numPoints, float smoothness)
+{
+	XUSG_N_RETURN(loadFocusPoints(pPoints, numPoints, smoothness), false);
+	UpdateFrame(m_focus, m_sigma);
+
+	return true;
+}
+
+FilterTiledCPU::TilePtr FilterTiledCPU::GetTile(uint8_t level, uint32_t i, uint32_t j)
+{
+	assert(level < m_levels.size() && i < m_levels[level].NumTilesX && j < m_levels[level].NumTilesY);
+	prefetch(level, i, j);
+
+	return getBlendedTile(level, i, j);
+}
+
+void FilterTiledCPU::GetTileCount(uint8_t level, uint32_t& numTilesX, uint32_t& numTilesY) const
+{
+	numTilesX = m_levels[level].NumTilesX;
+	numTilesY = m_levels[level].NumTilesY;
+}
+
+FilterTiledCPU::TilePtr FilterTiledCPU::getMipTile(uint8_t level, uint32_t i, uint32_t j)
+{
+	const auto key = GetTileKey(level, i, j);
+	TilePtr tile;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if (m_caches[MIP][level].Find(key, tile)) return tile;
+	}
+
+	tile = loadTile(level, i, j);
+
+	lock_guard<mutex> lock(m_mutex);
+	m_caches[MIP][level].Insert(key, tile);
+
+	return tile;
+}
+
+FilterTiledCPU::TilePtr FilterTiledCPU::getBlendedTile(uint8_t level, uint32_t i, uint32_t j)
+{
+	// The coarsest level is the mip itself
+	if (level + 1u >= m_levels.size()) return getMipTile(level, i, j);
+
+	const auto key = GetTileKey(level, i, j);
+	TilePtr tile;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if (m_caches[BLENDED][level].Find(key, tile)) return tile;
+	}
+
+	tile = blendTile(level, i, j);
+
+	lock_guard<mutex> lock(m_mutex);
+	m_caches[BLENDED][level].Insert(key, tile);
+
+	return tile;
+}
+
+FilterTiledCPU::TilePtr FilterTiledCPU::generateMipTile(uint8_t level, uint32_t i, uint32_t j)
+{
+	const auto& levelTaps = m_levels[level];
+	const auto x0 = m_tileSize * i;
+	const auto y0 = m_tileSize * j;
+	shared_ptr<Image> tile(new Image());
+	getTileSize(level, i, j, tile->Width, tile->Height);
+	tile->Pixels.resize(static_cast<size_t>(tile->Width) * tile->Height);
+
+	// Footprint of the 5 taps in the finer level
+	const auto srcX0 = levelTaps.DownX[0][x0].I0;
+	const auto srcY0 = levelTaps.DownY[0][y0].I0;
+	const auto srcX1 = levelTaps.DownX[2][x0 + tile->Width - 1].I1;
+	const auto srcY1 = levelTaps.DownY[2][y0 + tile->Height - 1].I1;
+	vector<XMFLOAT4> region;
+	gatherRegion(region, MIP, level - 1, srcX0, srcY0, srcX1, srcY1);
+
+	vector<Tap> tapsX[3];
+	for (uint8_t k = 0; k < 3; ++k) SliceTaps(tapsX[k], levelTaps.DownX[k], x0, tile->Width, srcX0);
+
+	const auto regionWidth = static_cast<size_t>(srcX1 - srcX0 + 1);
+	for (auto y = 0u; y < tile->Height; ++y)
+	{
+		const XMFLOAT4* pRows[3][2];
+		const Tap* pTapsY[3];
+		for (uint8_t k = 0; k < 3; ++k)
+		{
+			pTapsY[k] = &levelTaps.DownY[k][y0 + y];
+			pRows[k][0] = &region[regionWidth * (pTapsY[k]->I0 - srcY0)];
+			pRows[k][1] = &region[regionWidth * (pTapsY[k]->I1 - srcY0)];
+		}
+
+		downsampleRow(&tile->Pixels[static_cast<size_t>(tile->Width) * y], pRows, pTapsY, tapsX, 0, tile->Width);
+	}
+
+	return tile;
+}
+
+FilterTiledCPU::TilePtr FilterTiledCPU::blendTile(uint8_t level, uint32_t i, uint32_t j)
+{
+	const auto& levelTaps = m_levels[level];
+	const auto& mip = m_mips[level];
+	const auto x0 = m_tileSize * i;
+	const auto y0 = m_tileSize * j;
+	const auto src = getMipTile(level, i, j);
+	shared_ptr<Image> tile(new Image());
+	tile->Width = src->Width;
+	tile->Height = src->Height;
+	tile->Pixels.resize(src->Pixels.size());
+
+	// Falloffs of the sigma, whose largest tells if the coarser result is read at all
+	vector<float> dist2X, falloffs;
+	const auto isUniform = reinterpret_cast<const uint32_t&>(m_focus.x) == UINT32_MAX;
+	auto maxFalloff = 1.0f;
+	if (!isUniform && hasFalloffMap())
+	{
+		falloffs.resize(tile->Pixels.size());
+		for (auto y = 0u; y < tile->Height; ++y)
+			sampleFalloffs(&falloffs[static_cast<size_t>(tile->Width) * y], y0 + y, mip.Width, mip.Height, x0, x0 + tile->Width);
+
+		maxFalloff = 0.0f;
+		for (const auto& falloff : falloffs) maxFalloff = (max)(fabsf(falloff), maxFalloff);
+	}
+	else if (!isUniform)
+	{
+		dist2X.resize(tile->Width);
+		for (auto x = 0u; x < tile->Width; ++x) dist2X[x] = computeDistance(x0 + x, mip.Width, m_focus.x);
+		maxFalloff = getMaxFalloff(level, m_focus, x0, y0, x0 + tile->Width, y0 + tile->Height);
+	}
+
+	// Saturated tiles are the mip tiles
+	if (isSaturated(level, getMaxChannelSigma(m_sigma), maxFalloff))
+	{
+		tile->Pixels = src->Pixels;
+
+		return tile;
+	}
+
+	// Bilinear footprint in the coarser result
+	const auto srcX0 = levelTaps.UpX[x0].I0;
+	const auto srcY0 = levelTaps.UpY[y0].I0;
+	const auto srcX1 = levelTaps.UpX[x0 + tile->Width - 1].I1;
+	const auto srcY1 = levelTaps.UpY[y0 + tile->Height - 1].I1;
+	vector<XMFLOAT4> region;
+	gatherRegion(region, BLENDED, level + 1, srcX0, srcY0, srcX1, srcY1);
+
+	vector<Tap> tapsX;
+	SliceTaps(tapsX, levelTaps.UpX, x0, tile->Width, srcX0);
+	const auto sigmas = getChannelSigmas(m_sigma);
+
+	const auto regionWidth = static_cast<size_t>(srcX1 - srcX0 + 1);
+	for (auto y = 0u; y < tile->Height; ++y)
+	{
+		const auto& ty = levelTaps.UpY[y0 + y];
+		const auto rowOffset = static_cast<size_t>(tile->Width) * y;
+		const auto pFalloffX = !falloffs.empty() ? &falloffs[rowOffset] : isUniform ? nullptr : dist2X.data();
+		const auto falloffY = dist2X.empty() ? 0.0f : computeDistance(y0 + y, mip.Height, m_focus.y);
+		upsampleRow(level, &tile->Pixels[rowOffset], &src->Pixels[rowOffset],
+			&region[regionWidth * (ty.I0 - srcY0)], &region[regionWidth * (ty.I1 - srcY0)], ty, tapsX,
+			pFalloffX, falloffY, sigmas, 0, tile->Width);
+	}
+
+	return tile;
+}
+
+FilterTiledCPU::TilePtr FilterTiledCPU::loadTile(uint8_t level, uint32_t i, uint32_t j) const
+{
+	shared_ptr<Image> tile(new Image());
+	getTileSize(level, i, j, tile->Width, tile->Height);
+	tile->Pixels.resize(static_cast<size_t>(tile->Width) * tile->Height);
+	memcpy(tile->Pixels.data(), getTileData(level, i, j), sizeof(XMFLOAT4) * tile->Pixels.size());
+
+	return tile;
+}
+
+void FilterTiledCPU::storeTile(uint8_t level, uint32_t i, uint32_t j, const Image& tile)
+{
+	memcpy(getTileData(level, i, j), tile.Pixels.data(), sizeof(XMFLOAT4) * tile.Pixels.size());
+}
+
+void FilterTiledCPU::gatherRegion(vector<XMFLOAT4>& region, TileType type, uint8_t level,
+	uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+	const auto width = x1 - x0 + 1;
+	region.resize(static_cast<size_t>(width) * (y1 - y0 + 1));
+	for (auto j = y0 / m_tileSize; j <= y1 / m_tileSize; ++j)
+	{
+		for (auto i = x0 / m_tileSize; i <= x1 / m_tileSize; ++i)
+		{
+			const auto tile = type == MIP ? getMipTile(level, i, j) : getBlendedTile(level, i, j);
+
+			// Overlap of the tile and the region
+			const auto tileX = m_tileSize * i;
+			const auto tileY = m_tileSize * j;
+			const auto startX = (max)(x0, tileX);
+			const auto endX = (min)(x1 + 1, tileX + tile->Width);
+			const auto endY = (min)(y1 + 1, tileY + tile->Height);
+			for (auto y = (max)(y0, tileY); y < endY; ++y)
+				memcpy(&region[static_cast<size_t>(width) * (y - y0) + startX - x0],
+					&tile->Pixels[static_cast<size_t>(tile->Width) * (y - tileY) + startX - tileX],
+					sizeof(XMFLOAT4) * (endX - startX));
+		}
+	}
+}
+
+void FilterTiledCPU::prefetch(uint8_t level, uint32_t i, uint32_t j)
+{
+	const auto& levelInfo = m_levels[level];
+	{
+		lock_guard<mutex> lock(m_mutex);
+		for (auto y = j ? j - 1 : j; y <= j + 1 && y < levelInfo.NumTilesY; ++y)
+			for (auto x = i ? i - 1 : i; x <= i + 1 && x < levelInfo.NumTilesX; ++x)
+				if (x != i || y != j) m_prefetchKeys.emplace_back(GetTileKey(level, x, y));
+
+		while (m_prefetchKeys.size() > g_maxPrefetches) m_prefetchKeys.pop_front();
+	}
+	m_prefetchReady.notify_one();
+}
+
+void FilterTiledCPU::prefetchMain()
+{
+	for (;;)
+	{
+		uint64_t key;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_prefetchReady.wait(lock, [this] { return !m_prefetchKeys.empty() || m_isQuitting; });
+			if (m_isQuitting) break;
+
+			key = m_prefetchKeys.front();
+			m_prefetchKeys.pop_front();
+		}
+
+		// Mip tiles only; result tiles depend on the parameters
+		const auto level = static_cast<uint8_t>(key >> 48);
+		getMipTile(level, static_cast<uint32_t>(key & 0xffffff), static_cast<uint32_t>((key >> 24) & 0xffffff));
+	}
+}
+
+void FilterTiledCPU::stopPrefetch()
+{
+	if (!m_prefetchThread.joinable()) return;
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_isQuitting = true;
+		m_prefetchKeys.clear();
+	}
+	m_prefetchReady.notify_all();
+	m_prefetchThread.join();
+}
+
+void FilterTiledCPU::getTileSize(uint8_t level, uint32_t i, uint32_t j, uint32_t& width, uint32_t& height) const
+{
+	const auto& mip = m_mips[level];
+	width = (min)(m_tileSize, mip.Width - m_tileSize * i);
+	height = (min)(m_tileSize, mip.Height - m_tileSize * j);
+}
+
+uint8_t* FilterTiledCPU::getTileData(uint8_t level, uint32_t i, uint32_t j) const
+{
+	const auto& levelInfo = m_levels[level];
+	const auto slot = static_cast<uint64_t>(levelInfo.NumTilesX) * j + i;
+
+	return &m_store.GetData()[levelInfo.Offset + sizeof(XMFLOAT4) * m_tileSize * m_tileSize * slot];
+}
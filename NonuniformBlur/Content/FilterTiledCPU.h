@@ -0,0 +1,93 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "FilterCPU.h"
+#include "LRUCache.h"
+
+// Out-of-core variant of the CPU filter for panning and zooming around very large images.
+// The mip chain is stored in a tiled file, with the recently used tiles of each level cached,
+// and result tiles are evaluated on demand from only the mip and coarser result tiles they
+// depend on.
+class FilterTiledCPU :
+	protected FilterCPU
+{
+public:
+	using FilterCPU::Image;
+	using FilterCPU::FocusPoint;
+	using TilePtr = std::shared_ptr<const Image>;
+
+	FilterTiledCPU();
+	virtual ~FilterTiledCPU();
+
+	// Builds the mip tiles into the store file; the source is not needed afterwards
+	bool Init(const ImageFile& source, const char* storeFileName,
+		uint32_t tileSize = 128, uint32_t numCachedTiles = 64);
+
+	// Drops the result tiles of the previous parameters
+	void UpdateFrame(DirectX::XMFLOAT2 focus, float sigma);
+
+	// Drops the result tiles too; the map is sampled per tile instead of held for the whole levels
+	bool SetSigmaMap(const ImageFile& sigmaMap);
+	bool SetSigmaMap(const float* pSigmaMap, uint32_t width, uint32_t height);
+	bool SetFocusPoints(const FocusPoint* pPoints, uint32_t numPoints, float smoothness = 0.0f);
+
+	// Result tile at a level, 0 for the full resolution; its neighbours are prefetched
+	TilePtr GetTile(uint8_t level, uint32_t i, uint32_t j);
+
+	using FilterCPU::GetImageSize;
+	using FilterCPU::GetNumLevels;
+	void GetTileCount(uint8_t level, uint32_t& numTilesX, uint32_t& numTilesY) const;
+
+protected:
+	enum TileType : uint8_t
+	{
+		MIP,
+		BLENDED,
+
+		NUM_TILE_TYPE
+	};
+
+	struct Level
+	{
+		uint32_t			NumTilesX;
+		uint32_t			NumTilesY;
+		uint64_t			Offset;		// Of the first tile in the store
+		std::vector<Tap>	DownX[3];	// From the finer level
+		std::vector<Tap>	DownY[3];
+		std::vector<Tap>	UpX;		// From the coarser level
+		std::vector<Tap>	UpY;
+	};
+
+	using TileCache = LRUCache<uint64_t, TilePtr>;
+
+	TilePtr getMipTile(uint8_t level, uint32_t i, uint32_t j);
+	TilePtr getBlendedTile(uint8_t level, uint32_t i, uint32_t j);
+	TilePtr generateMipTile(uint8_t level, uint32_t i, uint32_t j);
+	TilePtr blendTile(uint8_t level, uint32_t i, uint32_t j);
+	TilePtr loadTile(uint8_t level, uint32_t i, uint32_t j) const;
+	void storeTile(uint8_t level, uint32_t i, uint32_t j, const Image& tile);
+	void gatherRegion(std::vector<DirectX::XMFLOAT4>& region, TileType type, uint8_t level,
+		uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1);
+
+	void prefetch(uint8_t level, uint32_t i, uint32_t j);
+	void prefetchMain();
+	void stopPrefetch();
+
+	void getTileSize(uint8_t level, uint32_t i, uint32_t j, uint32_t& width, uint32_t& height) const;
+	uint8_t* getTileData(uint8_t level, uint32_t i, uint32_t j) const;
+
+	MappedFile				m_store;
+	std::string				m_storeFileName;
+	std::vector<Level>		m_levels;
+	std::vector<TileCache>	m_caches[NUM_TILE_TYPE];
+	uint32_t				m_tileSize;
+
+	std::thread				m_prefetchThread;
+	std::mutex				m_mutex;
+	std::condition_variable	m_prefetchReady;
+	std::deque<uint64_t>	m_prefetchKeys;
+	bool					m_isQuitting;
+};
@@ -0,0 +1,199 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "FilterVideoCPU.h"
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+	// Multiply-xorshift hash over 8-byte words, to skip the byte compare of most changed tiles
+	uint64_t HashBytes(uint64_t hash, const uint8_t* pData, size_t size)
+	{
+		const auto prime = 0x9e3779b97f4a7c15ull;
+
+		size_t i = 0;
+		for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+		{
+			uint64_t word;
+			memcpy(&word, &pData[i], sizeof(uint64_t));
+			hash = (hash ^ word) * prime;
+			hash ^= hash >> 29;
+		}
+
+		for (; i < size; ++i) hash = (hash ^ pData[i]) * prime;
+
+		return hash;
+	}
+}
+
+FilterVideoCPU::FilterVideoCPU() :
+	m_frameDesc(),
+	m_tileSize(32),
+	m_numTilesX(0),
+	m_numTilesY(0),
+	m_isProcessed(false),
+	m_tileReuseRatio(0.0f),
+	m_reuseRatio(0.0f)
+{
+}
+
+FilterVideoCPU::~FilterVideoCPU()
+{
+}
+
+bool FilterVideoCPU::Init(const ImageFile& firstFrame, uint32_t tileSize)
+{
+	XUSG_N_RETURN(tileSize > 0, false);
+	XUSG_N_RETURN(FilterCPU::Init(firstFrame), false);
+
+	const auto& desc = firstFrame.GetDesc();
+	m_frameDesc = desc;
+	m_tileSize = tileSize;
+	m_numTilesX = (desc.Width + tileSize - 1) / tileSize;
+	m_numTilesY = (desc.Height + tileSize - 1) / tileSize;
+	m_tileHashes.resize(static_cast<size_t>(m_numTilesX) * m_numTilesY);
+	m_prevFrame.resize(static_cast<size_t>(ImageFile::GetElementSize(desc.Type)) * desc.Comp * desc.Width * desc.Height);
+	for (auto j = 0u; j < m_numTilesY; ++j)
+	{
+		for (auto i = 0u; i < m_numTilesX; ++i)
+		{
+			m_tileHashes[m_numTilesX * j + i] = hashTile(firstFrame, i, j);
+			storeTile(firstFrame, i, j);
+		}
+	}
+	m_isProcessed = false;
+
+	return true;
+}
+
+void FilterVideoCPU::UpdateFrame(XMFLOAT2 focus, float sigma)
+{
+	if (m_isProcessed && reinterpret_cast<const uint32_t&>(focus.x) == reinterpret_cast<const uint32_t&>(m_focus.x) &&
+		focus.y == m_focus.y && sigma == m_sigma) return;
+
+	FilterCPU::UpdateFrame(focus, sigma);
+	m_isProcessed = false;
+}
+
+bool FilterVideoCPU::SetSigmaMap(const ImageFile& sigmaMap)
+{
+	XUSG_N_RETURN(FilterCPU::SetSigmaMap(sigmaMap), false);
+	m_isProcessed = false;
+
+	return true;
+}
+
+bool FilterVideoCPU::SetFocusPoints(const FocusPoint* pPoints, uint32_t numPoints, float smoothness)
+{
+	XUSG_N_RETURN(FilterCPU::SetFocusPoints(pPoints, numPoints, smoothness), false);
+	m_isProcessed = false;
+
+	return true;
+}
+
+bool FilterVideoCPU::Process(const ImageFile& frame, float tolerance)
+{
+	const auto& desc = frame.GetDesc();
+	XUSG_N_RETURN(desc.Width == m_frameDesc.Width && desc.Height == m_frameDesc.Height &&
+		desc.Comp == m_frameDesc.Comp && desc.Type == m_frameDesc.Type, false);
+
+	// Changed tiles, as runs along each row of tiles; a hash match is confirmed by the bytes
+	vector<Rect> dirtyRects;
+	auto numChanged = 0u;
+	for (auto j = 0u; j < m_numTilesY; ++j)
+	{
+		for (auto i = 0u; i < m_numTilesX; ++i)
+		{
+			auto& tileHash = m_tileHashes[m_numTilesX * j + i];
+			const auto hash = hashTile(frame, i, j);
+			if (hash == tileHash && compareTile(frame, i, j)) continue;
+
+			tileHash = hash;
+			storeTile(frame, i, j);
+			++numChanged;
+			const auto x = m_tileSize * i;
+			const auto y = m_tileSize * j;
+			if (!dirtyRects.empty() && dirtyRects.back().Right == x && dirtyRects.back().Top == y)
+				dirtyRects.back().Right = x + m_tileSize;
+			else dirtyRects.push_back({ x, y, x + m_tileSize, y + m_tileSize });
+		}
+	}
+
+	XUSG_N_RETURN(UpdateSource(frame, dirtyRects.data(), static_cast<uint32_t>(dirtyRects.size())), false);
+	m_tileReuseRatio = 1.0f - static_cast<float>(numChanged) / m_tileHashes.size();
+
+	// Re-blur the whole frame for new parameters, or only the cones of the changed tiles
+	if (!m_isProcessed)
+	{
+		FilterCPU::Process();
+		m_isProcessed = true;
+		m_reuseRatio = 0.0f;
+	}
+	else
+	{
+		size_t numPixels = 0;
+		for (size_t i = 0; i + 1 < m_blended.size(); ++i) numPixels += m_blended[i].Pixels.size();
+		const auto numReblended = ProcessDirty(tolerance);
+		m_reuseRatio = numPixels > 0 ? 1.0f - static_cast<float>(numReblended) / numPixels : 1.0f;
+	}
+
+	return true;
+}
+
+float FilterVideoCPU::GetTileReuseRatio() const
+{
+	return m_tileReuseRatio;
+}
+
+float FilterVideoCPU::GetReuseRatio() const
+{
+	return m_reuseRatio;
+}
+
+uint64_t FilterVideoCPU::hashTile(const ImageFile& frame, uint32_t i, uint32_t j) const
+{
+	// Rows in the file's own layout, so that nothing is converted
+	const auto& desc = frame.GetDesc();
+	const auto pixelSize = static_cast<size_t>(desc.Comp) * ImageFile::GetElementSize(desc.Type);
+	const auto x0 = m_tileSize * i;
+	const auto y0 = m_tileSize * j;
+	const auto rowSize = pixelSize * ((min)(x0 + m_tileSize, desc.Width) - x0);
+	const auto y1 = (min)(y0 + m_tileSize, desc.Height);
+
+	auto hash = 0xcbf29ce484222325ull;
+	for (auto y = y0; y < y1; ++y) hash = HashBytes(hash, &frame.GetRow(y)[pixelSize * x0], rowSize);
+
+	return hash;
+}
+
+bool FilterVideoCPU::compareTile(const ImageFile& frame, uint32_t i, uint32_t j) const
+{
+	const auto pixelSize = static_cast<size_t>(m_frameDesc.Comp) * ImageFile::GetElementSize(m_frameDesc.Type);
+	const auto rowPitch = pixelSize * m_frameDesc.Width;
+	const auto x0 = m_tileSize * i;
+	const auto y0 = m_tileSize * j;
+	const auto rowSize = pixelSize * ((min)(x0 + m_tileSize, m_frameDesc.Width) - x0);
+	const auto y1 = (min)(y0 + m_tileSize, m_frameDesc.Height);
+
+	for (auto y = y0; y < y1; ++y)
+		if (memcmp(&frame.GetRow(y)[pixelSize * x0], &m_prevFrame[rowPitch * y + pixelSize * x0], rowSize) != 0)
+			return false;
+
+	return true;
+}
+
+void FilterVideoCPU::storeTile(const ImageFile& frame, uint32_t i, uint32_t j)
+{
+	const auto pixelSize = static_cast<size_t>(m_frameDesc.Comp) * ImageFile::GetElementSize(m_frameDesc.Type);
+	const auto rowPitch = pixelSize * m_frameDesc.Width;
+	const auto x0 = m_tileSize * i;
+	const auto y0 = m_tileSize * j;
+	const auto rowSize = pixelSize * ((min)(x0 + m_tileSize, m_frameDesc.Width) - x0);
+	const auto y1 = (min)(y0 + m_tileSize, m_frameDesc.Height);
+
+	for (auto y = y0; y < y1; ++y)
+		memcpy(&m_prevFrame[rowPitch * y + pixelSize * x0], &frame.GetRow(y)[pixelSize * x0], rowSize);
+}
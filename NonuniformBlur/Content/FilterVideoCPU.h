@@ -0,0 +1,58 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "FilterCPU.h"
+
+// Video variant of the CPU filter for screen-capture and UI content, where most of a frame is
+// identical to the previous one. The source tiles of each frame are hashed, and compared byte by
+// byte with the previous frame on a hash match; only the changed tiles are reloaded and re-blurred
+// through the dirty rectangles of FilterCPU, so that the mips and the result of the unchanged
+// regions are reused.
+class FilterVideoCPU :
+	protected FilterCPU
+{
+public:
+	using FilterCPU::FocusPoint;
+
+	FilterVideoCPU();
+	virtual ~FilterVideoCPU();
+
+	// Loads the first frame; the following frames must be of the same size and pixel type
+	bool Init(const ImageFile& firstFrame, uint32_t tileSize = 32);
+
+	// The whole frame is re-blurred after the parameters change
+	void UpdateFrame(DirectX::XMFLOAT2 focus, float sigma);
+	bool SetSigmaMap(const ImageFile& sigmaMap);
+	bool SetFocusPoints(const FocusPoint* pPoints, uint32_t numPoints, float smoothness = 0.0f);
+
+	// Filters the next frame; the tolerance is as for ProcessDirty()
+	bool Process(const ImageFile& frame, float tolerance = 0.0f);
+
+	using FilterCPU::GetResult;
+	using FilterCPU::GetImageSize;
+	using FilterCPU::WriteResult;
+
+	// Fractions of the last frame reused from the previous one: of the source tiles, and of
+	// the up-sampled pixels
+	float GetTileReuseRatio() const;
+	float GetReuseRatio() const;
+
+protected:
+	uint64_t hashTile(const ImageFile& frame, uint32_t i, uint32_t j) const;
+	bool compareTile(const ImageFile& frame, uint32_t i, uint32_t j) const;	// With the previous frame
+	void storeTile(const ImageFile& frame, uint32_t i, uint32_t j);
+
+	std::vector<uint64_t>	m_tileHashes;
+	std::vector<uint8_t>	m_prevFrame;	// Rows of the previous frame in its own layout
+	ImageFile::Desc			m_frameDesc;
+	uint32_t				m_tileSize;
+	uint32_t				m_numTilesX;
+	uint32_t				m_numTilesY;
+	bool					m_isProcessed;	// False until a frame is blurred with the current parameters
+
+	float					m_tileReuseRatio;
+	float					m_reuseRatio;
+};
@@ -0,0 +1,312 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "FocusPullRenderer.h"
+#include "CommandLineArgs.h"
+
+using namespace std;
+using namespace DirectX;
+
+FocusPullRenderer::FocusPullRenderer() :
+	m_outputExt("png"),
+	m_outputDesc(),
+	m_nextFrame(0),
+	m_numFinished(0),
+	m_numFailures(0),
+	m_focus(0.0f, 0.0f),
+	m_sigma(24.0f),
+	m_focusDistance(0.5f),
+	m_aperture(16.0f),
+	m_numFrames(0),
+	m_outputLevel(0),
+	m_numThreads(0)
+{
+}
+
+FocusPullRenderer::~FocusPullRenderer()
+{
+}
+
+bool FocusPullRenderer::ParseCommandLineArgs(wchar_t* argv[], int argc)
+{
+	const CommandLineArgs args(argv, argc);
+
+	auto isRender = false;
+	for (auto i = 1; i < argc; ++i)
+	{
+		if (args.IsMatched(i, L"render"))
+		{
+			if (args.HasNextValue(i)) m_input = CommandLineArgs::ToString(argv[++i]);
+			if (args.HasNextValue(i)) m_outputDir = CommandLineArgs::ToString(argv[++i]);
+			isRender = true;
+		}
+		else if (args.IsMatched(i, L"keys"))
+		{
+			if (args.HasNextValue(i)) m_keyFileName = CommandLineArgs::ToString(argv[++i]);
+		}
+		else if (args.IsMatched(i, L"sigmamap"))
+		{
+			if (args.HasNextValue(i)) m_sigmaMapFileName = CommandLineArgs::ToString(argv[++i]);
+		}
+		else if (args.IsMatched(i, L"depth"))
+		{
+			if (args.HasNextValue(i)) m_depthFileName = CommandLineArgs::ToString(argv[++i]);
+		}
+		else if (args.IsMatched(i, L"distance"))
+		{
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_focusDistance);
+		}
+		else if (args.IsMatched(i, L"aperture"))
+		{
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_aperture);
+		}
+		else if (args.IsMatched(i, L"frames"))
+		{
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%u", &m_numFrames);
+		}
+		else if (args.IsMatched(i, L"format"))
+		{
+			if (args.HasNextValue(i)) m_outputExt = CommandLineArgs::ToString(argv[++i]);
+		}
+		else if (args.IsMatched(i, L"threads"))
+		{
+			auto numThreads = 0u;
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%u", &numThreads);
+			m_numThreads = static_cast<uint8_t>((min)(numThreads, 255u));
+		}
+		else if (args.IsMatched(i, L"s") || args.IsMatched(i, L"sigma"))
+		{
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_sigma);
+		}
+		else if (args.IsMatched(i, L"f") || args.IsMatched(i, L"focus"))
+		{
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_focus.x);
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_focus.y);
+		}
+		else if (args.IsMatched(i, L"u") || args.IsMatched(i, L"uniform"))
+			reinterpret_cast<uint32_t&>(m_focus.x) = UINT32_MAX;
+		else if (args.IsMatched(i, L"l") || args.IsMatched(i, L"level"))
+		{
+			auto level = 0u;
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%u", &level);
+			m_outputLevel = static_cast<uint8_t>((min)(level, 255u));
+		}
+	}
+
+	if (m_outputDir.empty()) m_outputDir = ".";
+
+	return isRender;
+}
+
+bool FocusPullRenderer::Run()
+{
+	if (!loadKeyframes())
+	{
+		cerr << "Failed to load the keyframes from " << m_keyFileName << endl;
+
+		return false;
+	}
+
+	// The pyramid of the static source is shared by all frames, while the layers of the depth of
+	// field depend on the focus distance, so that they are built per frame
+	{
+		ImageFile source;
+		if (!source.Open(m_input.c_str()))
+		{
+			cerr << "Failed to load " << m_input << endl;
+
+			return false;
+		}
+
+		m_outputDesc = source.GetDesc();
+		if (m_depthFileName.empty())
+		{
+			if (!m_filter.Init(source))
+			{
+				cerr << "Failed to load " << m_input << endl;
+
+				return false;
+			}
+
+			ImageFile sigmaMap;
+			if (!m_sigmaMapFileName.empty() && (!sigmaMap.Open(m_sigmaMapFileName.c_str()) || !m_filter.SetSigmaMap(sigmaMap)))
+			{
+				cerr << "Failed to load the sigma map " << m_sigmaMapFileName << endl;
+
+				return false;
+			}
+
+			m_outputLevel = (min)(m_outputLevel, static_cast<uint8_t>(m_filter.GetNumLevels() - 1));
+			m_filter.GetImageSize(m_outputDesc.Width, m_outputDesc.Height, m_outputLevel);
+		}
+		else
+		{
+			// The CoC takes the place of the sigma map
+			ImageFile depth;
+			if (!depth.Open(m_depthFileName.c_str()) || !m_dof.Init(source, depth))
+			{
+				cerr << "Failed to load the depth image " << m_depthFileName << endl;
+
+				return false;
+			}
+
+			m_outputLevel = (min)(m_outputLevel, static_cast<uint8_t>(m_dof.GetNumLevels() - 1));
+			m_dof.GetImageSize(m_outputDesc.Width, m_outputDesc.Height, m_outputLevel);
+		}
+	}
+
+	if (!m_numFrames) m_numFrames = m_keyframes.back().Frame + 1;
+	CreateDirectoryA(m_outputDir.c_str(), nullptr);
+
+	// Frames are independent, so they are handed out to the threads in any order
+	if (!m_numThreads) m_numThreads = static_cast<uint8_t>((min)((max)(thread::hardware_concurrency(), 1u), 255u));
+	vector<thread> threads((min)(static_cast<uint32_t>(m_numThreads), m_numFrames));
+	for (auto& thread : threads) thread = std::thread(&FocusPullRenderer::renderMain, this);
+	for (auto& thread : threads) thread.join();
+
+	return m_numFailures == 0;
+}
+
+bool FocusPullRenderer::loadKeyframes()
+{
+	// Without keyframes, the parameters of the command line hold for all frames
+	const auto isDOF = !m_depthFileName.empty();
+	m_keyframes.clear();
+	if (m_keyFileName.empty())
+	{
+		const auto isUniform = reinterpret_cast<const uint32_t&>(m_focus.x) == UINT32_MAX;
+		if (isDOF) m_keyframes.push_back({ 0, XMFLOAT2(m_focusDistance, 0.0f), m_aperture, false });
+		else m_keyframes.push_back({ 0, m_focus, m_sigma, isUniform });
+
+		return true;
+	}
+
+	ifstream file(m_keyFileName);
+	XUSG_N_RETURN(file, false);
+
+	// A line per keyframe: the frame, then the focus and sigma, or "u" and sigma for the uniform blur;
+	// with a depth image, the frame, then the focus distance and aperture
+	for (string line; getline(file, line);)
+	{
+		istringstream tokens(line);
+		string token;
+		if (!(tokens >> token) || token[0] == '#') continue;
+
+		Keyframe key = {};
+		key.Frame = static_cast<uint32_t>(strtoul(token.c_str(), nullptr, 10));
+		XUSG_N_RETURN(tokens >> token, false);
+		key.IsUniform = !isDOF && token == "u";
+		if (!key.IsUniform)
+		{
+			key.Focus.x = strtof(token.c_str(), nullptr);
+			if (!isDOF) tokens >> key.Focus.y;
+		}
+		tokens >> key.Sigma;
+		XUSG_N_RETURN(!tokens.fail(), false);
+		m_keyframes.emplace_back(key);
+	}
+	XUSG_N_RETURN(!m_keyframes.empty(), false);
+
+	stable_sort(m_keyframes.begin(), m_keyframes.end(),
+		[](const Keyframe& a, const Keyframe& b) { return a.Frame < b.Frame; });
+
+	return true;
+}
+
+void FocusPullRenderer::evaluate(uint32_t frameIndex, XMFLOAT2& focus, float& sigma) const
+{
+	// Linear between the keyframes, and held before the first and after the last
+	const auto next = upper_bound(m_keyframes.cbegin(), m_keyframes.cend(), frameIndex,
+		[](uint32_t i, const Keyframe& key) { return i < key.Frame; });
+	const auto& key1 = next == m_keyframes.cend() ? m_keyframes.back() : *next;
+	const auto& key0 = next == m_keyframes.cbegin() ? m_keyframes.front() : *(next - 1);
+	const auto t = key1.Frame > key0.Frame ? static_cast<float>(frameIndex - key0.Frame) / (key1.Frame - key0.Frame) : 0.0f;
+
+	sigma = key0.Sigma + (key1.Sigma - key0.Sigma) * t;
+
+	// The uniform blur steps at its keyframes, and the focus is held next to them
+	if (key0.IsUniform)
+	{
+		reinterpret_cast<uint32_t&>(focus.x) = UINT32_MAX;
+		focus.y = 0.0f;
+	}
+	else if (key1.IsUniform) focus = key0.Focus;
+	else
+	{
+		focus.x = key0.Focus.x + (key1.Focus.x - key0.Focus.x) * t;
+		focus.y = key0.Focus.y + (key1.Focus.y - key0.Focus.y) * t;
+	}
+}
+
+string FocusPullRenderer::getOutputFileName(uint32_t frameIndex) const
+{
+	const auto nameStart = m_input.find_last_of("/\\") + 1;
+	const auto extStart = m_input.find_last_of('.');
+	const auto hasExt = extStart != string::npos && extStart > nameStart;
+	const auto baseName = m_input.substr(nameStart, (hasExt ? extStart : m_input.size()) - nameStart);
+
+	char index[16];
+	sprintf_s(index, sizeof(index), "_%05u.", frameIndex);
+
+	return m_outputDir + "/" + baseName + index + m_outputExt;
+}
+
+void FocusPullRenderer::renderMain()
+{
+	// Up-sampled levels, or the layers of the depth of field, of this thread, reused across its frames
+	FilterCPU::Frame frame;
+	FilterDOFCPU dof;
+	if (!m_depthFileName.empty()) dof = m_dof;
+	for (;;)
+	{
+		uint32_t frameIndex;
+		{
+			lock_guard<mutex> lock(m_mutex);
+			if (m_nextFrame >= m_numFrames) break;
+			frameIndex = m_nextFrame++;
+		}
+
+		const auto succeeded = m_depthFileName.empty() ? render(frameIndex, frame) : renderDOF(frameIndex, dof);
+
+		lock_guard<mutex> lock(m_mutex);
+		++m_numFinished;
+		if (succeeded) cout << "[" << m_numFinished << "/" << m_numFrames << "] frame " << frameIndex << endl;
+		else
+		{
+			cerr << "Failed to render frame " << frameIndex << endl;
+			++m_numFailures;
+		}
+	}
+}
+
+bool FocusPullRenderer::render(uint32_t frameIndex, FilterCPU::Frame& frame) const
+{
+	evaluate(frameIndex, frame.Focus, frame.Sigma);
+	m_filter.Process(frame, m_outputLevel);
+
+	ImageFile output;
+	XUSG_N_RETURN(output.Create(getOutputFileName(frameIndex).c_str(), m_outputDesc), false);
+	const auto& result = m_filter.GetResult(frame, m_outputLevel);
+	vector<XMFLOAT4> pixels(result.Pixels.size());
+	FilterCPU::Unpremultiply(pixels.data(), result.Pixels.data(), pixels.size());
+	output.WriteRows(0, result.Height, &pixels[0].x, sizeof(XMFLOAT4) * result.Width, 4);
+
+	return output.Close();
+}
+
+bool FocusPullRenderer::renderDOF(uint32_t frameIndex, FilterDOFCPU& filter) const
+{
+	// The focus distance and aperture are tracked as the focus x and sigma
+	XMFLOAT2 focus;
+	float aperture;
+	evaluate(frameIndex, focus, aperture);
+	filter.UpdateFrame(focus.x, aperture);
+	filter.Process(m_outputLevel);
+
+	ImageFile output;
+	XUSG_N_RETURN(output.Create(getOutputFileName(frameIndex).c_str(), m_outputDesc), false);
+	filter.WriteResult(output);
+
+	return output.Close();
+}
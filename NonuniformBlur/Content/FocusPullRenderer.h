@@ -0,0 +1,67 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "FilterDOFCPU.h"
+
+// Offline mode: renders a focus pull over a static image into an image sequence. The focus,
+// sigma and uniform blur follow keyframe tracks evaluated at each frame index, instead of the
+// wall-clock animation of the windowed app, so that every run renders the same frames. The
+// pyramid is built once, and the frames are spread across threads that each up-sample their
+// own levels from it. With a depth image, the frames are rendered with the depth of field of
+// FilterDOFCPU instead, whose focus distance and aperture follow the tracks of the focus and
+// the sigma.
+class FocusPullRenderer
+{
+public:
+	FocusPullRenderer();
+	virtual ~FocusPullRenderer();
+
+	// Returns true if rendering is requested
+	bool ParseCommandLineArgs(wchar_t* argv[], int argc);
+	bool Run();
+
+protected:
+	struct Keyframe
+	{
+		uint32_t			Frame;
+		DirectX::XMFLOAT2	Focus;
+		float				Sigma;
+		bool				IsUniform;
+	};
+
+	bool loadKeyframes();
+	void evaluate(uint32_t frameIndex, DirectX::XMFLOAT2& focus, float& sigma) const;
+	std::string getOutputFileName(uint32_t frameIndex) const;
+
+	void renderMain();
+	bool render(uint32_t frameIndex, FilterCPU::Frame& frame) const;
+	bool renderDOF(uint32_t frameIndex, FilterDOFCPU& filter) const;
+
+	std::string				m_input;
+	std::string				m_outputDir;
+	std::string				m_outputExt;
+	std::string				m_keyFileName;
+	std::string				m_sigmaMapFileName;
+	std::string				m_depthFileName;
+	std::vector<Keyframe>	m_keyframes;	// Sorted by frame
+
+	FilterCPU				m_filter;
+	FilterDOFCPU			m_dof;			// Copied by each thread, as the sigma maps of its slices change per frame
+	ImageFile::Desc			m_outputDesc;
+
+	std::mutex				m_mutex;
+	uint32_t				m_nextFrame;
+	uint32_t				m_numFinished;
+	uint32_t				m_numFailures;
+
+	DirectX::XMFLOAT2		m_focus;
+	float					m_sigma;
+	float					m_focusDistance;
+	float					m_aperture;
+	uint32_t				m_numFrames;	// 0 for up to the last keyframe
+	uint8_t					m_outputLevel;
+	uint8_t					m_numThreads;
+};
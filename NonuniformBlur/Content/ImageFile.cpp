@@ -0,0 +1,996 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "ImageFile.h"
+#include "PNGEncoder.h"
+#include "stb_image.h"
+
+using namespace std;
+
+namespace
+{
+	//--------------------------------------------------------------------------------------
+	// Element and row conversions
+	//--------------------------------------------------------------------------------------
+	inline float ToFloat(uint8_t v) { return v / 255.0f; }
+	inline float ToFloat(uint16_t v) { return v / 65535.0f; }
+	inline float ToFloat(float v) { return v; }
+
+	template<typename T> T FromFloat(float v);
+	template<> uint8_t FromFloat<uint8_t>(float v) { return static_cast<uint8_t>((min)((max)(v, 0.0f), 1.0f) * 255.0f + 0.5f); }
+	template<> uint16_t FromFloat<uint16_t>(float v) { return static_cast<uint16_t>((min)((max)(v, 0.0f), 1.0f) * 65535.0f + 0.5f); }
+	template<> float FromFloat<float>(float v) { return v; }
+
+	template<typename T> T One() { return FromFloat<T>(1.0f); }
+
+	template<typename TDst, typename TSrc>
+	inline TDst Convert(TSrc v) { return FromFloat<TDst>(ToFloat(v)); }
+	template<> inline uint8_t Convert<uint8_t, uint8_t>(uint8_t v) { return v; }
+	template<> inline uint16_t Convert<uint16_t, uint16_t>(uint16_t v) { return v; }
+	template<> inline uint16_t Convert<uint16_t, uint8_t>(uint8_t v) { return static_cast<uint16_t>(v * 257); }
+	template<> inline float Convert<float, float>(float v) { return v; }
+
+	// Source channel of each destination channel; -1 means opaque alpha
+	void GetChannelMap(int8_t channelMap[4], uint8_t srcComp, uint8_t dstComp)
+	{
+		const auto srcHasAlpha = srcComp == 2 || srcComp == 4;
+		const auto dstHasAlpha = dstComp == 2 || dstComp == 4;
+		const auto isSrcGray = srcComp <= 2;
+		const auto isDstGray = dstComp <= 2;
+		for (uint8_t c = 0; c < dstComp; ++c)
+		{
+			if (dstHasAlpha && c + 1 == dstComp) channelMap[c] = srcHasAlpha ? srcComp - 1 : -1;
+			else channelMap[c] = isSrcGray || isDstGray ? 0 : c;
+		}
+	}
+
+	template<typename TDst, typename TSrc>
+	void ConvertRow(TDst* pDst, uint8_t dstComp, const TSrc* pSrc, uint8_t srcComp, uint32_t width)
+	{
+		if (is_same<TDst, TSrc>::value && dstComp == srcComp)
+		{
+			memcpy(pDst, pSrc, sizeof(TDst) * dstComp * width);
+
+			return;
+		}
+
+		int8_t channelMap[4];
+		GetChannelMap(channelMap, srcComp, dstComp);
+		for (auto i = 0u; i < width; ++i)
+			for (uint8_t c = 0; c < dstComp; ++c)
+				pDst[dstComp * i + c] = channelMap[c] < 0 ? One<TDst>() : Convert<TDst>(pSrc[srcComp * i + channelMap[c]]);
+	}
+
+	void SwapBytes(uint8_t* pData, size_t numElements, uint8_t elementSize)
+	{
+		for (size_t i = 0; i < numElements; ++i, pData += elementSize)
+			reverse(pData, pData + elementSize);
+	}
+
+	//--------------------------------------------------------------------------------------
+	// QOI codec (https://qoiformat.org/qoi-specification.pdf)
+	//--------------------------------------------------------------------------------------
+	const uint8_t g_qoiOpIndex = 0x00;
+	const uint8_t g_qoiOpDiff = 0x40;
+	const uint8_t g_qoiOpLuma = 0x80;
+	const uint8_t g_qoiOpRun = 0xc0;
+	const uint8_t g_qoiOpRGB = 0xfe;
+	const uint8_t g_qoiOpRGBA = 0xff;
+	const uint8_t g_qoiMask = 0xc0;
+	const uint8_t g_qoiHeaderSize = 14;
+	const uint8_t g_qoiPadding[] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+	struct QOIPixel
+	{
+		uint8_t R, G, B, A;
+
+		bool operator==(const QOIPixel& p) const { return R == p.R && G == p.G && B == p.B && A == p.A; }
+		uint8_t Hash() const { return (R * 3 + G * 5 + B * 7 + A * 11) % 64; }
+	};
+
+	uint32_t GetBigEndian(const uint8_t* pData)
+	{
+		return static_cast<uint32_t>(pData[0]) << 24 | static_cast<uint32_t>(pData[1]) << 16 |
+			static_cast<uint32_t>(pData[2]) << 8 | pData[3];
+	}
+
+	size_t GetMaxQOISize(uint32_t width, uint32_t height, uint8_t comp)
+	{
+		return g_qoiHeaderSize + sizeof(g_qoiPadding) + static_cast<size_t>(comp + 1) * width * height;
+	}
+
+	uint8_t* PutQOIHeader(uint8_t* p, uint32_t width, uint32_t height, uint8_t comp)
+	{
+		const auto putBigEndian = [&p](uint32_t v)
+		{
+			for (int8_t s = 24; s >= 0; s -= 8) *p++ = static_cast<uint8_t>(v >> s);
+		};
+
+		*p++ = 'q'; *p++ = 'o'; *p++ = 'i'; *p++ = 'f';
+		putBigEndian(width);
+		putBigEndian(height);
+		*p++ = comp;
+		*p++ = 0; // sRGB with linear alpha
+
+		return p;
+	}
+
+	// Encoder state carried across the rows, so that an image can be encoded in pieces
+	struct QOIEncoder
+	{
+		QOIPixel Index[64];
+		QOIPixel Prev;
+		uint8_t Run;
+
+		QOIEncoder() : Index(), Prev({ 0, 0, 0, 255 }), Run(0) {}
+
+		// Any pending run is emitted after the pixels only if they end the image
+		uint8_t* Encode(uint8_t* p, const uint8_t* pPixels, size_t numPixels, uint8_t comp, bool isLast)
+		{
+			for (size_t i = 0; i < numPixels; ++i)
+			{
+				const auto pSrc = &pPixels[comp * i];
+				const QOIPixel px = { pSrc[0], pSrc[1], pSrc[2], comp == 4 ? pSrc[3] : Prev.A };
+
+				if (px == Prev)
+				{
+					if (++Run == 62 || (isLast && i + 1 == numPixels))
+					{
+						*p++ = g_qoiOpRun | (Run - 1);
+						Run = 0;
+					}
+
+					continue;
+				}
+
+				if (Run > 0)
+				{
+					*p++ = g_qoiOpRun | (Run - 1);
+					Run = 0;
+				}
+
+				const auto h = px.Hash();
+				if (Index[h] == px) *p++ = g_qoiOpIndex | h;
+				else
+				{
+					Index[h] = px;
+					if (px.A == Prev.A)
+					{
+						const auto vr = static_cast<int8_t>(px.R - Prev.R);
+						const auto vg = static_cast<int8_t>(px.G - Prev.G);
+						const auto vb = static_cast<int8_t>(px.B - Prev.B);
+						const auto vgr = vr - vg;
+						const auto vgb = vb - vg;
+
+						if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+							*p++ = g_qoiOpDiff | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+						else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8)
+						{
+							*p++ = g_qoiOpLuma | (vg + 32);
+							*p++ = static_cast<uint8_t>((vgr + 8) << 4 | (vgb + 8));
+						}
+						else
+						{
+							*p++ = g_qoiOpRGB;
+							*p++ = px.R; *p++ = px.G; *p++ = px.B;
+						}
+					}
+					else
+					{
+						*p++ = g_qoiOpRGBA;
+						*p++ = px.R; *p++ = px.G; *p++ = px.B; *p++ = px.A;
+					}
+				}
+
+				Prev = px;
+			}
+
+			return p;
+		}
+	};
+
+	size_t EncodeQOI(uint8_t* pOut, const uint8_t* pPixels, uint32_t width, uint32_t height, uint8_t comp)
+	{
+		auto p = PutQOIHeader(pOut, width, height, comp);
+		p = QOIEncoder().Encode(p, pPixels, static_cast<size_t>(width) * height, comp, true);
+		memcpy(p, g_qoiPadding, sizeof(g_qoiPadding));
+
+		return p - pOut + sizeof(g_qoiPadding);
+	}
+
+	bool DecodeQOI(vector<uint8_t>& pixels, uint32_t& width, uint32_t& height, uint8_t& comp,
+		const uint8_t* pData, size_t size)
+	{
+		XUSG_N_RETURN(size >= g_qoiHeaderSize + sizeof(g_qoiPadding) && !memcmp(pData, "qoif", 4), false);
+
+		width = GetBigEndian(&pData[4]);
+		height = GetBigEndian(&pData[8]);
+		comp = pData[12];
+		XUSG_N_RETURN(width > 0 && height > 0 && (comp == 3 || comp == 4), false);
+
+		const auto numPixels = static_cast<size_t>(width) * height;
+		pixels.resize(numPixels * comp);
+
+		QOIPixel index[64] = {};
+		QOIPixel px = { 0, 0, 0, 255 };
+		const auto chunksEnd = size - sizeof(g_qoiPadding);
+		auto p = static_cast<size_t>(g_qoiHeaderSize);
+		uint8_t run = 0;
+		for (size_t i = 0; i < numPixels; ++i)
+		{
+			if (run > 0) --run;
+			else if (p < chunksEnd)
+			{
+				const auto b1 = pData[p++];
+				if (b1 == g_qoiOpRGB)
+				{
+					px.R = pData[p++]; px.G = pData[p++]; px.B = pData[p++];
+				}
+				else if (b1 == g_qoiOpRGBA)
+				{
+					px.R = pData[p++]; px.G = pData[p++]; px.B = pData[p++]; px.A = pData[p++];
+				}
+				else if ((b1 & g_qoiMask) == g_qoiOpIndex) px = index[b1];
+				else if ((b1 & g_qoiMask) == g_qoiOpDiff)
+				{
+					px.R += ((b1 >> 4) & 0x03) - 2;
+					px.G += ((b1 >> 2) & 0x03) - 2;
+					px.B += (b1 & 0x03) - 2;
+				}
+				else if ((b1 & g_qoiMask) == g_qoiOpLuma)
+				{
+					const auto b2 = pData[p++];
+					const auto vg = (b1 & 0x3f) - 32;
+					px.R += vg - 8 + ((b2 >> 4) & 0x0f);
+					px.G += vg;
+					px.B += vg - 8 + (b2 & 0x0f);
+				}
+				else run = b1 & 0x3f;
+
+				index[px.Hash()] = px;
+			}
+
+			const auto pDst = &pixels[comp * i];
+			pDst[0] = px.R;
+			pDst[1] = px.G;
+			pDst[2] = px.B;
+			if (comp == 4) pDst[3] = px.A;
+		}
+
+		return true;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// MappedFile
+//--------------------------------------------------------------------------------------
+
+MappedFile::MappedFile() :
+	m_file(INVALID_HANDLE_VALUE),
+	m_mapping(nullptr),
+	m_pData(nullptr),
+	m_size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Create(const char* fileName, size_t size)
+{
+	Close();
+	if (createMapping(fileName, size)) return true;
+	Close();
+
+	return false;
+}
+
+bool MappedFile::Open(const char* fileName)
+{
+	Close();
+	if (openMapping(fileName)) return true;
+	Close();
+
+	return false;
+}
+
+bool MappedFile::createMapping(const char* fileName, size_t size)
+{
+	XUSG_N_RETURN(size > 0, false);
+
+	m_file = CreateFileA(fileName, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	XUSG_N_RETURN(m_file != INVALID_HANDLE_VALUE, false);
+
+	// Creating the mapping extends the file to the requested size
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32),
+		static_cast<DWORD>(size), nullptr);
+	XUSG_N_RETURN(m_mapping, false);
+
+	m_pData = static_cast<uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, size));
+	XUSG_N_RETURN(m_pData, false);
+	m_size = size;
+
+	return true;
+}
+
+bool MappedFile::openMapping(const char* fileName)
+{
+	m_file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	XUSG_N_RETURN(m_file != INVALID_HANDLE_VALUE, false);
+
+	LARGE_INTEGER size;
+	XUSG_N_RETURN(GetFileSizeEx(m_file, &size) && size.QuadPart > 0, false);
+	m_size = static_cast<size_t>(size.QuadPart);
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	XUSG_N_RETURN(m_mapping, false);
+
+	m_pData = static_cast<uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	XUSG_N_RETURN(m_pData, false);
+
+	return true;
+}
+
+bool MappedFile::Close(size_t finalSize)
+{
+	auto result = true;
+
+	if (m_pData) UnmapViewOfFile(m_pData);
+	if (m_mapping) CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		if (finalSize < m_size)
+		{
+			LARGE_INTEGER offset;
+			offset.QuadPart = static_cast<LONGLONG>(finalSize);
+			result = SetFilePointerEx(m_file, offset, nullptr, FILE_BEGIN) && SetEndOfFile(m_file);
+		}
+		CloseHandle(m_file);
+	}
+
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = nullptr;
+
+	m_pData = nullptr;
+	m_size = 0;
+
+	return result;
+}
+
+uint8_t* MappedFile::GetData() const
+{
+	return m_pData;
+}
+
+size_t MappedFile::GetSize() const
+{
+	return m_size;
+}
+
+//--------------------------------------------------------------------------------------
+// ImageFile
+//--------------------------------------------------------------------------------------
+
+struct ImageFile::QOIState
+{
+	QOIEncoder	Encoder;
+	size_t		Size;	// Encoded so far, including the header
+};
+
+ImageFile::ImageFile() :
+	m_desc(),
+	m_format(OTHER),
+	m_pPixels(nullptr),
+	m_rowPitch(0),
+	m_isBottomUp(false),
+	m_isSwapped(false),
+	m_isWriting(false),
+	m_isStreamed(false),
+	m_isStreamValid(false),
+	m_numStreamed(0)
+{
+}
+
+ImageFile::~ImageFile()
+{
+	if (m_pPixels) Close();
+}
+
+bool ImageFile::Create(const char* fileName, const Desc& desc, bool isStreamed)
+{
+	if (m_pPixels) Close();
+	XUSG_N_RETURN(desc.Width > 0 && desc.Height > 0 && desc.Comp >= 1, false);
+	XUSG_N_RETURN(desc.Comp <= 4 || (GetFormat(fileName) == RAW && desc.Type == FLOAT32 && desc.Comp <= MaxRawComp), false);
+
+	m_fileName = fileName;
+	m_format = GetFormat(fileName);
+	m_desc = desc;
+	m_isBottomUp = false;
+	m_isSwapped = false;
+	m_isWriting = true;
+
+	// Fit the desc to the format
+	string header;
+	const auto w = to_string(desc.Width);
+	const auto h = to_string(desc.Height);
+	switch (m_format)
+	{
+	case PNG:
+		m_desc.Type = UNORM8;
+		break;
+	case QOI:
+		m_desc.Type = UNORM8;
+		m_desc.Comp = desc.Comp == 2 || desc.Comp == 4 ? 4 : 3;
+		break;
+	case PNM:
+	{
+		m_desc.Type = desc.Type == UNORM8 ? UNORM8 : UNORM16;
+		m_isSwapped = m_desc.Type == UNORM16; // PNM samples are big-endian
+		const auto maxVal = m_desc.Type == UNORM8 ? "255" : "65535";
+		if (m_desc.Comp == 1 || m_desc.Comp == 3)
+			header = string(m_desc.Comp == 1 ? "P5\n" : "P6\n") + w + " " + h + "\n" + maxVal + "\n";
+		else header = "P7\nWIDTH " + w + "\nHEIGHT " + h + "\nDEPTH " + to_string(m_desc.Comp) + "\nMAXVAL " + maxVal +
+			"\nTUPLTYPE " + (m_desc.Comp == 2 ? "GRAYSCALE_ALPHA" : "RGB_ALPHA") + "\nENDHDR\n";
+		break;
+	}
+	case PFM:
+		m_desc.Type = FLOAT32;
+		m_desc.Comp = desc.Comp <= 2 ? 1 : 3;
+		m_isBottomUp = true;
+		header = string(m_desc.Comp == 1 ? "Pf\n" : "PF\n") + w + " " + h + "\n-1.0\n"; // Negative scale: little-endian
+		break;
+	case RAW:
+	{
+		static const char* typeNames[] = { "unorm8", "unorm16", "float32" };
+		const auto json = "{\n\t\"width\": " + w + ",\n\t\"height\": " + h + ",\n\t\"channels\": " +
+			to_string(m_desc.Comp) + ",\n\t\"type\": \"" + typeNames[m_desc.Type] + "\"\n}\n";
+
+		FILE* pFile;
+		XUSG_N_RETURN(fopen_s(&pFile, (m_fileName + ".json").c_str(), "w") == 0 && pFile, false);
+		const auto written = fwrite(json.data(), 1, json.size(), pFile);
+		fclose(pFile);
+		XUSG_N_RETURN(written == json.size(), false);
+		break;
+	}
+	default:
+		return false;
+	}
+
+	m_rowPitch = static_cast<size_t>(GetElementSize(m_desc.Type)) * m_desc.Comp * m_desc.Width;
+	const auto imageSize = m_rowPitch * m_desc.Height;
+
+	// Compressed formats are encoded from memory on Close(), or row by row if streamed
+	if ((m_format == PNG || m_format == QOI) && isStreamed)
+	{
+		m_isStreamed = true;
+		m_isStreamValid = true;
+		m_numStreamed = 0;
+		m_buffer.resize(m_rowPitch);
+		m_pPixels = m_buffer.data();
+
+		if (m_format == PNG)
+		{
+			m_pngStream = make_unique<PNGStream>();
+
+			return m_pngStream->Open(fileName, m_desc.Width, m_desc.Height, m_desc.Comp);
+		}
+
+		// Encode straight into a mapping of the worst-case size, truncated on Close()
+		XUSG_N_RETURN(m_mappedFile.Create(fileName, GetMaxQOISize(m_desc.Width, m_desc.Height, m_desc.Comp)), false);
+		m_qoiState = make_unique<QOIState>();
+		m_qoiState->Size = PutQOIHeader(m_mappedFile.GetData(), m_desc.Width, m_desc.Height, m_desc.Comp) - m_mappedFile.GetData();
+
+		return true;
+	}
+
+	if (m_format == PNG || m_format == QOI)
+	{
+		m_buffer.resize(imageSize);
+		m_pPixels = m_buffer.data();
+
+		return true;
+	}
+
+	XUSG_N_RETURN(m_mappedFile.Create(fileName, header.size() + imageSize), false);
+	memcpy(m_mappedFile.GetData(), header.data(), header.size());
+	m_pPixels = m_mappedFile.GetData() + header.size();
+
+	return true;
+}
+
+bool ImageFile::Create(const Desc& desc)
+{
+	XUSG_N_RETURN(desc.Width > 0 && desc.Height > 0 && desc.Comp >= 1 && desc.Comp <= MaxRawComp, false);
+
+	// Reuse the buffer, e.g. for the frames of a video
+	if (m_pPixels && m_fileName.empty() && m_desc.Width == desc.Width && m_desc.Height == desc.Height &&
+		m_desc.Comp == desc.Comp && m_desc.Type == desc.Type) return true;
+
+	if (m_pPixels) Close();
+	m_fileName.clear();
+	m_format = RAW;
+	m_desc = desc;
+	m_isBottomUp = false;
+	m_isSwapped = false;
+	m_rowPitch = static_cast<size_t>(GetElementSize(m_desc.Type)) * m_desc.Comp * m_desc.Width;
+	m_buffer.resize(m_rowPitch * m_desc.Height);
+	m_pPixels = m_buffer.data();
+
+	return true;
+}
+
+bool ImageFile::Open(const char* fileName)
+{
+	if (m_pPixels) Close();
+	XUSG_N_RETURN(m_mappedFile.Open(fileName), false);
+
+	return open(fileName, m_mappedFile.GetData(), m_mappedFile.GetSize());
+}
+
+bool ImageFile::Open(const char* fileName, vector<uint8_t>&& fileData)
+{
+	if (m_pPixels) Close();
+	m_fileData = move(fileData);
+
+	return open(fileName, m_fileData.data(), m_fileData.size());
+}
+
+bool ImageFile::Close()
+{
+	auto result = true;
+	if (m_isWriting && m_isStreamed)
+	{
+		result = m_isStreamValid && m_numStreamed == m_desc.Height;
+		if (m_format == PNG) result = m_pngStream->Close() && result;
+		else
+		{
+			const auto pEnd = m_mappedFile.GetData() + m_qoiState->Size;
+			memcpy(pEnd, g_qoiPadding, sizeof(g_qoiPadding));
+			result = m_mappedFile.Close(m_qoiState->Size + sizeof(g_qoiPadding)) && result;
+		}
+	}
+	else if (m_isWriting)
+	{
+		if (m_format == PNG) result = PNGEncoder().Write(m_fileName.c_str(), m_buffer.data(), m_desc.Width, m_desc.Height, m_desc.Comp);
+		else if (m_format == QOI) result = encodeQOI();
+	}
+
+	result = m_mappedFile.Close() && result;
+	m_fileData.clear();
+	m_buffer.clear();
+	m_pngStream.reset();
+	m_qoiState.reset();
+	m_pPixels = nullptr;
+	m_isWriting = false;
+	m_isStreamed = false;
+
+	return result;
+}
+
+bool ImageFile::Close(vector<uint8_t>& fileData, const PNGEncoder* pPNGEncoder)
+{
+	auto result = true;
+	fileData.clear();
+	if (m_isWriting && !m_isStreamed)
+	{
+		if (m_format == PNG)
+			result = (pPNGEncoder ? *pPNGEncoder : PNGEncoder()).Encode(fileData,
+				m_buffer.data(), m_desc.Width, m_desc.Height, m_desc.Comp);
+		else if (m_format == QOI)
+		{
+			fileData.resize(GetMaxQOISize(m_desc.Width, m_desc.Height, m_desc.Comp));
+			fileData.resize(EncodeQOI(fileData.data(), m_buffer.data(), m_desc.Width, m_desc.Height, m_desc.Comp));
+		}
+		m_isWriting = false;
+	}
+
+	return Close() && result;
+}
+
+void ImageFile::WriteRows(uint32_t y, uint32_t numRows, const uint8_t* pSrc, size_t srcRowPitch, uint8_t srcComp)
+{
+	writeRows(y, numRows, pSrc, srcRowPitch, srcComp);
+}
+
+void ImageFile::WriteRows(uint32_t y, uint32_t numRows, const float* pSrc, size_t srcRowPitch, uint8_t srcComp)
+{
+	writeRows(y, numRows, pSrc, srcRowPitch, srcComp);
+}
+
+void ImageFile::ReadRows(uint32_t y, uint32_t numRows, uint8_t* pDst, size_t dstRowPitch, uint8_t dstComp) const
+{
+	readRows(y, numRows, pDst, dstRowPitch, dstComp);
+}
+
+void ImageFile::ReadRows(uint32_t y, uint32_t numRows, float* pDst, size_t dstRowPitch, uint8_t dstComp) const
+{
+	readRows(y, numRows, pDst, dstRowPitch, dstComp);
+}
+
+uint8_t* ImageFile::GetRow(uint32_t y) const
+{
+	assert(m_pPixels && !m_isStreamed && y < m_desc.Height);
+
+	return &m_pPixels[m_rowPitch * (m_isBottomUp ? m_desc.Height - 1 - y : y)];
+}
+
+const ImageFile::Desc& ImageFile::GetDesc() const
+{
+	return m_desc;
+}
+
+ImageFile::Format ImageFile::GetFormat() const
+{
+	return m_format;
+}
+
+ImageFile::Format ImageFile::GetFormat(const char* fileName)
+{
+	const auto pExt = strrchr(fileName, '.');
+	if (!pExt) return OTHER;
+
+	string ext(pExt + 1);
+	transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+
+	if (ext == "png") return PNG;
+	if (ext == "ppm" || ext == "pgm" || ext == "pam" || ext == "pnm") return PNM;
+	if (ext == "pfm") return PFM;
+	if (ext == "raw") return RAW;
+	if (ext == "qoi") return QOI;
+
+	return OTHER;
+}
+
+bool ImageFile::ReadDesc(Desc& desc, const char* fileName, const uint8_t* pData, size_t size)
+{
+	switch (GetFormat(fileName))
+	{
+	case QOI:
+		XUSG_N_RETURN(size >= g_qoiHeaderSize && !memcmp(pData, "qoif", 4), false);
+		desc.Width = GetBigEndian(&pData[4]);
+		desc.Height = GetBigEndian(&pData[8]);
+		desc.Comp = pData[12];
+		desc.Type = UNORM8;
+
+		return true;
+	case PNG:
+	case OTHER:
+	{
+		const auto len = static_cast<int>(size);
+		int w, h, comp;
+		XUSG_N_RETURN(stbi_info_from_memory(pData, len, &w, &h, &comp), false);
+		desc.Width = static_cast<uint32_t>(w);
+		desc.Height = static_cast<uint32_t>(h);
+		desc.Comp = static_cast<uint8_t>(comp);
+		desc.Type = stbi_is_hdr_from_memory(pData, len) ? FLOAT32 :
+			(stbi_is_16_bit_from_memory(pData, len) ? UNORM16 : UNORM8);
+
+		return true;
+	}
+	default:
+	{
+		// Uncompressed formats are parsed in place, without touching the pixels
+		ImageFile imageFile;
+		XUSG_N_RETURN(imageFile.open(fileName, const_cast<uint8_t*>(pData), size), false);
+		desc = imageFile.m_desc;
+
+		return true;
+	}
+	}
+}
+
+uint8_t ImageFile::GetElementSize(PixelType type)
+{
+	static const uint8_t elementSizes[] = { 1, 2, 4 };
+
+	return elementSizes[type];
+}
+
+template<typename TSrc>
+void ImageFile::writeRows(uint32_t y, uint32_t numRows, const TSrc* pSrc, size_t srcRowPitch, uint8_t srcComp)
+{
+	assert(m_isWriting && y + numRows <= m_desc.Height && m_desc.Comp <= 4);
+
+	const auto pSrcBytes = reinterpret_cast<const uint8_t*>(pSrc);
+	const auto numElements = static_cast<size_t>(m_desc.Comp) * m_desc.Width;
+	for (auto i = 0u; i < numRows; ++i)
+	{
+		const auto pSrcRow = reinterpret_cast<const TSrc*>(&pSrcBytes[srcRowPitch * i]);
+		const auto pDstRow = m_isStreamed ? m_buffer.data() : GetRow(y + i);
+		switch (m_desc.Type)
+		{
+		case UNORM8:
+			ConvertRow(pDstRow, m_desc.Comp, pSrcRow, srcComp, m_desc.Width);
+			break;
+		case UNORM16:
+			ConvertRow(reinterpret_cast<uint16_t*>(pDstRow), m_desc.Comp, pSrcRow, srcComp, m_desc.Width);
+			break;
+		default:
+			ConvertRow(reinterpret_cast<float*>(pDstRow), m_desc.Comp, pSrcRow, srcComp, m_desc.Width);
+		}
+
+		if (m_isSwapped) SwapBytes(pDstRow, numElements, GetElementSize(m_desc.Type));
+		if (m_isStreamed) writeStreamed(y + i);
+	}
+}
+
+template<typename TDst>
+void ImageFile::readRows(uint32_t y, uint32_t numRows, TDst* pDst, size_t dstRowPitch, uint8_t dstComp) const
+{
+	assert(y + numRows <= m_desc.Height);
+
+	const auto pDstBytes = reinterpret_cast<uint8_t*>(pDst);
+	const auto numElements = static_cast<size_t>(m_desc.Comp) * m_desc.Width;
+	vector<uint8_t> swapped(m_isSwapped ? m_rowPitch : 0);
+	for (auto i = 0u; i < numRows; ++i)
+	{
+		auto pSrcRow = GetRow(y + i);
+		if (m_isSwapped)
+		{
+			memcpy(swapped.data(), pSrcRow, m_rowPitch);
+			SwapBytes(swapped.data(), numElements, GetElementSize(m_desc.Type));
+			pSrcRow = swapped.data();
+		}
+
+		const auto pDstRow = reinterpret_cast<TDst*>(&pDstBytes[dstRowPitch * i]);
+		switch (m_desc.Type)
+		{
+		case UNORM8:
+			ConvertRow(pDstRow, dstComp, pSrcRow, m_desc.Comp, m_desc.Width);
+			break;
+		case UNORM16:
+			ConvertRow(pDstRow, dstComp, reinterpret_cast<const uint16_t*>(pSrcRow), m_desc.Comp, m_desc.Width);
+			break;
+		default:
+			ConvertRow(pDstRow, dstComp, reinterpret_cast<const float*>(pSrcRow), m_desc.Comp, m_desc.Width);
+		}
+	}
+}
+
+bool ImageFile::open(const char* fileName, uint8_t* pData, size_t size)
+{
+	m_fileName = fileName;
+	m_format = GetFormat(fileName);
+	m_isBottomUp = false;
+	m_isSwapped = false;
+	m_isWriting = false;
+
+	bool result;
+	switch (m_format)
+	{
+	case PNM:
+		result = openPNM(pData, size);
+		break;
+	case PFM:
+		result = openPFM(pData, size);
+		break;
+	case RAW:
+		result = openRAW(pData, size);
+		break;
+	case QOI:
+		result = openQOI(pData, size);
+		break;
+	default:
+		result = openOther(pData, size);
+	}
+
+	// Decoded formats no longer need the file data
+	if (!result || m_pPixels == m_buffer.data())
+	{
+		m_mappedFile.Close();
+		m_fileData = vector<uint8_t>();
+	}
+
+	if (!result) m_pPixels = nullptr;
+
+	return result;
+}
+
+bool ImageFile::openPNM(uint8_t* pData, size_t size)
+{
+	const auto pText = reinterpret_cast<const char*>(pData);
+	size_t pos = 0;
+	const auto nextToken = [&]()
+	{
+		// Skip white spaces and comments
+		while (pos < size)
+		{
+			if (pText[pos] == '#') while (pos < size && pText[pos] != '\n') ++pos;
+			else if (isspace(static_cast<uint8_t>(pText[pos]))) ++pos;
+			else break;
+		}
+
+		const auto start = pos;
+		while (pos < size && !isspace(static_cast<uint8_t>(pText[pos]))) ++pos;
+
+		return string(&pText[start], pos - start);
+	};
+
+	const auto toUInt = [](const string& token) { return static_cast<uint32_t>(strtoul(token.c_str(), nullptr, 10)); };
+
+	const auto magic = nextToken();
+	uint32_t maxVal = 0;
+	if (magic == "P5" || magic == "P6")
+	{
+		m_desc.Width = toUInt(nextToken());
+		m_desc.Height = toUInt(nextToken());
+		maxVal = toUInt(nextToken());
+		m_desc.Comp = magic == "P5" ? 1 : 3;
+	}
+	else if (magic == "P7")
+	{
+		m_desc.Comp = 0;
+		for (auto token = nextToken(); !token.empty() && token != "ENDHDR"; token = nextToken())
+		{
+			if (token == "WIDTH") m_desc.Width = toUInt(nextToken());
+			else if (token == "HEIGHT") m_desc.Height = toUInt(nextToken());
+			else if (token == "DEPTH") m_desc.Comp = static_cast<uint8_t>(toUInt(nextToken()));
+			else if (token == "MAXVAL") maxVal = toUInt(nextToken());
+			else if (token == "TUPLTYPE") nextToken();
+		}
+	}
+	else return false;
+	++pos; // Single white space before the raster
+
+	XUSG_N_RETURN(maxVal == 255 || maxVal == 65535, false);
+	XUSG_N_RETURN(m_desc.Width > 0 && m_desc.Height > 0 && m_desc.Comp >= 1 && m_desc.Comp <= 4, false);
+	m_desc.Type = maxVal == 255 ? UNORM8 : UNORM16;
+	m_isSwapped = m_desc.Type == UNORM16;
+
+	m_rowPitch = static_cast<size_t>(GetElementSize(m_desc.Type)) * m_desc.Comp * m_desc.Width;
+	XUSG_N_RETURN(pos + m_rowPitch * m_desc.Height <= size, false);
+	m_pPixels = pData + pos;
+
+	return true;
+}
+
+bool ImageFile::openPFM(uint8_t* pData, size_t size)
+{
+	const auto pText = reinterpret_cast<const char*>(pData);
+	size_t pos = 0;
+	const auto nextToken = [&]()
+	{
+		while (pos < size && isspace(static_cast<uint8_t>(pText[pos]))) ++pos;
+		const auto start = pos;
+		while (pos < size && !isspace(static_cast<uint8_t>(pText[pos]))) ++pos;
+
+		return string(&pText[start], pos - start);
+	};
+
+	const auto magic = nextToken();
+	XUSG_N_RETURN(magic == "PF" || magic == "Pf", false);
+	m_desc.Width = static_cast<uint32_t>(strtoul(nextToken().c_str(), nullptr, 10));
+	m_desc.Height = static_cast<uint32_t>(strtoul(nextToken().c_str(), nullptr, 10));
+	const auto scale = strtod(nextToken().c_str(), nullptr);
+	++pos;
+
+	XUSG_N_RETURN(m_desc.Width > 0 && m_desc.Height > 0 && scale != 0.0, false);
+	m_desc.Comp = magic == "PF" ? 3 : 1;
+	m_desc.Type = FLOAT32;
+	m_isBottomUp = true;
+	m_isSwapped = scale > 0.0; // Positive scale: big-endian
+
+	m_rowPitch = sizeof(float) * m_desc.Comp * m_desc.Width;
+	XUSG_N_RETURN(pos + m_rowPitch * m_desc.Height <= size, false);
+	m_pPixels = pData + pos;
+
+	return true;
+}
+
+bool ImageFile::openRAW(uint8_t* pData, size_t size)
+{
+	// Parse the sidecar descriptor
+	string json;
+	{
+		FILE* pFile;
+		XUSG_N_RETURN(fopen_s(&pFile, (m_fileName + ".json").c_str(), "r") == 0 && pFile, false);
+		char buffer[256];
+		for (size_t n; (n = fread(buffer, 1, sizeof(buffer), pFile)) > 0;) json.append(buffer, n);
+		fclose(pFile);
+	}
+
+	const auto getValue = [&json](const char* key)
+	{
+		auto pos = json.find(string("\"") + key + "\"");
+		if (pos == string::npos) return string();
+		pos = json.find(':', pos);
+		if (pos == string::npos) return string();
+		pos = json.find_first_not_of(" \t\r\n\"", pos + 1);
+		if (pos == string::npos) return string();
+		const auto end = json.find_first_of(" \t\r\n\",}", pos);
+
+		return json.substr(pos, end - pos);
+	};
+
+	m_desc.Width = static_cast<uint32_t>(strtoul(getValue("width").c_str(), nullptr, 10));
+	m_desc.Height = static_cast<uint32_t>(strtoul(getValue("height").c_str(), nullptr, 10));
+	m_desc.Comp = static_cast<uint8_t>(strtoul(getValue("channels").c_str(), nullptr, 10));
+	const auto type = getValue("type");
+	if (type == "unorm8") m_desc.Type = UNORM8;
+	else if (type == "unorm16") m_desc.Type = UNORM16;
+	else if (type == "float32") m_desc.Type = FLOAT32;
+	else return false;
+	XUSG_N_RETURN(m_desc.Width > 0 && m_desc.Height > 0 && m_desc.Comp >= 1, false);
+	XUSG_N_RETURN(m_desc.Comp <= 4 || (m_desc.Type == FLOAT32 && m_desc.Comp <= MaxRawComp), false);
+
+	m_rowPitch = static_cast<size_t>(GetElementSize(m_desc.Type)) * m_desc.Comp * m_desc.Width;
+	XUSG_N_RETURN(m_rowPitch * m_desc.Height <= size, false);
+	m_pPixels = pData;
+
+	return true;
+}
+
+bool ImageFile::openQOI(const uint8_t* pData, size_t size)
+{
+	XUSG_N_RETURN(DecodeQOI(m_buffer, m_desc.Width, m_desc.Height, m_desc.Comp, pData, size), false);
+
+	m_desc.Type = UNORM8;
+	m_rowPitch = static_cast<size_t>(m_desc.Comp) * m_desc.Width;
+	m_pPixels = m_buffer.data();
+
+	return true;
+}
+
+bool ImageFile::openOther(const uint8_t* pData, size_t size)
+{
+	const auto len = static_cast<int>(size);
+	int w, h, comp;
+	void* pImage;
+	if (stbi_is_hdr_from_memory(pData, len))
+	{
+		pImage = stbi_loadf_from_memory(pData, len, &w, &h, &comp, 0);
+		m_desc.Type = FLOAT32;
+	}
+	else if (stbi_is_16_bit_from_memory(pData, len))
+	{
+		pImage = stbi_load_16_from_memory(pData, len, &w, &h, &comp, 0);
+		m_desc.Type = UNORM16;
+	}
+	else
+	{
+		pImage = stbi_load_from_memory(pData, len, &w, &h, &comp, 0);
+		m_desc.Type = UNORM8;
+	}
+	XUSG_N_RETURN(pImage, false);
+
+	m_desc.Width = static_cast<uint32_t>(w);
+	m_desc.Height = static_cast<uint32_t>(h);
+	m_desc.Comp = static_cast<uint8_t>(comp);
+	m_rowPitch = static_cast<size_t>(GetElementSize(m_desc.Type)) * m_desc.Comp * m_desc.Width;
+
+	const auto pBytes = static_cast<const uint8_t*>(pImage);
+	m_buffer.assign(pBytes, pBytes + m_rowPitch * m_desc.Height);
+	stbi_image_free(pImage);
+	m_pPixels = m_buffer.data();
+
+	return true;
+}
+
+bool ImageFile::encodeQOI()
+{
+	// Encode straight into a mapping of the worst-case size, then truncate
+	XUSG_N_RETURN(m_mappedFile.Create(m_fileName.c_str(), GetMaxQOISize(m_desc.Width, m_desc.Height, m_desc.Comp)), false);
+	const auto size = EncodeQOI(m_mappedFile.GetData(), m_buffer.data(), m_desc.Width, m_desc.Height, m_desc.Comp);
+
+	return m_mappedFile.Close(size);
+}
+
+void ImageFile::writeStreamed(uint32_t y)
+{
+	// Rows out of order fail the file on Close()
+	m_isStreamValid = m_isStreamValid && y == m_numStreamed++;
+	if (!m_isStreamValid) return;
+
+	if (m_format == PNG) m_isStreamValid = m_pngStream->WriteRows(m_buffer.data(), 1);
+	else
+	{
+		const auto pData = m_mappedFile.GetData();
+		const auto p = m_qoiState->Encoder.Encode(pData + m_qoiState->Size, m_buffer.data(),
+			m_desc.Width, m_desc.Comp, m_numStreamed == m_desc.Height);
+		m_qoiState->Size = p - pData;
+	}
+}
@@ -0,0 +1,135 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+class PNGEncoder;
+class PNGStream;
+
+// Read-only or read-write mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile();
+	virtual ~MappedFile();
+
+	bool Create(const char* fileName, size_t size);
+	bool Open(const char* fileName);
+	bool Close(size_t finalSize = SIZE_MAX);	// Optionally truncates a created file
+
+	uint8_t* GetData() const;
+	size_t GetSize() const;
+
+protected:
+	bool createMapping(const char* fileName, size_t size);
+	bool openMapping(const char* fileName);
+
+	HANDLE		m_file;
+	HANDLE		m_mapping;
+	uint8_t*	m_pData;
+	size_t		m_size;
+};
+
+// Row-based image file access with format conversion. Uncompressed formats (PNM, PFM
+// and raw with a JSON sidecar) are memory mapped, so rows are converted straight from
+// or into the file mapping; PNG and QOI are buffered and encoded on Close(), unless the
+// file is created streamed, in which case they are encoded as the rows are written in order.
+// Float raw files may hold more than 4 channels, whose rows are only written through GetRow().
+class ImageFile
+{
+public:
+	enum Format : uint8_t
+	{
+		PNG,
+		PNM,	// PGM/PPM (P5/P6), or PAM (P7) with alpha
+		PFM,
+		RAW,	// Headerless pixels, described by <fileName>.json
+		QOI,
+		OTHER,	// Read-only through stb_image
+
+		NUM_FORMAT
+	};
+
+	enum PixelType : uint8_t
+	{
+		UNORM8,
+		UNORM16,
+		FLOAT32,
+
+		NUM_PIXEL_TYPE
+	};
+
+	struct Desc
+	{
+		uint32_t	Width;
+		uint32_t	Height;
+		uint8_t		Comp;
+		PixelType	Type;
+	};
+
+	ImageFile();
+	virtual ~ImageFile();
+
+	// The format is chosen from the extension; the desc is adjusted to what the format can store.
+	// Streamed files take rows in order only, and have no GetRow() unless mapped.
+	bool Create(const char* fileName, const Desc& desc, bool isStreamed = false);
+	bool Create(const Desc& desc);	// Pixels in memory only, with no file; kept as is while the desc is unchanged
+	bool Open(const char* fileName);
+	bool Open(const char* fileName, std::vector<uint8_t>&& fileData);	// From file data already in memory
+	bool Close();
+	bool Close(std::vector<uint8_t>& fileData, const PNGEncoder* pPNGEncoder = nullptr);	// PNG and QOI are encoded into fileData instead of the file, unless streamed
+
+	void WriteRows(uint32_t y, uint32_t numRows, const uint8_t* pSrc, size_t srcRowPitch, uint8_t srcComp);
+	void WriteRows(uint32_t y, uint32_t numRows, const float* pSrc, size_t srcRowPitch, uint8_t srcComp);
+	void ReadRows(uint32_t y, uint32_t numRows, uint8_t* pDst, size_t dstRowPitch, uint8_t dstComp) const;
+	void ReadRows(uint32_t y, uint32_t numRows, float* pDst, size_t dstRowPitch, uint8_t dstComp) const;
+
+	// Row in the file's own layout (see GetDesc()), e.g. for storing results in place;
+	// 16-bit PNM and big-endian PFM rows are byte-swapped relative to the host.
+	uint8_t* GetRow(uint32_t y) const;
+
+	const Desc& GetDesc() const;
+	Format GetFormat() const;
+
+	static Format GetFormat(const char* fileName);
+	static bool ReadDesc(Desc& desc, const char* fileName, const uint8_t* pData, size_t size);	// From the header only
+	static uint8_t GetElementSize(PixelType type);
+
+	static const uint8_t MaxRawComp = 64;
+
+protected:
+	struct QOIState;
+
+	template<typename TSrc>
+	void writeRows(uint32_t y, uint32_t numRows, const TSrc* pSrc, size_t srcRowPitch, uint8_t srcComp);
+	template<typename TDst>
+	void readRows(uint32_t y, uint32_t numRows, TDst* pDst, size_t dstRowPitch, uint8_t dstComp) const;
+
+	bool open(const char* fileName, uint8_t* pData, size_t size);
+	bool openPNM(uint8_t* pData, size_t size);
+	bool openPFM(uint8_t* pData, size_t size);
+	bool openRAW(uint8_t* pData, size_t size);
+	bool openQOI(const uint8_t* pData, size_t size);
+	bool openOther(const uint8_t* pData, size_t size);
+	bool encodeQOI();
+	void writeStreamed(uint32_t y);
+
+	std::string				m_fileName;
+	MappedFile				m_mappedFile;
+	std::vector<uint8_t>	m_fileData;
+	std::vector<uint8_t>	m_buffer;	// The whole image, or a row if streamed
+	std::unique_ptr<PNGStream> m_pngStream;
+	std::unique_ptr<QOIState> m_qoiState;
+
+	Desc					m_desc;
+	Format					m_format;
+	uint8_t*				m_pPixels;
+	size_t					m_rowPitch;
+	bool					m_isBottomUp;
+	bool					m_isSwapped;
+	bool					m_isWriting;
+	bool					m_isStreamed;
+	bool					m_isStreamValid;
+	uint32_t				m_numStreamed;	// Rows written so far, if streamed
+};
@@ -0,0 +1,207 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "ImageWriter.h"
+
+#if defined(_M_X64) || defined(__SSSE3__)
+#include <tmmintrin.h>
+#define _SSSE3_DEPITCH_
+#endif
+
+using namespace std;
+
+ImageWriter::ImageWriter() :
+	m_maxBuffers(2),
+	m_numBuffers(0),
+	m_isBusy(false),
+	m_isQuitting(false),
+	m_succeeded(true)
+{
+}
+
+ImageWriter::~ImageWriter()
+{
+	if (m_worker.joinable())
+	{
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_isQuitting = true;
+		}
+		m_jobReady.notify_one();
+		m_worker.join();
+	}
+}
+
+bool ImageWriter::Init(uint8_t maxPendingImages, PNGEncoder::Preset pngPreset, uint8_t numEncoderThreads)
+{
+	assert(!m_worker.joinable());
+	m_pngEncoder = PNGEncoder(pngPreset, numEncoderThreads);
+	m_maxBuffers = (max)(maxPendingImages, static_cast<uint8_t>(1));
+	m_worker = thread(&ImageWriter::workerMain, this);
+
+	return true;
+}
+
+bool ImageWriter::Write(const char* fileName, const void* pData, uint32_t width, uint32_t height,
+	uint32_t rowPitch, uint8_t comp, uint8_t srcComp)
+{
+	assert(comp <= srcComp);
+
+	auto imageData = AcquireBuffer(static_cast<size_t>(comp) * width * height);
+	Depitch(imageData.data(), static_cast<const uint8_t*>(pData), width, height, rowPitch, comp, srcComp);
+
+	return Submit(fileName, move(imageData), width, height, comp);
+}
+
+vector<uint8_t> ImageWriter::AcquireBuffer(size_t size)
+{
+	vector<uint8_t> buffer;
+	{
+		// Block while all buffers are in flight, so that memory stays bounded
+		unique_lock<mutex> lock(m_mutex);
+		m_bufferReady.wait(lock, [this] { return !m_freeBuffers.empty() || m_numBuffers < m_maxBuffers; });
+		if (m_freeBuffers.empty()) ++m_numBuffers;
+		else
+		{
+			buffer = move(m_freeBuffers.back());
+			m_freeBuffers.pop_back();
+		}
+	}
+
+	buffer.resize(size);
+
+	return buffer;
+}
+
+bool ImageWriter::Submit(const char* fileName, vector<uint8_t>&& imageData,
+	uint32_t width, uint32_t height, uint8_t comp)
+{
+	if (!m_worker.joinable())
+	{
+		releaseBuffer(move(imageData));
+
+		return false;
+	}
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_jobs.push_back({ fileName, move(imageData), width, height, comp });
+	}
+	m_jobReady.notify_one();
+
+	return true;
+}
+
+bool ImageWriter::Flush()
+{
+	unique_lock<mutex> lock(m_mutex);
+	m_idle.wait(lock, [this] { return m_jobs.empty() && !m_isBusy; });
+	const auto succeeded = m_succeeded;
+	m_succeeded = true;
+
+	return succeeded;
+}
+
+void ImageWriter::Depitch(uint8_t* pDst, const uint8_t* pSrc, uint32_t width, uint32_t height,
+	uint32_t rowPitch, uint8_t comp, uint8_t srcComp)
+{
+	const auto dstRowSize = static_cast<size_t>(comp) * width;
+
+	// Same layout, only the row padding needs to be removed
+	if (comp == srcComp)
+	{
+		for (auto i = 0u; i < height; ++i)
+			memcpy(&pDst[dstRowSize * i], &pSrc[static_cast<size_t>(rowPitch) * i], dstRowSize);
+
+		return;
+	}
+
+	for (auto i = 0u; i < height; ++i)
+	{
+		const auto pSrcRow = &pSrc[static_cast<size_t>(rowPitch) * i];
+		const auto pDstRow = &pDst[dstRowSize * i];
+		auto j = 0u;
+
+#ifdef _SSSE3_DEPITCH_
+		// RGBA to RGB, 4 pixels per iteration; the 16-byte store overlaps the next
+		// 4 bytes, so the last 2 pixels of the row are always left to the scalar loop.
+		if (srcComp == 4 && comp == 3)
+		{
+			const auto shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+			for (; j + 6 <= width; j += 4)
+			{
+				const auto pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&pSrcRow[4 * j]));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&pDstRow[3 * j]), _mm_shuffle_epi8(pixels, shuffle));
+			}
+		}
+#endif
+
+		for (; j < width; ++j)
+			for (uint8_t k = 0; k < comp; ++k)
+				pDstRow[comp * j + k] = pSrcRow[srcComp * j + k];
+	}
+}
+
+void ImageWriter::workerMain()
+{
+	for (;;)
+	{
+		Job job;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_jobReady.wait(lock, [this] { return !m_jobs.empty() || m_isQuitting; });
+			if (m_jobs.empty()) break; // Quitting with no pending jobs
+
+			job = move(m_jobs.front());
+			m_jobs.pop_front();
+			m_isBusy = true;
+		}
+
+		const auto succeeded = encode(job);
+		releaseBuffer(move(job.ImageData));
+
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_succeeded = m_succeeded && succeeded;
+			m_isBusy = false;
+		}
+		m_idle.notify_all();
+	}
+}
+
+bool ImageWriter::encode(const Job& job)
+{
+	// Formats that cannot be written, e.g. JPEG, are saved as PNG
+	const auto format = ImageFile::GetFormat(job.FileName.c_str());
+	if (format == ImageFile::PNG || format == ImageFile::OTHER)
+	{
+		auto fileName = job.FileName;
+		if (format == ImageFile::OTHER)
+		{
+			const auto nameStart = fileName.find_last_of("/\\") + 1;
+			const auto extStart = fileName.find_last_of('.');
+			if (extStart != string::npos && extStart > nameStart) fileName.resize(extStart);
+			fileName += ".png";
+		}
+
+		return m_pngEncoder.Write(fileName.c_str(), job.ImageData.data(), job.Width, job.Height, job.Comp);
+	}
+
+	// Uncompressed formats need no encoding: rows are converted straight into the file mapping
+	ImageFile file;
+	const ImageFile::Desc desc = { job.Width, job.Height, job.Comp, ImageFile::UNORM8 };
+	XUSG_N_RETURN(file.Create(job.FileName.c_str(), desc), false);
+	file.WriteRows(0, job.Height, job.ImageData.data(), static_cast<size_t>(job.Comp) * job.Width, job.Comp);
+
+	return file.Close();
+}
+
+void ImageWriter::releaseBuffer(vector<uint8_t>&& buffer)
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_freeBuffers.emplace_back(move(buffer));
+	}
+	m_bufferReady.notify_one();
+}
@@ -0,0 +1,67 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "PNGEncoder.h"
+#include "ImageFile.h"
+
+// Background image writer: encoding and file output run on a worker thread,
+// so that the caller (frame loop or CPU filter) can continue with the next frame.
+class ImageWriter
+{
+public:
+	ImageWriter();
+	virtual ~ImageWriter();
+
+	bool Init(uint8_t maxPendingImages = 2, PNGEncoder::Preset pngPreset = PNGEncoder::DEFAULT,
+		uint8_t numEncoderThreads = 0);
+
+	// Copy a pitched image (e.g. a mapped read-back buffer) into a pooled buffer and enqueue it;
+	// formats that cannot be written, e.g. JPEG, are saved as PNG.
+	bool Write(const char* fileName, const void* pData, uint32_t width, uint32_t height,
+		uint32_t rowPitch, uint8_t comp = 3, uint8_t srcComp = 4);
+
+	// Zero-copy path: fill a buffer from AcquireBuffer() tightly packed and submit it
+	std::vector<uint8_t> AcquireBuffer(size_t size);
+	bool Submit(const char* fileName, std::vector<uint8_t>&& imageData,
+		uint32_t width, uint32_t height, uint8_t comp);
+
+	// Wait until all pending images are written; returns false if any of them failed
+	bool Flush();
+
+	static void Depitch(uint8_t* pDst, const uint8_t* pSrc, uint32_t width, uint32_t height,
+		uint32_t rowPitch, uint8_t comp, uint8_t srcComp);
+
+protected:
+	struct Job
+	{
+		std::string				FileName;
+		std::vector<uint8_t>	ImageData;
+		uint32_t				Width;
+		uint32_t				Height;
+		uint8_t					Comp;
+	};
+
+	void workerMain();
+	bool encode(const Job& job);
+	void releaseBuffer(std::vector<uint8_t>&& buffer);
+
+	PNGEncoder					m_pngEncoder;
+
+	std::thread					m_worker;
+	std::mutex					m_mutex;
+	std::condition_variable		m_jobReady;
+	std::condition_variable		m_bufferReady;
+	std::condition_variable		m_idle;
+
+	std::deque<Job>				m_jobs;
+	std::vector<std::vector<uint8_t>> m_freeBuffers;
+
+	uint8_t						m_maxBuffers;
+	uint8_t						m_numBuffers;
+	bool						m_isBusy;
+	bool						m_isQuitting;
+	bool						m_succeeded;
+};
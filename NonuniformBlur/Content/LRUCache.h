@@ -0,0 +1,112 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Least-recently-used cache with a capacity in entries; not thread safe
+template<typename TKey, typename TValue>
+class LRUCache
+{
+public:
+	LRUCache(size_t capacity = 64);
+	virtual ~LRUCache();
+
+	void SetCapacity(size_t capacity);
+
+	// Marks the entry as the most recently used if found
+	bool Find(const TKey& key, TValue& value);
+	bool Contains(const TKey& key) const;
+
+	// Evicts the least recently used entries beyond the capacity
+	void Insert(const TKey& key, const TValue& value);
+	void Clear();
+
+	size_t GetSize() const;
+
+protected:
+	using Entry = std::pair<TKey, TValue>;
+
+	void evict();
+
+	std::list<Entry>	m_entries;	// Most recently used first
+	std::unordered_map<TKey, typename std::list<Entry>::iterator> m_index;
+
+	size_t				m_capacity;
+};
+
+template<typename TKey, typename TValue>
+LRUCache<TKey, TValue>::LRUCache(size_t capacity) :
+	m_capacity((std::max)(capacity, static_cast<size_t>(1)))
+{
+}
+
+template<typename TKey, typename TValue>
+LRUCache<TKey, TValue>::~LRUCache()
+{
+}
+
+template<typename TKey, typename TValue>
+void LRUCache<TKey, TValue>::SetCapacity(size_t capacity)
+{
+	m_capacity = (std::max)(capacity, static_cast<size_t>(1));
+	evict();
+}
+
+template<typename TKey, typename TValue>
+bool LRUCache<TKey, TValue>::Find(const TKey& key, TValue& value)
+{
+	const auto it = m_index.find(key);
+	if (it == m_index.end()) return false;
+
+	m_entries.splice(m_entries.begin(), m_entries, it->second);
+	value = it->second->second;
+
+	return true;
+}
+
+template<typename TKey, typename TValue>
+bool LRUCache<TKey, TValue>::Contains(const TKey& key) const
+{
+	return m_index.find(key) != m_index.end();
+}
+
+template<typename TKey, typename TValue>
+void LRUCache<TKey, TValue>::Insert(const TKey& key, const TValue& value)
+{
+	const auto it = m_index.find(key);
+	if (it != m_index.end())
+	{
+		m_entries.splice(m_entries.begin(), m_entries, it->second);
+		it->second->second = value;
+
+		return;
+	}
+
+	m_entries.emplace_front(key, value);
+	m_index[key] = m_entries.begin();
+	evict();
+}
+
+template<typename TKey, typename TValue>
+void LRUCache<TKey, TValue>::Clear()
+{
+	m_entries.clear();
+	m_index.clear();
+}
+
+template<typename TKey, typename TValue>
+size_t LRUCache<TKey, TValue>::GetSize() const
+{
+	return m_entries.size();
+}
+
+template<typename TKey, typename TValue>
+void LRUCache<TKey, TValue>::evict()
+{
+	while (m_entries.size() > m_capacity)
+	{
+		m_index.erase(m_entries.back().first);
+		m_entries.pop_back();
+	}
+}
@@ -0,0 +1,577 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "PNGEncoder.h"
+
+using namespace std;
+
+namespace
+{
+	const uint32_t g_windowSize = 1 << 15;
+	const uint8_t g_hashBits = 15;
+	const uint32_t g_minRowsPerBand = 32;
+	const uint16_t g_maxMatch = 258;
+
+	const uint16_t g_lengthBase[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	const uint8_t g_lengthExtra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	const uint16_t g_distBase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	const uint8_t g_distExtra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	//--------------------------------------------------------------------------------------
+	// Static tables: fixed Huffman codes (bit-reversed for LSB-first output), symbol lookups and CRC
+	//--------------------------------------------------------------------------------------
+	struct Tables
+	{
+		uint16_t LitCode[288];
+		uint8_t LitBits[288];
+		uint8_t DistCode[30];
+		uint8_t LengthSymbol[g_maxMatch + 1];
+		uint8_t DistSymbol[g_windowSize];
+		uint32_t CRC[256];
+
+		Tables()
+		{
+			const auto reverse = [](uint32_t code, uint8_t numBits)
+			{
+				uint32_t result = 0;
+				for (uint8_t i = 0; i < numBits; ++i) result |= ((code >> i) & 1) << (numBits - 1 - i);
+
+				return static_cast<uint16_t>(result);
+			};
+
+			for (auto i = 0u; i < 288; ++i)
+			{
+				uint32_t code;
+				if (i < 144) code = 0x30 + i, LitBits[i] = 8;
+				else if (i < 256) code = 0x190 + (i - 144), LitBits[i] = 9;
+				else if (i < 280) code = i - 256, LitBits[i] = 7;
+				else code = 0xc0 + (i - 280), LitBits[i] = 8;
+				LitCode[i] = reverse(code, LitBits[i]);
+			}
+
+			for (uint8_t i = 0; i < 30; ++i) DistCode[i] = static_cast<uint8_t>(reverse(i, 5));
+
+			for (uint8_t i = 0; i < 29; ++i)
+			{
+				const auto end = i + 1 < 29 ? g_lengthBase[i + 1] : g_maxMatch + 1;
+				for (auto l = g_lengthBase[i]; l < end; ++l) LengthSymbol[l] = i;
+			}
+
+			for (uint8_t i = 0; i < 30; ++i)
+			{
+				const auto end = i + 1 < 30 ? g_distBase[i + 1] : g_windowSize + 1;
+				for (uint32_t d = g_distBase[i]; d < end; ++d) DistSymbol[d - 1] = i;
+			}
+
+			for (auto i = 0u; i < 256; ++i)
+			{
+				auto c = i;
+				for (uint8_t k = 0; k < 8; ++k) c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+				CRC[i] = c;
+			}
+		}
+	};
+
+	const Tables& GetTables()
+	{
+		static const Tables tables;
+
+		return tables;
+	}
+
+	uint32_t UpdateCRC(uint32_t crc, const uint8_t* pData, size_t size)
+	{
+		const auto& table = GetTables().CRC;
+		for (size_t i = 0; i < size; ++i) crc = table[(crc ^ pData[i]) & 0xff] ^ (crc >> 8);
+
+		return crc;
+	}
+
+	uint32_t Adler32(const uint8_t* pData, size_t size)
+	{
+		const uint32_t base = 65521;
+		uint32_t s1 = 1, s2 = 0;
+		while (size > 0)
+		{
+			// 5552 is the largest block for which s2 cannot overflow before the modulo
+			const auto blockSize = (min)(size, static_cast<size_t>(5552));
+			for (size_t i = 0; i < blockSize; ++i)
+			{
+				s1 += pData[i];
+				s2 += s1;
+			}
+			s1 %= base;
+			s2 %= base;
+			pData += blockSize;
+			size -= blockSize;
+		}
+
+		return (s2 << 16) | s1;
+	}
+
+	uint32_t CombineAdler32(uint32_t adler1, uint32_t adler2, uint32_t size2)
+	{
+		const uint32_t base = 65521;
+		const auto rem = size2 % base;
+		auto s1 = adler1 & 0xffff;
+		auto s2 = static_cast<uint32_t>((static_cast<uint64_t>(rem) * s1) % base);
+		s1 += (adler2 & 0xffff) + base - 1;
+		s2 += (adler1 >> 16) + (adler2 >> 16) + base - rem;
+		if (s1 >= base) s1 -= base;
+		if (s1 >= base) s1 -= base;
+		if (s2 >= (base << 1)) s2 -= base << 1;
+		if (s2 >= base) s2 -= base;
+
+		return (s2 << 16) | s1;
+	}
+
+	void PutBigEndian(vector<uint8_t>& out, uint32_t value)
+	{
+		out.push_back(static_cast<uint8_t>(value >> 24));
+		out.push_back(static_cast<uint8_t>(value >> 16));
+		out.push_back(static_cast<uint8_t>(value >> 8));
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	void PutChunk(vector<uint8_t>& out, const char* type, const uint8_t* pData, uint32_t size)
+	{
+		PutBigEndian(out, size);
+		const auto offset = out.size();
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), pData, pData + size);
+		const auto crc = UpdateCRC(0xffffffff, &out[offset], size + 4) ^ 0xffffffff;
+		PutBigEndian(out, crc);
+	}
+
+	//--------------------------------------------------------------------------------------
+	// LSB-first bit stream
+	//--------------------------------------------------------------------------------------
+	class BitWriter
+	{
+	public:
+		BitWriter(vector<uint8_t>& out) : m_out(out), m_bits(0), m_numBits(0) {}
+
+		void Put(uint32_t bits, uint8_t numBits)
+		{
+			m_bits |= static_cast<uint64_t>(bits) << m_numBits;
+			m_numBits += numBits;
+			while (m_numBits >= 8)
+			{
+				m_out.push_back(static_cast<uint8_t>(m_bits));
+				m_bits >>= 8;
+				m_numBits -= 8;
+			}
+		}
+
+		void Align()
+		{
+			if (m_numBits) Put(0, 8 - m_numBits);
+		}
+
+	protected:
+		vector<uint8_t>& m_out;
+		uint64_t m_bits;
+		uint8_t m_numBits;
+	};
+
+	//--------------------------------------------------------------------------------------
+	// Single fixed-Huffman deflate block; non-final blocks end with a sync flush
+	// (empty stored block) so that the next band starts on a byte boundary.
+	//--------------------------------------------------------------------------------------
+	void Deflate(vector<uint8_t>& out, const uint8_t* pData, size_t size, bool isFinal, uint8_t maxChain, bool insertAll)
+	{
+		const auto& tables = GetTables();
+		const auto hashMask = (1u << g_hashBits) - 1;
+		const auto windowMask = g_windowSize - 1;
+		const auto hash = [hashMask](const uint8_t* p)
+		{
+			const auto v = (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[2];
+
+			return (v * 2654435761u) >> (32 - g_hashBits) & hashMask;
+		};
+
+		vector<int64_t> head(static_cast<size_t>(1) << g_hashBits, -1);
+		vector<int64_t> prev(g_windowSize, -1);
+		const auto insert = [&](size_t pos)
+		{
+			const auto h = hash(&pData[pos]);
+			prev[pos & windowMask] = head[h];
+			head[h] = static_cast<int64_t>(pos);
+		};
+
+		BitWriter bitWriter(out);
+		bitWriter.Put(isFinal ? 1 : 0, 1);
+		bitWriter.Put(1, 2); // BTYPE = fixed Huffman
+
+		size_t i = 0;
+		while (i < size)
+		{
+			size_t bestLen = 0, bestDist = 0;
+			if (i + 3 <= size)
+			{
+				const auto maxLen = (min)(size - i, static_cast<size_t>(g_maxMatch));
+				auto cand = head[hash(&pData[i])];
+				for (uint8_t probe = 0; cand >= 0 && i - static_cast<size_t>(cand) <= g_windowSize && probe < maxChain; ++probe)
+				{
+					const auto pCand = &pData[cand];
+					if (pCand[bestLen] == pData[i + bestLen])
+					{
+						size_t len = 0;
+						while (len < maxLen && pCand[len] == pData[i + len]) ++len;
+						if (len > bestLen)
+						{
+							bestLen = len;
+							bestDist = i - static_cast<size_t>(cand);
+							if (len == maxLen) break;
+						}
+					}
+
+					const auto next = prev[cand & windowMask];
+					if (next >= cand) break;
+					cand = next;
+				}
+
+				insert(i);
+			}
+
+			if (bestLen >= 3)
+			{
+				const auto lenSymbol = tables.LengthSymbol[bestLen];
+				bitWriter.Put(tables.LitCode[257 + lenSymbol], tables.LitBits[257 + lenSymbol]);
+				bitWriter.Put(static_cast<uint32_t>(bestLen - g_lengthBase[lenSymbol]), g_lengthExtra[lenSymbol]);
+
+				const auto distSymbol = tables.DistSymbol[bestDist - 1];
+				bitWriter.Put(tables.DistCode[distSymbol], 5);
+				bitWriter.Put(static_cast<uint32_t>(bestDist - g_distBase[distSymbol]), g_distExtra[distSymbol]);
+
+				if (insertAll)
+					for (size_t k = 1; k < bestLen && i + k + 3 <= size; ++k) insert(i + k);
+				i += bestLen;
+			}
+			else
+			{
+				bitWriter.Put(tables.LitCode[pData[i]], tables.LitBits[pData[i]]);
+				++i;
+			}
+		}
+
+		bitWriter.Put(tables.LitCode[256], tables.LitBits[256]); // End of block
+
+		if (!isFinal)
+		{
+			bitWriter.Put(0, 3); // Empty stored block
+			bitWriter.Align();
+			const uint8_t syncFlush[] = { 0x00, 0x00, 0xff, 0xff };
+			out.insert(out.end(), syncFlush, syncFlush + sizeof(syncFlush));
+		}
+		else bitWriter.Align();
+	}
+
+	//--------------------------------------------------------------------------------------
+	// PNG row filters
+	//--------------------------------------------------------------------------------------
+	uint8_t Paeth(int a, int b, int c)
+	{
+		const auto p = a + b - c;
+		const auto pa = abs(p - a);
+		const auto pb = abs(p - b);
+		const auto pc = abs(p - c);
+
+		return static_cast<uint8_t>(pa <= pb && pa <= pc ? a : (pb <= pc ? b : c));
+	}
+
+	void FilterRow(uint8_t* pDst, const uint8_t* pRow, const uint8_t* pPrior, size_t stride, uint8_t bpp, uint8_t type)
+	{
+		for (size_t i = 0; i < stride; ++i)
+		{
+			const int a = i >= bpp ? pRow[i - bpp] : 0;
+			const int b = pPrior ? pPrior[i] : 0;
+			const int c = pPrior && i >= bpp ? pPrior[i - bpp] : 0;
+			switch (type)
+			{
+			case 0: pDst[i] = pRow[i]; break;
+			case 1: pDst[i] = static_cast<uint8_t>(pRow[i] - a); break;
+			case 2: pDst[i] = static_cast<uint8_t>(pRow[i] - b); break;
+			case 3: pDst[i] = static_cast<uint8_t>(pRow[i] - ((a + b) >> 1)); break;
+			default: pDst[i] = static_cast<uint8_t>(pRow[i] - Paeth(a, b, c));
+			}
+		}
+	}
+}
+
+PNGEncoder::PNGEncoder(Preset preset, uint8_t numThreads) :
+	m_preset(preset),
+	m_numThreads(numThreads)
+{
+}
+
+PNGEncoder::~PNGEncoder()
+{
+}
+
+bool PNGEncoder::Write(const char* fileName, const uint8_t* pData, uint32_t width, uint32_t height, uint8_t comp) const
+{
+	vector<uint8_t> png;
+	XUSG_N_RETURN(Encode(png, pData, width, height, comp), false);
+
+	FILE* pFile;
+	XUSG_N_RETURN(fopen_s(&pFile, fileName, "wb") == 0 && pFile, false);
+	const auto written = fwrite(png.data(), 1, png.size(), pFile);
+	fclose(pFile);
+
+	return written == png.size();
+}
+
+bool PNGEncoder::Encode(vector<uint8_t>& png, const uint8_t* pData, uint32_t width, uint32_t height, uint8_t comp) const
+{
+	XUSG_N_RETURN(comp >= 1 && comp <= 4 && width > 0 && height > 0, false);
+
+	// Split rows into bands, one per thread; the band count is recounted from the rounded-up band
+	// height, so that no band starts past the last row
+	const uint32_t numThreads = getNumThreads();
+	const auto rowsPerBand = XUSG_DIV_UP(height, (max)((min)(height / g_minRowsPerBand, numThreads), 1u));
+
+	vector<Band> bands;
+	encodeBands(bands, pData, nullptr, width, comp, height, rowsPerBand, true, true);
+
+	png.clear();
+	putHeader(png, width, height, comp);
+	auto adler = 1u;
+	putBands(png, bands, adler, true);
+	PutChunk(png, "IEND", nullptr, 0);
+
+	return true;
+}
+
+void PNGEncoder::encodeBands(vector<Band>& bands, const uint8_t* pRows, const uint8_t* pPrior, uint32_t width,
+	uint8_t comp, uint32_t numRows, uint32_t rowsPerBand, bool isFirst, bool isLast) const
+{
+	const auto stride = static_cast<size_t>(comp) * width;
+	const auto numBands = XUSG_DIV_UP(numRows, rowsPerBand);
+	bands.resize(numBands);
+
+	vector<thread> workers;
+	for (auto i = 1u; i < numBands; ++i)
+	{
+		const auto rowStart = rowsPerBand * i;
+		const auto pBandRows = &pRows[stride * rowStart];
+		workers.emplace_back(&PNGEncoder::encodeBand, this, ref(bands[i]), pBandRows, pBandRows - stride,
+			width, comp, (min)(rowsPerBand, numRows - rowStart), false, isLast && i + 1 == numBands);
+	}
+	encodeBand(bands[0], pRows, pPrior, width, comp, (min)(rowsPerBand, numRows), isFirst, isLast && numBands == 1);
+	for (auto& worker : workers) worker.join();
+}
+
+void PNGEncoder::encodeBand(Band& band, const uint8_t* pRows, const uint8_t* pPrior, uint32_t width,
+	uint8_t comp, uint32_t numRows, bool isFirst, bool isLast) const
+{
+	const auto stride = static_cast<size_t>(comp) * width;
+
+	// Filter rows; the prior row of the first row in a band comes from the previous band
+	vector<uint8_t> filtered((stride + 1) * numRows);
+	vector<uint8_t> candidates(m_preset == FAST ? 0 : stride * 5);
+	for (auto y = 0u; y < numRows; ++y)
+	{
+		const auto pRow = &pRows[stride * y];
+		if (y > 0) pPrior = pRow - stride;
+		const auto pDst = &filtered[(stride + 1) * y];
+
+		if (m_preset == FAST)
+		{
+			pDst[0] = 2; // Up
+			FilterRow(&pDst[1], pRow, pPrior, stride, comp, 2);
+		}
+		else
+		{
+			// Pick the filter with the minimum sum of absolute differences
+			uint8_t bestType = 0;
+			auto bestCost = UINT64_MAX;
+			for (uint8_t type = 0; type < 5; ++type)
+			{
+				const auto pCandidate = &candidates[stride * type];
+				FilterRow(pCandidate, pRow, pPrior, stride, comp, type);
+
+				uint64_t cost = 0;
+				for (size_t i = 0; i < stride; ++i) cost += abs(static_cast<int8_t>(pCandidate[i]));
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestType = type;
+				}
+			}
+
+			pDst[0] = bestType;
+			memcpy(&pDst[1], &candidates[stride * bestType], stride);
+		}
+	}
+
+	band.Adler = Adler32(filtered.data(), filtered.size());
+	band.Size = static_cast<uint32_t>(filtered.size());
+
+	// Compress; the zlib header goes in front of the first band
+	band.Chunk.clear();
+	band.Chunk.reserve(filtered.size() / 2 + 64);
+	if (isFirst)
+	{
+		band.Chunk.push_back(0x78);
+		band.Chunk.push_back(m_preset == FAST ? 0x01 : 0x9c);
+	}
+
+	if (m_preset == FAST) Deflate(band.Chunk, filtered.data(), filtered.size(), isLast, 1, false);
+	else Deflate(band.Chunk, filtered.data(), filtered.size(), isLast, 16, true);
+
+	const uint8_t type[] = { 'I', 'D', 'A', 'T' };
+	band.CRC = UpdateCRC(UpdateCRC(0xffffffff, type, sizeof(type)), band.Chunk.data(), band.Chunk.size());
+}
+
+uint8_t PNGEncoder::getNumThreads() const
+{
+	return m_numThreads ? m_numThreads : static_cast<uint8_t>((min)((max)(thread::hardware_concurrency(), 1u), 255u));
+}
+
+void PNGEncoder::putHeader(vector<uint8_t>& png, uint32_t width, uint32_t height, uint8_t comp)
+{
+	static const uint8_t colorTypes[] = { 0, 0, 4, 2, 6 };
+
+	// Signature and header
+	const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	png.insert(png.end(), signature, signature + sizeof(signature));
+
+	vector<uint8_t> header;
+	PutBigEndian(header, width);
+	PutBigEndian(header, height);
+	header.push_back(8);
+	header.push_back(colorTypes[comp]);
+	header.push_back(0); // Compression
+	header.push_back(0); // Filter
+	header.push_back(0); // Interlace
+	PutChunk(png, "IHDR", header.data(), static_cast<uint32_t>(header.size()));
+}
+
+void PNGEncoder::putBands(vector<uint8_t>& png, const vector<Band>& bands, uint32_t& adler, bool isLast)
+{
+	// Stitch the zlib stream: Adler-32 of the whole filtered image goes after the last band
+	for (const auto& band : bands) adler = CombineAdler32(adler, band.Adler, band.Size);
+
+	// One IDAT chunk per band
+	for (const auto& band : bands)
+	{
+		const auto isLastBand = isLast && &band == &bands.back();
+		const auto size = static_cast<uint32_t>(band.Chunk.size()) + (isLastBand ? 4 : 0);
+		PutBigEndian(png, size);
+		png.insert(png.end(), { 'I', 'D', 'A', 'T' });
+		png.insert(png.end(), band.Chunk.cbegin(), band.Chunk.cend());
+		auto crc = band.CRC;
+		if (isLastBand)
+		{
+			PutBigEndian(png, adler);
+			crc = UpdateCRC(crc, &png[png.size() - 4], 4);
+		}
+		PutBigEndian(png, crc ^ 0xffffffff);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// PNGStream
+//--------------------------------------------------------------------------------------
+
+PNGStream::PNGStream(const PNGEncoder& encoder) :
+	m_encoder(encoder),
+	m_pFile(nullptr),
+	m_width(0),
+	m_height(0),
+	m_rowsPerBand(0),
+	m_numPending(0),
+	m_numFlushed(0),
+	m_adler(1),
+	m_comp(0)
+{
+}
+
+PNGStream::~PNGStream()
+{
+	if (m_pFile) fclose(m_pFile);
+}
+
+bool PNGStream::Open(const char* fileName, uint32_t width, uint32_t height, uint8_t comp)
+{
+	if (m_pFile) Close();
+	XUSG_N_RETURN(comp >= 1 && comp <= 4 && width > 0 && height > 0, false);
+	XUSG_N_RETURN(fopen_s(&m_pFile, fileName, "wb") == 0 && m_pFile, false);
+
+	m_width = width;
+	m_height = height;
+	m_comp = comp;
+	m_numPending = 0;
+	m_numFlushed = 0;
+	m_adler = 1;
+
+	// Bands of at least 1 MB keep the compression close to that of a whole image
+	const auto stride = static_cast<size_t>(comp) * width;
+	m_rowsPerBand = static_cast<uint32_t>((max)(XUSG_DIV_UP(static_cast<size_t>(1) << 20, stride),
+		static_cast<size_t>(g_minRowsPerBand)));
+	const auto maxPending = (min)(m_rowsPerBand * m_encoder.getNumThreads(), height);
+	m_rows.resize(stride * (maxPending + 1));
+
+	m_png.clear();
+	PNGEncoder::putHeader(m_png, width, height, comp);
+
+	return fwrite(m_png.data(), 1, m_png.size(), m_pFile) == m_png.size();
+}
+
+bool PNGStream::WriteRows(const uint8_t* pData, uint32_t numRows)
+{
+	XUSG_N_RETURN(m_pFile && m_numFlushed + m_numPending + numRows <= m_height, false);
+
+	const auto stride = static_cast<size_t>(m_comp) * m_width;
+	const auto maxPending = static_cast<uint32_t>(m_rows.size() / stride - 1);
+	while (numRows > 0)
+	{
+		const auto n = (min)(numRows, maxPending - m_numPending);
+		memcpy(&m_rows[stride * (m_numPending + 1)], pData, stride * n);
+		m_numPending += n;
+		pData += stride * n;
+		numRows -= n;
+
+		if (m_numPending == maxPending || m_numFlushed + m_numPending == m_height) XUSG_N_RETURN(flush(), false);
+	}
+
+	return true;
+}
+
+bool PNGStream::Close()
+{
+	XUSG_N_RETURN(m_pFile, false);
+
+	const auto result = fclose(m_pFile) == 0 && m_numFlushed == m_height;
+	m_pFile = nullptr;
+	m_rows = vector<uint8_t>();
+	m_bands = vector<PNGEncoder::Band>();
+	m_png = vector<uint8_t>();
+
+	return result;
+}
+
+bool PNGStream::flush()
+{
+	const auto stride = static_cast<size_t>(m_comp) * m_width;
+	const auto isLast = m_numFlushed + m_numPending == m_height;
+	m_encoder.encodeBands(m_bands, &m_rows[stride], m_numFlushed > 0 ? m_rows.data() : nullptr,
+		m_width, m_comp, m_numPending, m_rowsPerBand, m_numFlushed == 0, isLast);
+
+	m_png.clear();
+	PNGEncoder::putBands(m_png, m_bands, m_adler, isLast);
+	if (isLast) PutChunk(m_png, "IEND", nullptr, 0);
+
+	// The last row is the prior row of the next band
+	memcpy(m_rows.data(), &m_rows[stride * m_numPending], stride);
+	m_numFlushed += m_numPending;
+	m_numPending = 0;
+
+	return fwrite(m_png.data(), 1, m_png.size(), m_pFile) == m_png.size();
+}
@@ -0,0 +1,80 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Multi-threaded PNG encoder: row bands are filtered and deflated in parallel,
+// each band ending with a sync flush so that the compressed bands can be emitted
+// back to back as consecutive IDAT chunks of a single valid zlib stream.
+class PNGEncoder
+{
+public:
+	enum Preset : uint8_t
+	{
+		DEFAULT,	// Adaptive row filters and hash chains, comparable to stbi_write_png
+		FAST,		// Fixed row filter and single-probe matching, for intermediate files
+
+		NUM_PRESET
+	};
+
+	PNGEncoder(Preset preset = DEFAULT, uint8_t numThreads = 0);
+	virtual ~PNGEncoder();
+
+	bool Write(const char* fileName, const uint8_t* pData, uint32_t width, uint32_t height, uint8_t comp) const;
+	bool Encode(std::vector<uint8_t>& png, const uint8_t* pData, uint32_t width, uint32_t height, uint8_t comp) const;
+
+protected:
+	struct Band
+	{
+		std::vector<uint8_t> Chunk;	// IDAT chunk data (compressed band)
+		uint32_t CRC;				// Running CRC of the chunk type and data
+		uint32_t Adler;				// Adler-32 of the filtered band
+		uint32_t Size;				// Filtered (uncompressed) size
+	};
+
+	friend class PNGStream;
+
+	// Bands of rowsPerBand rows are encoded in parallel; pPrior is the row above the first band
+	void encodeBands(std::vector<Band>& bands, const uint8_t* pRows, const uint8_t* pPrior, uint32_t width,
+		uint8_t comp, uint32_t numRows, uint32_t rowsPerBand, bool isFirst, bool isLast) const;
+	void encodeBand(Band& band, const uint8_t* pRows, const uint8_t* pPrior, uint32_t width,
+		uint8_t comp, uint32_t numRows, bool isFirst, bool isLast) const;
+	uint8_t getNumThreads() const;
+
+	static void putHeader(std::vector<uint8_t>& png, uint32_t width, uint32_t height, uint8_t comp);
+	static void putBands(std::vector<uint8_t>& png, const std::vector<Band>& bands, uint32_t& adler, bool isLast);
+
+	Preset	m_preset;
+	uint8_t	m_numThreads;
+};
+
+// Row-streamed PNG output for images that do not fit in memory: the rows are appended in order,
+// and a band per thread is held, encoded in parallel and written out each time they fill up.
+class PNGStream
+{
+public:
+	PNGStream(const PNGEncoder& encoder = PNGEncoder());
+	virtual ~PNGStream();
+
+	bool Open(const char* fileName, uint32_t width, uint32_t height, uint8_t comp);
+	bool WriteRows(const uint8_t* pData, uint32_t numRows);	// Tightly packed rows, in order
+	bool Close();	// Fails unless all the rows are written
+
+protected:
+	bool flush();
+
+	PNGEncoder						m_encoder;
+	FILE*							m_pFile;
+	std::vector<uint8_t>			m_rows;		// The prior row, then the pending rows
+	std::vector<PNGEncoder::Band>	m_bands;
+	std::vector<uint8_t>			m_png;		// Chunks of the flushed bands
+
+	uint32_t						m_width;
+	uint32_t						m_height;
+	uint32_t						m_rowsPerBand;
+	uint32_t						m_numPending;
+	uint32_t						m_numFlushed;
+	uint32_t						m_adler;	// Of the flushed bands
+	uint8_t							m_comp;
+};
@@ -12,6 +12,36 @@ Texture2D		g_txSource;
 //--------------------------------------------------------------------------------------
 SamplerState	g_smpLinear;
 
+//--------------------------------------------------------------------------------------
+// Bilinear sample of the source texels premultiplied by their alpha
+//--------------------------------------------------------------------------------------
+float4 SamplePremultiplied(float2 uv, int2 offset)
+{
+	float2 imageSize;
+	g_txSource.GetDimensions(imageSize.x, imageSize.y);
+
+	// Gathered texels are (-, +), (+, +), (+, -), and (-, -) of the footprint
+	const float2 pos = uv * imageSize - 0.5 + offset;
+	const float2 f = frac(pos);
+	const float2 uvGather = (floor(pos) + 1.0) / imageSize;
+	const float4 r = g_txSource.GatherRed(g_smpLinear, uvGather);
+	const float4 g = g_txSource.GatherGreen(g_smpLinear, uvGather);
+	const float4 b = g_txSource.GatherBlue(g_smpLinear, uvGather);
+	const float4 a = g_txSource.GatherAlpha(g_smpLinear, uvGather);
+	const float4 w = float4((1.0 - f.x) * f.y, f.x * f.y, f.x * (1.0 - f.y), (1.0 - f.x) * (1.0 - f.y));
+	const float4 wa = w * a;
+
+	return float4(dot(r, wa), dot(g, wa), dot(b, wa), dot(a, w));
+}
+
+// The straight-alpha source is premultiplied per texel before it is filtered, so that the colors
+// of transparent texels do not bleed into the mips
+#ifdef _PREMULTIPLY_
+#define SAMPLE_SOURCE(uv, offset) SamplePremultiplied(uv, offset)
+#else
+#define SAMPLE_SOURCE(uv, offset) g_txSource.SampleLevel(g_smpLinear, uv, 0.0, offset)
+#endif
+
 //--------------------------------------------------------------------------------------
 // Compute shader
 //--------------------------------------------------------------------------------------
@@ -19,18 +49,18 @@ float4 Resample(float2 uv)
 {
 #ifdef _HIGH_QUALITY_
 	float4 srcs[5];
-	srcs[0] = g_txSource.SampleLevel(g_smpLinear, uv, 0.0);
-	srcs[1] = g_txSource.SampleLevel(g_smpLinear, uv, 0.0, int2(-1, 0));
-	srcs[2] = g_txSource.SampleLevel(g_smpLinear, uv, 0.0, int2(1, 0));
-	srcs[3] = g_txSource.SampleLevel(g_smpLinear, uv, 0.0, int2(0, -1));
-	srcs[4] = g_txSource.SampleLevel(g_smpLinear, uv, 0.0, int2(0, 1));
+	srcs[0] = SAMPLE_SOURCE(uv, int2(0, 0));
+	srcs[1] = SAMPLE_SOURCE(uv, int2(-1, 0));
+	srcs[2] = SAMPLE_SOURCE(uv, int2(1, 0));
+	srcs[3] = SAMPLE_SOURCE(uv, int2(0, -1));
+	srcs[4] = SAMPLE_SOURCE(uv, int2(0, 1));
 
 	float4 result = srcs[0] * 2.0;
 	[unroll]
 	for (uint i = 1; i < 5; ++i) result += srcs[i];
 	result /= 6.0;
 #else
-	const float4 result = g_txSource.SampleLevel(g_smpLinear, uv, 0.0);
+	const float4 result = SAMPLE_SOURCE(uv, int2(0, 0));
 #endif
 
 	return result;
@@ -0,0 +1,24 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "Blit2D.hlsli"
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+RWTexture2D<float4>	g_txDest;
+
+//--------------------------------------------------------------------------------------
+// Compute shader
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint2 DTid : SV_DispatchThreadID)
+{
+	float2 imageSize;
+	g_txDest.GetDimensions(imageSize.x, imageSize.y);
+
+	const float2 uv = (DTid + 0.5) / imageSize;
+
+	g_txDest[DTid] = Resample(uv);
+}
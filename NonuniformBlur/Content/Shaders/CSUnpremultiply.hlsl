@@ -0,0 +1,20 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "MipGaussian.hlsli"
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+RWTexture2D<float4>	g_txDest;
+
+//--------------------------------------------------------------------------------------
+// Compute shader
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint2 DTid : SV_DispatchThreadID)
+{
+	// The result at a reduced level is made straight in place
+	g_txDest[DTid] = Unpremultiply(g_txDest[DTid]);
+}
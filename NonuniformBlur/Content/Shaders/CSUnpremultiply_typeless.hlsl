@@ -0,0 +1,22 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "MipGaussian.hlsli"
+#include "D3DX_DXGIFormatConvert.inl"
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+RWTexture2D<uint>	g_txDest;
+
+//--------------------------------------------------------------------------------------
+// Compute shader
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint2 DTid : SV_DispatchThreadID)
+{
+	// The result at a reduced level is made straight in place
+	const float4 color = D3DX_R8G8B8A8_UNORM_to_FLOAT4(g_txDest[DTid]);
+	g_txDest[DTid] = D3DX_FLOAT4_to_R8G8B8A8_UNORM(Unpremultiply(color));
+}
@@ -22,11 +22,11 @@ void main(uint2 DTid : SV_DispatchThreadID)
 
 	// Fetch the color of the current level and the resolved color at the coarser level
 	const float2 uv = (DTid + 0.5) / imageSize;
-	const float4 src = g_txSource[DTid];
+	const float4 src = Premultiply(g_txSource[DTid]);
 	const float4 coarser = g_txCoarser.SampleLevel(g_smpLinear, uv, 0.0);
 
 	// Gaussian-approximating Haar coefficients (weights of box filters)
 	const float weight = MipGaussianBlendWeight(uv);
 
-	g_txDest[DTid] = lerp(coarser, src, weight);
+	g_txDest[DTid] = Unpremultiply(lerp(coarser, src, weight));
 }
@@ -12,6 +12,7 @@ cbuffer cbPerFrame
 {
 	float2	g_focus;
 	float	g_sigma;
+	uint	g_useSigmaMap;
 };
 
 cbuffer cbPerPass
@@ -24,6 +25,25 @@ cbuffer cbPerPass
 //--------------------------------------------------------------------------------------
 SamplerState	g_smpLinear;
 
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+Texture2D<float>	g_txSigmaMap : register (t2);	// Sigma scales in place of the radial falloff
+
+//--------------------------------------------------------------------------------------
+// Convert between straight and premultiplied alpha; the levels are premultiplied, and
+// only the source and the result are straight
+//--------------------------------------------------------------------------------------
+float4 Premultiply(float4 color)
+{
+	return float4(color.xyz * color.w, color.w);
+}
+
+float4 Unpremultiply(float4 color)
+{
+	return float4(color.w > 0.0 ? color.xyz / color.w : 0.0, color.w);
+}
+
 //--------------------------------------------------------------------------------------
 // Calculate Gaussian exponent
 //--------------------------------------------------------------------------------------
@@ -59,8 +79,12 @@ float MipGaussianBlendWeight(float2 uv)
 	float sigma = g_sigma;
 	if (asuint(g_focus.x) != 0xffffffff)
 	{
-		const float2 r = (2.0 * uv - 1.0) - g_focus;
-		sigma *= dot(r, r);
+		if (g_useSigmaMap) sigma *= g_txSigmaMap.SampleLevel(g_smpLinear, uv, 0.0);
+		else
+		{
+			const float2 r = (2.0 * uv - 1.0) - g_focus;
+			sigma *= dot(r, r);
+		}
 	}
 	const float sigma2 = sigma * sigma;
 
@@ -0,0 +1,22 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "Blit2D.hlsli"
+
+//--------------------------------------------------------------------------------------
+// Structure
+//--------------------------------------------------------------------------------------
+struct PSIn
+{
+	float4 Pos	: SV_POSITION;
+	float2 UV	: TEXCOORD;
+};
+
+//--------------------------------------------------------------------------------------
+// Pixel shader
+//--------------------------------------------------------------------------------------
+float4 main(PSIn input) : SV_TARGET
+{
+	return Resample(input.UV);
+}
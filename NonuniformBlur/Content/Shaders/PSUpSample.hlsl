@@ -16,8 +16,8 @@ struct PSIn
 //--------------------------------------------------------------------------------------
 // Textures
 //--------------------------------------------------------------------------------------
-Texture2D<float3>	g_txSource;
-Texture2D<float3>	g_txCoarser;
+Texture2D	g_txSource;
+Texture2D	g_txCoarser;
 
 //--------------------------------------------------------------------------------------
 // Pixel shader
@@ -25,11 +25,11 @@ Texture2D<float3>	g_txCoarser;
 float4 main(PSIn input) : SV_TARGET
 {
 	// Fetch the color of the resolved color at the coarser level
-	const float3 src = g_txSource[input.Pos.xy];
-	const float3 coarser = g_txCoarser.SampleLevel(g_smpLinear, input.UV, 0.0);
+	const float4 src = Premultiply(g_txSource[input.Pos.xy]);
+	const float4 coarser = g_txCoarser.SampleLevel(g_smpLinear, input.UV, 0.0);
 
 	// Gaussian-approximating Haar coefficients (weights of box filters)
 	const float weight = MipGaussianBlendWeight(input.UV);
 
-	return float4(lerp(coarser, src, weight), 1.0);
+	return Unpremultiply(lerp(coarser, src, weight));
 }
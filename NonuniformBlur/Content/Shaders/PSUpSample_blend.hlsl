@@ -13,21 +13,31 @@ struct PSIn
 	float2 UV	: TEXCOORD;
 };
 
+struct PSOut
+{
+	float4 Color	: SV_TARGET0;
+	float4 Weight	: SV_TARGET1;
+};
+
 //--------------------------------------------------------------------------------------
 // Textures
 //--------------------------------------------------------------------------------------
-Texture2D<float3>	g_txCoarser;
+Texture2D	g_txCoarser;
 
 //--------------------------------------------------------------------------------------
 // Pixel shader
 //--------------------------------------------------------------------------------------
-float4 main(PSIn input) : SV_TARGET
+PSOut main(PSIn input)
 {
+	PSOut output;
+
 	// Fetch the color of the resolved color at the coarser level
-	const float3 coarser = g_txCoarser.SampleLevel(g_smpLinear, input.UV, 0.0);
+	output.Color = g_txCoarser.SampleLevel(g_smpLinear, input.UV, 0.0);
 
-	// Gaussian-approximating Haar coefficients (weights of box filters)
+	// Gaussian-approximating Haar coefficients (weights of box filters); the blend factor is
+	// the second source, so that the premultiplied alpha is blended like the colors
 	const float weight = MipGaussianBlendWeight(input.UV);
+	output.Weight = 1.0 - weight;
 
-	return float4(coarser, 1.0 - weight);
+	return output;
 }
@@ -0,0 +1,443 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "VideoProcessor.h"
+#include "CommandLineArgs.h"
+
+#include <fcntl.h>
+#include <io.h>
+
+using namespace std;
+using namespace DirectX;
+
+VideoProcessor::VideoProcessor() :
+	m_focus(0.0f, 0.0f),
+	m_sigma(24.0f),
+	m_focusSmoothness(0.0f),
+	m_tolerance(0.0f),
+	m_format(NUM_STREAM_FORMAT),
+	m_width(0),
+	m_height(0),
+	m_comp(4),
+	m_chromaShiftX(0),
+	m_chromaShiftY(0),
+	m_frameSize(0),
+	m_numFrames(0),
+	m_reuseRatioSum(0.0),
+	m_isFailed(false)
+{
+}
+
+VideoProcessor::~VideoProcessor()
+{
+}
+
+bool VideoProcessor::ParseCommandLineArgs(wchar_t* argv[], int argc)
+{
+	const CommandLineArgs args(argv, argc);
+
+	for (auto i = 1; i < argc; ++i)
+	{
+		if (args.IsMatched(i, L"video"))
+		{
+			m_format = Y4M;
+			if (args.HasNextValue(i) && CommandLineArgs::ToLower(argv[i + 1]) == L"rgba")
+			{
+				m_format = RGBA;
+				++i;
+				if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%u", &m_width);
+				if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%u", &m_height);
+			}
+			else if (args.HasNextValue(i) && CommandLineArgs::ToLower(argv[i + 1]) == L"y4m") ++i;
+		}
+		else if (args.IsMatched(i, L"params"))
+		{
+			if (args.HasNextValue(i)) m_paramFileName = CommandLineArgs::ToString(argv[++i]);
+		}
+		else if (args.IsMatched(i, L"sigmamap"))
+		{
+			if (args.HasNextValue(i)) m_sigmaMapFileName = CommandLineArgs::ToString(argv[++i]);
+		}
+		else if (args.IsMatched(i, L"focuspoint"))
+		{
+			FilterCPU::FocusPoint point = { XMFLOAT2(0.0f, 0.0f), 1.0f };
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &point.Focus.x);
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &point.Focus.y);
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &point.SigmaScale);
+			m_focusPoints.push_back(point);
+		}
+		else if (args.IsMatched(i, L"smoothness"))
+		{
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_focusSmoothness);
+		}
+		else if (args.IsMatched(i, L"tolerance"))
+		{
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_tolerance);
+		}
+		else if (args.IsMatched(i, L"s") || args.IsMatched(i, L"sigma"))
+		{
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_sigma);
+		}
+		else if (args.IsMatched(i, L"f") || args.IsMatched(i, L"focus"))
+		{
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_focus.x);
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_focus.y);
+		}
+		else if (args.IsMatched(i, L"u") || args.IsMatched(i, L"uniform"))
+			reinterpret_cast<uint32_t&>(m_focus.x) = UINT32_MAX;
+	}
+
+	return m_format < NUM_STREAM_FORMAT;
+}
+
+bool VideoProcessor::Run()
+{
+	_setmode(_fileno(stdin), _O_BINARY);
+	_setmode(_fileno(stdout), _O_BINARY);
+
+	if (!loadParams())
+	{
+		cerr << "Failed to load the frame parameters from " << m_paramFileName << endl;
+
+		return false;
+	}
+
+	if (!readStreamHeader())
+	{
+		cerr << "Unsupported video stream" << endl;
+
+		return false;
+	}
+
+	if (!m_sigmaMapFileName.empty())
+	{
+		ImageFile sigmaMap;
+		if (!sigmaMap.Open(m_sigmaMapFileName.c_str()) || !m_filter.SetSigmaMap(sigmaMap))
+		{
+			cerr << "Failed to load the sigma map " << m_sigmaMapFileName << endl;
+
+			return false;
+		}
+	}
+
+	if (!m_focusPoints.empty() && !m_filter.SetFocusPoints(m_focusPoints.data(),
+		static_cast<uint32_t>(m_focusPoints.size()), m_focusSmoothness))
+	{
+		cerr << "Invalid focus points" << endl;
+
+		return false;
+	}
+
+	// Frames keep their size and layout, so the stream header is passed through
+	XUSG_N_RETURN(fwrite(m_streamHeader.data(), 1, m_streamHeader.size(), stdout) == m_streamHeader.size(), false);
+
+	// The frames in flight circulate through the stages
+	for (auto& queue : m_queues) queue.SetCapacity(FrameCount);
+	for (uint8_t i = 0; i < FrameCount; ++i) m_queues[READ].Push(unique_ptr<Frame>(new Frame()));
+
+	void (VideoProcessor::*const stageMains[])() =
+	{ &VideoProcessor::readMain, &VideoProcessor::filterMain, &VideoProcessor::writeMain };
+	for (uint8_t i = 0; i < NUM_STAGE; ++i) m_threads[i] = thread(stageMains[i], this);
+	for (auto& thread : m_threads) thread.join();
+	fflush(stdout);
+
+	if (m_numFrames > 0)
+		cerr << m_numFrames << " frames, " << fixed << setprecision(1) << 100.0 * m_reuseRatioSum / m_numFrames
+		<< "% of the up-sampled pixels reused" << endl;
+
+	return !m_isFailed;
+}
+
+bool VideoProcessor::loadParams()
+{
+	if (m_paramFileName.empty()) return true;
+
+	ifstream file(m_paramFileName);
+	XUSG_N_RETURN(file, false);
+
+	// A line per frame: the focus and sigma, or "u" and sigma for the uniform blur
+	for (string line; getline(file, line);)
+	{
+		istringstream tokens(line);
+		string token;
+		if (!(tokens >> token) || token[0] == '#') continue;
+
+		FrameParams params;
+		if (token == "u")
+		{
+			reinterpret_cast<uint32_t&>(params.Focus.x) = UINT32_MAX;
+			params.Focus.y = 0.0f;
+		}
+		else
+		{
+			params.Focus.x = strtof(token.c_str(), nullptr);
+			tokens >> params.Focus.y;
+		}
+		tokens >> params.Sigma;
+		XUSG_N_RETURN(!tokens.fail(), false);
+		m_params.emplace_back(params);
+	}
+
+	return true;
+}
+
+bool VideoProcessor::readStreamHeader()
+{
+	if (m_format == Y4M)
+	{
+		for (auto c = getchar(); c != '\n'; c = getchar())
+		{
+			XUSG_N_RETURN(c != EOF, false);
+			m_streamHeader.push_back(static_cast<char>(c));
+		}
+
+		istringstream tokens(m_streamHeader);
+		string token;
+		tokens >> token;
+		XUSG_N_RETURN(token == "YUV4MPEG2", false);
+
+		string colorSpace = "420jpeg";
+		while (tokens >> token)
+		{
+			if (token[0] == 'W') m_width = static_cast<uint32_t>(strtoul(&token[1], nullptr, 10));
+			else if (token[0] == 'H') m_height = static_cast<uint32_t>(strtoul(&token[1], nullptr, 10));
+			else if (token[0] == 'C') colorSpace = token.substr(1);
+		}
+		m_streamHeader.push_back('\n');
+
+		// 8-bit planes only; chroma siting is ignored
+		if (colorSpace == "mono") m_comp = 1;
+		else if (colorSpace == "444alpha") m_comp = 4;
+		else
+		{
+			m_comp = 3;
+			if (colorSpace == "420" || colorSpace == "420jpeg" || colorSpace == "420paldv" || colorSpace == "420mpeg2")
+			{
+				m_chromaShiftX = 1;
+				m_chromaShiftY = 1;
+			}
+			else if (colorSpace == "422") m_chromaShiftX = 1;
+			else XUSG_N_RETURN(colorSpace == "444", false);
+		}
+	}
+	XUSG_N_RETURN(m_width > 0 && m_height > 0, false);
+
+	const auto lumaSize = static_cast<size_t>(m_width) * m_height;
+	const auto chromaSize = static_cast<size_t>((m_width + (1u << m_chromaShiftX) - 1) >> m_chromaShiftX) *
+		((m_height + (1u << m_chromaShiftY) - 1) >> m_chromaShiftY);
+	m_frameSize = m_comp == 3 ? lumaSize + 2 * chromaSize : lumaSize * m_comp;
+
+	return true;
+}
+
+bool VideoProcessor::readFrame(Frame& frame)
+{
+	// Y4M frames start with a FRAME line, which is passed through with its parameters
+	if (m_format == Y4M)
+	{
+		frame.Header.clear();
+		for (auto c = getchar(); c != '\n'; c = getchar())
+		{
+			if (c == EOF)
+			{
+				if (!frame.Header.empty()) fail("Truncated frame header");
+
+				return false;
+			}
+			frame.Header.push_back(static_cast<char>(c));
+		}
+
+		if (frame.Header.compare(0, 5, "FRAME") != 0)
+		{
+			fail("Invalid frame header");
+
+			return false;
+		}
+		frame.Header.push_back('\n');
+	}
+
+	// The filter reads the frame from the interleaved pixels of its image, kept across frames
+	if (!frame.Image.Create({ m_width, m_height, m_comp, ImageFile::UNORM8 }))
+	{
+		fail("Failed to allocate a frame");
+
+		return false;
+	}
+	const auto numPixels = static_cast<size_t>(m_width) * m_height;
+	const auto pPixels = frame.Image.GetRow(0);
+
+	// RGBA frames are already interleaved
+	auto pData = pPixels;
+	if (m_format == Y4M)
+	{
+		frame.Data.resize(m_frameSize);
+		pData = frame.Data.data();
+	}
+
+	const auto size = fread(pData, 1, m_frameSize, stdin);
+	if (size < m_frameSize)
+	{
+		if (size > 0 || m_format == Y4M) fail("Truncated frame");
+
+		return false;
+	}
+
+	// Chroma is replicated over its blocks; the blur is an affine combination, so YUV is filtered as is
+	if (m_format == Y4M)
+	{
+		const auto chromaWidth = (m_width + (1u << m_chromaShiftX) - 1) >> m_chromaShiftX;
+		const auto chromaSize = m_comp == 3 ? (m_frameSize - numPixels) / 2 : numPixels;
+		const uint8_t* pPlanes[] = { pData, &pData[numPixels], &pData[numPixels + chromaSize], &pData[numPixels + 2 * chromaSize] };
+		for (auto y = 0u; y < m_height; ++y)
+		{
+			for (auto x = 0u; x < m_width; ++x)
+			{
+				const auto i = static_cast<size_t>(m_width) * y + x;
+				const auto j = static_cast<size_t>(chromaWidth) * (y >> m_chromaShiftY) + (x >> m_chromaShiftX);
+				auto pPixel = &pPixels[m_comp * i];
+				pPixel[0] = pPlanes[0][i];
+				if (m_comp < 3) continue;
+				pPixel[1] = pPlanes[1][j];
+				pPixel[2] = pPlanes[2][j];
+				if (m_comp > 3) pPixel[3] = pPlanes[3][i];
+			}
+		}
+	}
+
+	return true;
+}
+
+bool VideoProcessor::writeFrame(Frame& frame)
+{
+	const auto toUNorm8 = [](float v) { return static_cast<uint8_t>((min)((max)(v, 0.0f), 1.0f) * 255.0f + 0.5f); };
+
+	const auto numPixels = static_cast<size_t>(m_width) * m_height;
+	auto& data = frame.Data;
+	data.resize(m_frameSize);
+	if (m_format == RGBA)
+	{
+		for (size_t i = 0; i < numPixels; ++i)
+		{
+			const auto& pixel = frame.Result[i];
+			data[4 * i] = toUNorm8(pixel.x);
+			data[4 * i + 1] = toUNorm8(pixel.y);
+			data[4 * i + 2] = toUNorm8(pixel.z);
+			data[4 * i + 3] = toUNorm8(pixel.w);
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < numPixels; ++i)
+		{
+			data[i] = toUNorm8(frame.Result[i].x);
+			if (m_comp > 3) data[3 * numPixels + i] = toUNorm8(frame.Result[i].w);
+		}
+
+		// Chroma is averaged over its blocks
+		if (m_comp >= 3)
+		{
+			const auto chromaWidth = (m_width + (1u << m_chromaShiftX) - 1) >> m_chromaShiftX;
+			const auto chromaHeight = (m_height + (1u << m_chromaShiftY) - 1) >> m_chromaShiftY;
+			const auto chromaSize = static_cast<size_t>(chromaWidth) * chromaHeight;
+			for (auto j = 0u; j < chromaHeight; ++j)
+			{
+				for (auto i = 0u; i < chromaWidth; ++i)
+				{
+					const auto x0 = i << m_chromaShiftX;
+					const auto y0 = j << m_chromaShiftY;
+					const auto x1 = (min)((i + 1) << m_chromaShiftX, m_width);
+					const auto y1 = (min)((j + 1) << m_chromaShiftY, m_height);
+					XMFLOAT2 sum(0.0f, 0.0f);
+					for (auto y = y0; y < y1; ++y)
+					{
+						for (auto x = x0; x < x1; ++x)
+						{
+							const auto& pixel = frame.Result[static_cast<size_t>(m_width) * y + x];
+							sum.x += pixel.y;
+							sum.y += pixel.z;
+						}
+					}
+
+					const auto scale = 1.0f / ((x1 - x0) * (y1 - y0));
+					const auto k = static_cast<size_t>(chromaWidth) * j + i;
+					data[numPixels + k] = toUNorm8(sum.x * scale);
+					data[numPixels + chromaSize + k] = toUNorm8(sum.y * scale);
+				}
+			}
+		}
+	}
+
+	XUSG_N_RETURN(fwrite(frame.Header.data(), 1, frame.Header.size(), stdout) == frame.Header.size(), false);
+
+	return fwrite(data.data(), 1, data.size(), stdout) == data.size();
+}
+
+bool VideoProcessor::isFailed()
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	return m_isFailed;
+}
+
+void VideoProcessor::fail(const char* message)
+{
+	lock_guard<mutex> lock(m_mutex);
+	if (!m_isFailed) cerr << message << endl;
+	m_isFailed = true;
+}
+
+void VideoProcessor::readMain()
+{
+	// Frames are read while the others are filtered and written
+	auto frameIndex = 0u;
+	for (unique_ptr<Frame> frame; !isFailed() && m_queues[READ].Pop(frame); ++frameIndex)
+	{
+		if (m_params.empty()) frame->Params = { m_focus, m_sigma };
+		else frame->Params = m_params[(min)(frameIndex, static_cast<uint32_t>(m_params.size() - 1))];
+
+		if (!readFrame(*frame)) break;
+		m_queues[FILTER].Push(move(frame));
+	}
+
+	m_queues[FILTER].Close();
+}
+
+void VideoProcessor::filterMain()
+{
+	for (unique_ptr<Frame> frame; m_queues[FILTER].Pop(frame);)
+	{
+		// The filter is initialized from the first frame, and then only re-blurs the changed tiles
+		if (!isFailed())
+		{
+			if (!m_numFrames && !m_filter.Init(frame->Image)) fail("Failed to initialize the filter");
+			else
+			{
+				m_filter.UpdateFrame(frame->Params.Focus, frame->Params.Sigma);
+				if (m_filter.Process(frame->Image, m_tolerance))
+				{
+					auto& result = frame->Result;
+					result = m_filter.GetResult().Pixels;
+					FilterCPU::Unpremultiply(result.data(), result.data(), result.size());
+					m_reuseRatioSum += m_filter.GetReuseRatio();
+					++m_numFrames;
+				}
+				else fail("Failed to filter a frame");
+			}
+		}
+
+		m_queues[WRITE].Push(move(frame));
+	}
+
+	m_queues[WRITE].Close();
+}
+
+void VideoProcessor::writeMain()
+{
+	// Frames are recycled for reading once written
+	for (unique_ptr<Frame> frame; m_queues[WRITE].Pop(frame);)
+	{
+		if (!isFailed() && !writeFrame(*frame)) fail("Failed to write a frame");
+		m_queues[READ].Push(move(frame));
+	}
+}
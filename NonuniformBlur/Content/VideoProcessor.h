@@ -0,0 +1,98 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "BoundedQueue.h"
+#include "FilterVideoCPU.h"
+
+// Video mode: filters Y4M or raw RGBA frames from stdin to stdout with the CPU filter, as a
+// stage between a decoder and an encoder process. Reading, filtering and writing run on their
+// own threads over FrameCount frames in flight, so that reading frame N + 1, filtering N and
+// writing N - 1 overlap. The focus and sigma may change per frame through a parameter file.
+class VideoProcessor
+{
+public:
+	enum Stage : uint8_t
+	{
+		READ,
+		FILTER,
+		WRITE,
+
+		NUM_STAGE
+	};
+
+	enum StreamFormat : uint8_t
+	{
+		Y4M,
+		RGBA,	// Headerless 8-bit RGBA frames of the size given on the command line
+
+		NUM_STREAM_FORMAT
+	};
+
+	VideoProcessor();
+	virtual ~VideoProcessor();
+
+	// Returns true if video mode is requested
+	bool ParseCommandLineArgs(wchar_t* argv[], int argc);
+	bool Run();
+
+	static const uint8_t FrameCount = 3;
+
+protected:
+	struct FrameParams
+	{
+		DirectX::XMFLOAT2	Focus;
+		float				Sigma;
+	};
+
+	struct Frame
+	{
+		std::string						Header;	// FRAME line of Y4M
+		std::vector<uint8_t>			Data;	// Frame in the stream layout
+		ImageFile						Image;	// Interleaved source of the filter
+		std::vector<DirectX::XMFLOAT4>	Result;
+		FrameParams						Params;
+	};
+
+	using FrameQueue = BoundedQueue<std::unique_ptr<Frame>>;
+
+	bool loadParams();
+	bool readStreamHeader();
+	bool readFrame(Frame& frame);
+	bool writeFrame(Frame& frame);
+	bool isFailed();
+	void fail(const char* message);
+
+	void readMain();
+	void filterMain();
+	void writeMain();
+
+	std::string					m_paramFileName;
+	std::string					m_sigmaMapFileName;
+	std::vector<FilterCPU::FocusPoint> m_focusPoints;
+	std::vector<FrameParams>	m_params;		// Per frame; the last ones hold for the rest
+	std::string					m_streamHeader;
+
+	FrameQueue					m_queues[NUM_STAGE];	// Free frames are queued for reading
+	std::thread					m_threads[NUM_STAGE];
+	FilterVideoCPU				m_filter;
+
+	DirectX::XMFLOAT2			m_focus;
+	float						m_sigma;
+	float						m_focusSmoothness;
+	float						m_tolerance;
+	StreamFormat				m_format;
+	uint32_t					m_width;
+	uint32_t					m_height;
+	uint8_t						m_comp;			// Y, YUV or YUVA planes of Y4M, or RGBA
+	uint8_t						m_chromaShiftX;
+	uint8_t						m_chromaShiftY;
+	size_t						m_frameSize;
+
+	std::mutex					m_mutex;
+	uint32_t					m_numFrames;
+	double						m_reuseRatioSum;
+	bool						m_isFailed;
+};
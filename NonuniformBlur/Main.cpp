@@ -10,10 +10,51 @@
 //*********************************************************
 
 #include "NonUniformBlur.h"
+#include "BatchProcessor.h"
+#include "FocusPullRenderer.h"
+#include "VideoProcessor.h"
 
 _Use_decl_annotations_
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int nCmdShow)
 {
+	// Batch, render and video modes filter on the CPU without creating a window
+	{
+		int argc;
+		const auto argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+		BatchProcessor batchProcessor;
+		FocusPullRenderer focusPullRenderer;
+		VideoProcessor videoProcessor;
+		const auto isBatch = batchProcessor.ParseCommandLineArgs(argv, argc);
+		const auto isRender = focusPullRenderer.ParseCommandLineArgs(argv, argc);
+		const auto isVideo = videoProcessor.ParseCommandLineArgs(argv, argc);
+		LocalFree(argv);
+
+		// Video frames go through stdout, so only the errors go to the console
+		if (isVideo)
+		{
+			if (AttachConsole(ATTACH_PARENT_PROCESS))
+			{
+				FILE* stream;
+				freopen_s(&stream, "CONOUT$", "w+t", stderr);
+			}
+
+			return videoProcessor.Run() ? 0 : 1;
+		}
+
+		if (isBatch || isRender)
+		{
+			// Report progress to the console that started the process
+			if (AttachConsole(ATTACH_PARENT_PROCESS))
+			{
+				FILE* stream;
+				freopen_s(&stream, "CONOUT$", "w+t", stdout);
+				freopen_s(&stream, "CONOUT$", "w+t", stderr);
+			}
+
+			return (isRender ? focusPullRenderer.Run() : batchProcessor.Run()) ? 0 : 1;
+		}
+	}
+
 	NonUniformBlur nonUniformBlur(1024, 1024, L"DirectX 12 Nonuniform Blur Filter");
 
 	return Win32Application::Run(&nonUniformBlur, hInstance, nCmdShow);
@@ -10,7 +10,7 @@
 //*********************************************************
 
 #include "NonUniformBlur.h"
-#include "stb_image_write.h"
+#include "CommandLineArgs.h"
 
 using namespace std;
 using namespace XUSG;
@@ -30,6 +30,7 @@ NonUniformBlur::NonUniformBlur(uint32_t width, uint32_t height, wstring name) :
 	m_useEZ(true),
 	m_showFPS(true),
 	m_fileName("Assets/Sashimi.png"),
+	m_outputLevel(0),
 	m_screenShot(0)
 {
 #if defined (_DEBUG)
@@ -167,15 +168,19 @@ void NonUniformBlur::LoadPipeline(vector<Resource::uptr>& uploaders)
 
 	m_filter = make_unique<Filter>();
 	XUSG_N_RETURN(m_filter->Init(pCommandList, m_descriptorTableLib, uploaders,
-		g_backBufferFormat, m_fileName.c_str(), m_typedUAV), ThrowIfFailed(E_FAIL));
+		g_backBufferFormat, m_fileName.c_str(), m_typedUAV, m_sigmaMapFileName.empty() ?
+		nullptr : m_sigmaMapFileName.c_str()), ThrowIfFailed(E_FAIL));
 	
 	//m_filter->GetImageSize(m_width, m_height);
 
 	m_filterEZ = make_unique<FilterEZ>();
 	XUSG_N_RETURN(m_filterEZ->Init(pCommandList, uploaders, g_backBufferFormat,
-		m_fileName.c_str(), m_typedUAV), ThrowIfFailed(E_FAIL));
+		m_fileName.c_str(), m_typedUAV, m_sigmaMapFileName.empty() ?
+		nullptr : m_sigmaMapFileName.c_str()), ThrowIfFailed(E_FAIL));
 
-	m_filterEZ->GetImageSize(m_width, m_height);
+	// The result is shown at the output level
+	m_outputLevel = (min)(m_outputLevel, static_cast<uint8_t>(m_filterEZ->GetNumLevels() - 1));
+	m_filterEZ->GetImageSize(m_width, m_height, m_outputLevel);
 
 	// Resize window
 	{
@@ -236,6 +241,10 @@ void NonUniformBlur::LoadAssets()
 		// complete before continuing.
 		WaitForGpu();
 	}
+
+	// Screen shots are encoded and written on a background thread
+	m_imageWriter = make_unique<ImageWriter>();
+	XUSG_N_RETURN(m_imageWriter->Init(), ThrowIfFailed(E_FAIL));
 }
 
 // Update frame-based values.
@@ -285,6 +294,9 @@ void NonUniformBlur::OnDestroy()
 	// cleaned up by the destructor.
 	WaitForGpu();
 
+	// Finish writing pending screen shots
+	if (m_imageWriter) m_imageWriter->Flush();
+
 	CloseHandle(m_fenceEvent);
 }
 
@@ -316,60 +328,44 @@ void NonUniformBlur::OnKeyUp(uint8_t key)
 
 void NonUniformBlur::ParseCommandLineArgs(wchar_t* argv[], int argc)
 {
-	const auto str_tolower = [](wstring s)
-	{
-		transform(s.begin(), s.end(), s.begin(), [](wchar_t c) { return towlower(c); });
-
-		return s;
-	};
-
-	const auto isArgMatched = [&argv, &str_tolower](int i, const wchar_t* paramName)
-	{
-		const auto& arg = argv[i];
-
-		return (arg[0] == L'-' || arg[0] == L'/')
-			&& str_tolower(&arg[1]) == str_tolower(paramName);
-	};
-
-	const auto hasNextArgValue = [&argv, &argc](int i)
-	{
-		const auto& arg = argv[i + 1];
-
-		return i + 1 < argc && arg[0] != L'/' &&
-			(arg[0] != L'-' || (arg[1] >= L'0' && arg[1] <= L'9') || arg[1] == L'.');
-	};
+	const CommandLineArgs args(argv, argc);
 
 	DXFramework::ParseCommandLineArgs(argv, argc);
 
 	for (auto i = 1; i < argc; ++i)
 	{
-		if (isArgMatched(i, L"warp")) m_deviceType = DEVICE_WARP;
-		else if (isArgMatched(i, L"uma")) m_deviceType = DEVICE_UMA;
-		else if (isArgMatched(i, L"i") || isArgMatched(i, L"image"))
+		if (args.IsMatched(i, L"warp")) m_deviceType = DEVICE_WARP;
+		else if (args.IsMatched(i, L"uma")) m_deviceType = DEVICE_UMA;
+		else if (args.IsMatched(i, L"i") || args.IsMatched(i, L"image"))
 		{
-			if (hasNextArgValue(i))
-			{
-				m_fileName.resize(wcslen(argv[++i]));
-				for (size_t j = 0; j < m_fileName.size(); ++j)
-					m_fileName[j] = static_cast<char>(argv[i][j]);
-			}
+			if (args.HasNextValue(i)) m_fileName = CommandLineArgs::ToString(argv[++i]);
 		}
-		else if (isArgMatched(i, L"s") || isArgMatched(i, L"sigma"))
+		else if (args.IsMatched(i, L"sigmamap"))
 		{
-			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_sigma);
+			if (args.HasNextValue(i)) m_sigmaMapFileName = CommandLineArgs::ToString(argv[++i]);
+		}
+		else if (args.IsMatched(i, L"s") || args.IsMatched(i, L"sigma"))
+		{
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_sigma);
 			m_isAutoSigma = false;
 		}
-		else if (isArgMatched(i, L"f") || isArgMatched(i, L"focus"))
+		else if (args.IsMatched(i, L"f") || args.IsMatched(i, L"focus"))
 		{
-			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_focus.x);
-			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_focus.y);
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_focus.x);
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_focus.y);
 			m_isAutoFocus = false;
 		}
-		else if (isArgMatched(i, L"u") || isArgMatched(i, L"uniform"))
+		else if (args.IsMatched(i, L"u") || args.IsMatched(i, L"uniform"))
 		{
 			reinterpret_cast<uint32_t&>(m_focus.x) = UINT32_MAX;
 			m_isAutoFocus = false;
 		}
+		else if (args.IsMatched(i, L"l") || args.IsMatched(i, L"level"))
+		{
+			auto level = 0u;
+			if (args.HasNextValue(i)) i += swscanf_s(argv[i + 1], L"%u", &level);
+			m_outputLevel = static_cast<uint8_t>((min)(level, 255u));
+		}
 	}
 }
 
@@ -391,11 +387,12 @@ void NonUniformBlur::PopulateCommandList()
 		XUSG_N_RETURN(pCommandList->Reset(pCommandAllocator, nullptr), ThrowIfFailed(E_FAIL));
 
 		// Record commands.
-		m_filterEZ->Process(pCommandList, m_frameIndex, static_cast<FilterEZ::PipelineType>(m_pipelineType));
+		m_filterEZ->Process(pCommandList, m_frameIndex, static_cast<FilterEZ::PipelineType>(m_pipelineType), m_outputLevel);
 
+		// The filter un-premultiplies the result at any output level
 		const auto pResult = m_filterEZ->GetResult();
 		const TextureCopyLocation dst(pRenderTarget, 0);
-		const TextureCopyLocation src(pResult, 0);
+		const TextureCopyLocation src(pResult, m_outputLevel);
 
 		pCommandList->CopyTextureRegion(dst, 0, 0, 0, src);
 
@@ -428,16 +425,17 @@ void NonUniformBlur::PopulateCommandList()
 
 		const auto dstState = ResourceState::PIXEL_SHADER_RESOURCE |
 			ResourceState::NON_PIXEL_SHADER_RESOURCE | ResourceState::COPY_SOURCE;
-		m_filter->Process(pCommandList, m_frameIndex, m_pipelineType);	// V-cycle
+		m_filter->Process(pCommandList, m_frameIndex, m_pipelineType, m_outputLevel);	// V-cycle
 
 		{
+			// The filter un-premultiplies the result at any output level
 			const auto pResult = m_filter->GetResult();
 			const TextureCopyLocation dst(pRenderTarget, 0);
-			const TextureCopyLocation src(pResult, 0);
+			const TextureCopyLocation src(pResult, m_outputLevel);
 
 			ResourceBarrier barriers[2];
 			auto numBarriers = pRenderTarget->SetBarrier(barriers, ResourceState::COPY_DEST);
-			numBarriers = pResult->SetBarrier(barriers, dstState, numBarriers, 0);
+			numBarriers = pResult->SetBarrier(barriers, dstState, numBarriers, m_outputLevel);
 			pCommandList->Barrier(numBarriers, barriers);
 
 			pCommandList->CopyTextureRegion(dst, 0, 0, 0, src);
@@ -514,19 +512,8 @@ void NonUniformBlur::SaveImage(char const* fileName, Buffer* pImageBuffer, uint3
 	assert(comp == 3 || comp == 4);
 	const auto pData = static_cast<const uint8_t*>(pImageBuffer->Map(nullptr));
 
-	//stbi_write_png_compression_level = 1024;
-	vector<uint8_t> imageData(comp * w * h);
-	const auto sw = rowPitch / 4; // Byte to pixel
-	for (auto i = 0u; i < h; ++i)
-		for (auto j = 0u; j < w; ++j)
-		{
-			const auto s = sw * i + j;
-			const auto d = w * i + j;
-			for (uint8_t k = 0; k < comp; ++k)
-				imageData[comp * d + k] = pData[4 * s + k];
-		}
-
-	stbi_write_png(fileName, w, h, comp, imageData.data(), 0);
+	// Only de-pitching happens here; PNG encoding overlaps with the next frames
+	m_imageWriter->Write(fileName, pData, w, h, rowPitch, comp);
 
 	pImageBuffer->Unmap();
 }
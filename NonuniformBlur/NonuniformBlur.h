@@ -15,6 +15,7 @@
 #include "StepTimer.h"
 #include "Filter.h"
 #include "FilterEZ.h"
+#include "ImageWriter.h"
 
 using namespace DirectX;
 
@@ -87,11 +88,14 @@ private:
 
 	// User external settings
 	std::string m_fileName;
+	std::string m_sigmaMapFileName;
+	uint8_t		m_outputLevel;
 
 	// Screen-shot helpers and state
 	XUSG::Buffer::uptr	m_readBuffer;
 	uint32_t			m_rowPitch;
 	uint8_t				m_screenShot;
+	std::unique_ptr<ImageWriter> m_imageWriter;
 
 	void LoadPipeline(std::vector<XUSG::Resource::uptr>& uploaders);
 	void LoadAssets();
@@ -44,6 +44,11 @@
 #include <unordered_map>
 #endif
 #include <functional>
+#include <deque>
+#include <list>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <wrl.h>
 #include <shellapi.h>
 